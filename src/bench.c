@@ -0,0 +1,497 @@
+#include "chip8.h"
+#include "chip8jit.h"
+#include "chip8ops.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define BENCH_DEFAULT_REPS      10
+#define BENCH_DEFAULT_CYCLES    5000000ULL  /* per repetition */
+#define BENCH_DEFAULT_WARMUP    1000000ULL
+#define BENCH_CSV_HEADER        "name,engine,reps,cycles,ns_per_ins,stddev,min,ins_per_sec,hash\n"
+#define BENCH_MAX_ROWS          256
+
+/**
+ * Synthetic ROMs, each one leaning on a single part of the interpreter,
+ * plus two that look like the main loop of a real game. They all loop
+ * forever, so any cycle budget works.
+ */
+typedef struct BenchRom {
+    const char* name;
+    const uint8_t* data;
+    size_t size;
+} BenchRom;
+
+/* 8xy* and 7xkk back to back */
+static const uint8_t _rom_alu[] = {
+    0x60, 0x01,     /* 200: LD V0, 1 */
+    0x61, 0x03,     /* 202: LD V1, 3 */
+    0x80, 0x14,     /* 204: ADD V0, V1 */
+    0x81, 0x05,     /* 206: SUB V1, V0 */
+    0x82, 0x01,     /* 208: OR V2, V0 */
+    0x83, 0x12,     /* 20A: AND V3, V1 */
+    0x84, 0x23,     /* 20C: XOR V4, V2 */
+    0x85, 0x06,     /* 20E: SHR V5, V0 */
+    0x86, 0x0E,     /* 210: SHL V6, V0 */
+    0x87, 0x07,     /* 212: SUBN V7, V0 */
+    0x70, 0x01,     /* 214: ADD V0, 1 */
+    0x12, 0x04,     /* 216: JP 204 */
+};
+
+/* every kind of skip, taken and not taken, on an odd/even counter */
+static const uint8_t _rom_branch[] = {
+    0x60, 0x00,     /* 200: LD V0, 0 */
+    0x62, 0x01,     /* 202: LD V2, 1 */
+    0x70, 0x01,     /* 204: ADD V0, 1 */
+    0x81, 0x00,     /* 206: LD V1, V0 */
+    0x81, 0x22,     /* 208: AND V1, V2 */
+    0x31, 0x00,     /* 20A: SE V1, 0 */
+    0x12, 0x14,     /* 20C: JP 214 (odd) */
+    0x41, 0x01,     /* 20E: SNE V1, 1 */
+    0x12, 0x00,     /* 210: JP 200 (never) */
+    0x12, 0x04,     /* 212: JP 204 */
+    0x51, 0x20,     /* 214: SE V1, V2 */
+    0x12, 0x00,     /* 216: JP 200 (never) */
+    0x91, 0x20,     /* 218: SNE V1, V2 */
+    0x12, 0x04,     /* 21A: JP 204 */
+};
+
+/* twelve calls deep, then all the way back out */
+static const uint8_t _rom_call[] = {
+    0x22, 0x04, 0x12, 0x00,     /* 200: CALL 204, JP 200 */
+    0x22, 0x08, 0x00, 0xEE,     /* 204: CALL 208, RET */
+    0x22, 0x0C, 0x00, 0xEE,
+    0x22, 0x10, 0x00, 0xEE,
+    0x22, 0x14, 0x00, 0xEE,
+    0x22, 0x18, 0x00, 0xEE,
+    0x22, 0x1C, 0x00, 0xEE,
+    0x22, 0x20, 0x00, 0xEE,
+    0x22, 0x24, 0x00, 0xEE,
+    0x22, 0x28, 0x00, 0xEE,
+    0x22, 0x2C, 0x00, 0xEE,
+    0x22, 0x30, 0x00, 0xEE,     /* 22C: CALL 230, RET */
+    0x00, 0xEE,                 /* 230: RET */
+};
+
+/* fills the screen with sprites that never overlap, then clears it */
+static const uint8_t _rom_draw[] = {
+    0xA2, 0x1A,     /* 200: LD I, 21A */
+    0x00, 0xE0,     /* 202: CLS */
+    0x60, 0x00,     /* 204: LD V0, 0 */
+    0x61, 0x00,     /* 206: LD V1, 0 */
+    0xD0, 0x15,     /* 208: DRW V0, V1, 5 */
+    0x70, 0x08,     /* 20A: ADD V0, 8 */
+    0x30, 0x40,     /* 20C: SE V0, 64 */
+    0x12, 0x08,     /* 20E: JP 208 */
+    0x60, 0x00,     /* 210: LD V0, 0 */
+    0x71, 0x06,     /* 212: ADD V1, 6 */
+    0x31, 0x1E,     /* 214: SE V1, 30 */
+    0x12, 0x08,     /* 216: JP 208 */
+    0x12, 0x02,     /* 218: JP 202 */
+    0xFF, 0x81, 0x81, 0x81, 0xFF,
+};
+
+/* tall sprites walking over each other and off the edges, nearly every one collides */
+static const uint8_t _rom_draw_collide[] = {
+    0xA2, 0x0E,     /* 200: LD I, 20E */
+    0x60, 0x00,     /* 202: LD V0, 0 */
+    0x61, 0x00,     /* 204: LD V1, 0 */
+    0xD0, 0x18,     /* 206: DRW V0, V1, 8 */
+    0x70, 0x03,     /* 208: ADD V0, 3 */
+    0x71, 0x05,     /* 20A: ADD V1, 5 */
+    0x12, 0x06,     /* 20C: JP 206 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/* all sixteen registers out to memory and back in */
+static const uint8_t _rom_mem[] = {
+    0xA3, 0x00,     /* 200: LD I, 300 */
+    0xFF, 0x55,     /* 202: LD [I], VF */
+    0xA3, 0x00,     /* 204: LD I, 300 */
+    0xFF, 0x65,     /* 206: LD VF, [I] */
+    0x70, 0x01,     /* 208: ADD V0, 1 */
+    0x12, 0x00,     /* 20A: JP 200 */
+};
+
+/* two paddles and a ball, keys read every frame, synced on the delay timer */
+static const uint8_t _rom_pong[] = {
+    0x6A, 0x02,     /* 200: LD VA, 2 */
+    0x6B, 0x0C,     /* 202: LD VB, 12 */
+    0x6C, 0x3D,     /* 204: LD VC, 61 */
+    0x6D, 0x0C,     /* 206: LD VD, 12 */
+    0x6E, 0x20,     /* 208: LD VE, 32 */
+    0x68, 0x10,     /* 20A: LD V8, 16 */
+    0x66, 0x01,     /* 20C: LD V6, 1 */
+    0x67, 0x01,     /* 20E: LD V7, 1 */
+    0x00, 0xE0,     /* 210: CLS */
+    0xA2, 0x50,     /* 212: LD I, 250 */
+    0xDA, 0xB6,     /* 214: DRW VA, VB, 6 */
+    0xDC, 0xD6,     /* 216: DRW VC, VD, 6 */
+    0xA2, 0x56,     /* 218: LD I, 256 */
+    0xDE, 0x81,     /* 21A: DRW VE, V8, 1 */
+    0x60, 0x01,     /* 21C: LD V0, 1 */
+    0xE0, 0xA1,     /* 21E: SKNP V0 */
+    0x7B, 0xFF,     /* 220: ADD VB, -1 */
+    0x60, 0x04,     /* 222: LD V0, 4 */
+    0xE0, 0xA1,     /* 224: SKNP V0 */
+    0x7B, 0x01,     /* 226: ADD VB, 1 */
+    0xC1, 0x03,     /* 228: RND V1, 3 */
+    0x8D, 0x14,     /* 22A: ADD VD, V1 */
+    0x62, 0x1F,     /* 22C: LD V2, 31 */
+    0x8D, 0x22,     /* 22E: AND VD, V2 */
+    0x8E, 0x64,     /* 230: ADD VE, V6 */
+    0x88, 0x74,     /* 232: ADD V8, V7 */
+    0x4E, 0x3C,     /* 234: SNE VE, 60 */
+    0x66, 0xFF,     /* 236: LD V6, -1 */
+    0x4E, 0x03,     /* 238: SNE VE, 3 */
+    0x66, 0x01,     /* 23A: LD V6, 1 */
+    0x48, 0x1E,     /* 23C: SNE V8, 30 */
+    0x67, 0xFF,     /* 23E: LD V7, -1 */
+    0x48, 0x00,     /* 240: SNE V8, 0 */
+    0x67, 0x01,     /* 242: LD V7, 1 */
+    0x60, 0x01,     /* 244: LD V0, 1 */
+    0xF0, 0x15,     /* 246: LD DT, V0 */
+    0xF0, 0x07,     /* 248: LD V0, DT */
+    0x30, 0x00,     /* 24A: SE V0, 0 */
+    0x12, 0x48,     /* 24C: JP 248 */
+    0x12, 0x10,     /* 24E: JP 210 */
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80,
+};
+
+/* a score counter in font digits plus a randomly dropped piece, every frame */
+static const uint8_t _rom_score[] = {
+    0x65, 0x00,     /* 200: LD V5, 0 */
+    0x00, 0xE0,     /* 202: CLS */
+    0x75, 0x01,     /* 204: ADD V5, 1 */
+    0xA3, 0x00,     /* 206: LD I, 300 */
+    0xF5, 0x33,     /* 208: LD B, V5 */
+    0xF2, 0x65,     /* 20A: LD V2, [I] */
+    0x63, 0x00,     /* 20C: LD V3, 0 */
+    0x64, 0x00,     /* 20E: LD V4, 0 */
+    0xF0, 0x29,     /* 210: LD F, V0 */
+    0xD3, 0x45,     /* 212: DRW V3, V4, 5 */
+    0x73, 0x05,     /* 214: ADD V3, 5 */
+    0xF1, 0x29,     /* 216: LD F, V1 */
+    0xD3, 0x45,     /* 218: DRW V3, V4, 5 */
+    0x73, 0x05,     /* 21A: ADD V3, 5 */
+    0xF2, 0x29,     /* 21C: LD F, V2 */
+    0xD3, 0x45,     /* 21E: DRW V3, V4, 5 */
+    0xC0, 0x3F,     /* 220: RND V0, 63 */
+    0xC1, 0x1F,     /* 222: RND V1, 31 */
+    0xA2, 0x32,     /* 224: LD I, 232 */
+    0x62, 0x02,     /* 226: LD V2, 2 */
+    0xF2, 0x1E,     /* 228: ADD I, V2 */
+    0xD0, 0x14,     /* 22A: DRW V0, V1, 4 */
+    0x3F, 0x00,     /* 22C: SE VF, 0 */
+    0x65, 0x00,     /* 22E: LD V5, 0 */
+    0x12, 0x02,     /* 230: JP 202 */
+    0xC0, 0xC0, 0x60, 0x60, 0x30, 0x30,
+};
+
+static const BenchRom _roms[] = {
+    { "alu", _rom_alu, sizeof(_rom_alu) },
+    { "branch", _rom_branch, sizeof(_rom_branch) },
+    { "call", _rom_call, sizeof(_rom_call) },
+    { "draw", _rom_draw, sizeof(_rom_draw) },
+    { "draw-collide", _rom_draw_collide, sizeof(_rom_draw_collide) },
+    { "mem", _rom_mem, sizeof(_rom_mem) },
+    { "pong", _rom_pong, sizeof(_rom_pong) },
+    { "score", _rom_score, sizeof(_rom_score) },
+};
+
+/* one benchmark on one engine */
+typedef struct BenchResult {
+    char name[64];
+    char engine[8];
+    int reps;
+    uint64_t cycles;
+    double mean;            /* ns per instruction */
+    double stddev;
+    double min;
+    uint64_t hash;          /* chip8StateHash after the last repetition */
+} BenchResult;
+
+static int _reps = BENCH_DEFAULT_REPS;
+static uint64_t _cycles = BENCH_DEFAULT_CYCLES;
+static uint64_t _warmup = BENCH_DEFAULT_WARMUP;
+
+static int _bench(Chip8* vm, Chip8Jit* jit, const char* name, const uint8_t* rom, size_t size, BenchResult* res);
+static void _print_result(const BenchResult* res, const BenchResult* base);
+static void _write_csv(FILE* file, const BenchResult* res);
+static int _read_csv(const char* path, BenchResult* rows, int max);
+static const BenchResult* _find(const BenchResult* rows, int count, const BenchResult* res);
+static uint8_t* _read_file(const char* path, size_t* size);
+static void _usage(const char* prog);
+
+/**
+ * Runs every synthetic ROM (and any ROM files given) on the interpreter,
+ * and on the JIT when there is one. Each gets a warm-up, then reps timed
+ * repetitions of the same number of cycles; the spread between those is
+ * what says whether a difference between two runs is real.
+ */
+int main(int argc, char const *argv[])
+{
+    const char* outPath = NULL;
+    const char* basePath = NULL;
+    const char* filter = NULL;
+    int useJit = 1;
+    int first = 1;
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-r") == 0 && first + 1 < argc) {
+            _reps = atoi(argv[first + 1]);
+            first += 2;
+        } else if (strcmp(argv[first], "-c") == 0 && first + 1 < argc) {
+            _cycles = strtoull(argv[first + 1], NULL, 10);
+            first += 2;
+        } else if (strcmp(argv[first], "-w") == 0 && first + 1 < argc) {
+            _warmup = strtoull(argv[first + 1], NULL, 10);
+            first += 2;
+        } else if (strcmp(argv[first], "-o") == 0 && first + 1 < argc) {
+            outPath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-b") == 0 && first + 1 < argc) {
+            basePath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-f") == 0 && first + 1 < argc) {
+            filter = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-i") == 0) {
+            useJit = 0;
+            first++;
+        } else {
+            _usage(argv[0]);
+            return 1;
+        }
+    }
+    if (_reps < 1 || _cycles == 0) {
+        _usage(argv[0]);
+        return 1;
+    }
+
+    /* read the baseline before the output is opened, they may be the same file */
+    BenchResult* base = calloc(BENCH_MAX_ROWS, sizeof(BenchResult));
+    int baseCount = 0;
+    if (!base) {
+        return 1;
+    }
+    if (basePath) {
+        baseCount = _read_csv(basePath, base, BENCH_MAX_ROWS);
+        if (baseCount < 0) {
+            printf("could not read baseline %s\n", basePath);
+            free(base);
+            return 1;
+        }
+    }
+    FILE* out = NULL;
+    if (outPath) {
+        out = fopen(outPath, "w");
+        if (!out) {
+            printf("could not open %s\n", outPath);
+            free(base);
+            return 1;
+        }
+        fputs(BENCH_CSV_HEADER, out);
+    }
+
+    Chip8Jit* jit = useJit ? chip8JitCreate() : NULL;
+    Chip8* vm = calloc(1, sizeof(Chip8));
+    if (!vm) {
+        chip8JitDestroy(jit);
+        free(base);
+        return 1;
+    }
+    printf("reps=%d cycles=%llu warmup=%llu%s\n",
+        _reps,
+        (unsigned long long) _cycles,
+        (unsigned long long) _warmup,
+        useJit && !jit ? " (no JIT on this host)" : ""
+    );
+    printf("%-24s %-6s %10s %9s %10s %12s\n", "name", "engine", "ns/ins", "stddev", "min", "ins/s");
+
+    int failed = 0;
+    int count = (int) (sizeof(_roms) / sizeof(_roms[0]));
+    for (int i = 0; i < count + argc - first; i++) {
+        const char* name;
+        uint8_t* file = NULL;
+        const uint8_t* rom;
+        size_t size = 0;
+        if (i < count) {
+            name = _roms[i].name;
+            rom = _roms[i].data;
+            size = _roms[i].size;
+        } else {
+            name = argv[first + i - count];
+            file = _read_file(name, &size);
+            rom = file;
+        }
+        if (filter && !strstr(name, filter)) {
+            free(file);
+            continue;
+        }
+        if (!rom) {
+            printf("%s: could not load rom\n", name);
+            failed = 1;
+            continue;
+        }
+        for (int e = 0; e < (jit ? 2 : 1); e++) {
+            BenchResult res;
+            if (!_bench(vm, e ? jit : NULL, name, rom, size, &res)) {
+                failed = 1;
+                continue;
+            }
+            _print_result(&res, _find(base, baseCount, &res));
+            if (out) {
+                _write_csv(out, &res);
+            }
+        }
+        free(file);
+    }
+
+    if (out && fclose(out) != 0) {
+        printf("could not write %s\n", outPath);
+        failed = 1;
+    }
+    chip8Destroy(vm);
+    free(vm);
+    chip8JitDestroy(jit);
+    free(base);
+    return failed;
+}
+
+static void _usage(const char* prog) {
+    printf("Usage: %s [-r reps] [-c cycles] [-w warmup] [-f filter] [-i] [-o results.csv] [-b baseline.csv] [rom...]\n", prog);
+    printf("  -r  timed repetitions per benchmark (%d)\n", BENCH_DEFAULT_REPS);
+    printf("  -c  cycles per repetition (%llu)\n", BENCH_DEFAULT_CYCLES);
+    printf("  -w  cycles run before timing anything (%llu)\n", BENCH_DEFAULT_WARMUP);
+    printf("  -f  only run benchmarks whose name contains this\n");
+    printf("  -i  interpreter only, leave the JIT out\n");
+    printf("  -o  write the results as CSV\n");
+    printf("  -b  compare against the CSV of an earlier run\n");
+    printf("  any ROM files given are benchmarked after the built-in ones\n");
+}
+
+static int _bench(Chip8* vm, Chip8Jit* jit, const char* name, const uint8_t* rom, size_t size, BenchResult* res) {
+    memset(res, 0, sizeof(*res));
+    snprintf(res->name, sizeof(res->name), "%s", name);
+    snprintf(res->engine, sizeof(res->engine), "%s", jit ? "jit" : "interp");
+    if (!chip8LoadFromArray(vm, rom, size)) {
+        printf("%s: could not load rom\n", name);
+        return 0;
+    }
+    chip8JitFlush(jit);
+    chip8JitRunFor(jit, vm, _warmup);
+
+    double sum = 0, sumSq = 0;
+    res->min = INFINITY;
+    for (int r = 0; r < _reps; r++) {
+        double start = chip8NowSeconds();
+        uint64_t ran = chip8JitRunFor(jit, vm, _cycles);
+        double elapsed = chip8NowSeconds() - start;
+        if (ran < _cycles) {
+            printf("%s: stopped after %llu cycles (err=%d)\n", name, (unsigned long long) (vm->cycles), vm->err);
+            return 0;
+        }
+        double ns = elapsed * 1e9 / ran;
+        sum += ns;
+        sumSq += ns * ns;
+        if (ns < res->min) {
+            res->min = ns;
+        }
+    }
+    res->reps = _reps;
+    res->cycles = _cycles;
+    res->mean = sum / _reps;
+    double var = _reps > 1 ? (sumSq - sum * res->mean) / (_reps - 1) : 0;
+    res->stddev = var > 0 ? sqrt(var) : 0;
+    res->hash = chip8StateHash(vm);
+    return 1;
+}
+
+/* against a baseline, the change is in mean ns/ins: negative is faster */
+static void _print_result(const BenchResult* res, const BenchResult* base) {
+    printf("%-24s %-6s %10.3f %8.1f%% %10.3f %12.0f",
+        res->name,
+        res->engine,
+        res->mean,
+        res->mean > 0 ? 100.0 * res->stddev / res->mean : 0,
+        res->min,
+        res->mean > 0 ? 1e9 / res->mean : 0
+    );
+    if (base && base->mean > 0) {
+        printf("  %+6.1f%%%s",
+            100.0 * (res->mean - base->mean) / base->mean,
+            base->hash != res->hash && base->cycles == res->cycles && base->reps == res->reps ? " (state differs)" : ""
+        );
+    }
+    printf("\n");
+}
+
+static void _write_csv(FILE* file, const BenchResult* res) {
+    fprintf(file, "%s,%s,%d,%llu,%.4f,%.4f,%.4f,%.0f,0x%016llX\n",
+        res->name,
+        res->engine,
+        res->reps,
+        (unsigned long long) res->cycles,
+        res->mean,
+        res->stddev,
+        res->min,
+        res->mean > 0 ? 1e9 / res->mean : 0,
+        (unsigned long long) res->hash
+    );
+}
+
+/* returns the number of rows read, -1 if the file can't be opened */
+static int _read_csv(const char* path, BenchResult* rows, int max) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    char line[512];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), file)) {
+        BenchResult* r = &rows[count];
+        unsigned long long cycles = 0, hash = 0;
+        double ips = 0;
+        if (sscanf(line, "%63[^,],%7[^,],%d,%llu,%lf,%lf,%lf,%lf,%llx",
+                r->name, r->engine, &r->reps, &cycles, &r->mean, &r->stddev, &r->min, &ips, &hash) == 9) {
+            r->cycles = cycles;
+            r->hash = hash;
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static const BenchResult* _find(const BenchResult* rows, int count, const BenchResult* res) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(rows[i].name, res->name) == 0 && strcmp(rows[i].engine, res->engine) == 0) {
+            return &rows[i];
+        }
+    }
+    return NULL;
+}
+
+static uint8_t* _read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0L, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    uint8_t* buf = len > 0 ? malloc(len) : NULL;
+    if (!buf || fread(buf, 1, len, file) != (size_t) len) {
+        free(buf);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *size = (size_t) len;
+    return buf;
+}
+
@@ -1,14 +1,20 @@
 #include "chip8.h"
-#include "raylib.h"
+#include "chip8ops.h"
+#ifdef C8_TRACE
+#include "chip8trace.h"
+#endif
 
 #include <string.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <limits.h>
-#include <time.h>
 
 #define C8_BEGIN_ADDRESS    0x200
+#define C8_ADDR_MASK        (C8_MEMORY_SIZE - 1)    /* addresses wrap at the end of memory, 4k or 64k */
+#define C8_EXT_OPS          (C8_QUIRK_SCHIP_OPS | C8_QUIRK_XOCHIP_OPS)
+#define C8_BIG_FONT_SIZE    10                      /* bytes per 8x10 digit */
 
 #define C8_INS_HI(ins)      (((ins) & 0xF000U) >> 12)
 #define C8_INS_LO(ins)      ((ins) & 0x000FU)
@@ -20,6 +26,93 @@
 #define C8_EXTR_BYTE(ins)   ((ins) & 0x00FFU)
 
 
+#define C8_DUMP_BUF_SIZE    4096
+#define C8_DUMP_TABLE_HEADER "00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F \n"
+#define C8_DUMP_ADDR_DIGITS(size) ((size) > 0x1000 ? 4 : 3)   /* for the addresses in a table of size bytes */
+
+#define C8_STATE_MAGIC      "C8ST"
+
+/* the profiler's hooks, nothing at all when it's compiled out */
+#ifdef C8_PROFILE
+#define C8_PROFILE_INS(c8, pc, ins) do {                    \
+        (c8)->profile.ops[(ins)->op]++;                     \
+        (c8)->profile.pcs[(pc) & (C8_MEMORY_SIZE - 1)]++;   \
+    } while (0)
+#define C8_PROFILE_DRAW(c8, hit)    ((c8)->profile.collisions += (hit))
+
+_Static_assert(C8_OP_COUNT <= C8_PROFILE_OPS, "Chip8Profile::ops is too small");
+_Static_assert(C8_MEMORY_SIZE / C8_PAGE_SIZE <= 64, "Chip8::dirtyPages is too small");
+
+static const char* const _op_names[C8_OP_COUNT] = {
+    [C8_OP_UNKNOWN]     = "unknown",
+    [C8_OP_CLS]         = "00E0",   [C8_OP_RET]         = "00EE",   [C8_OP_SYS]         = "0nnn",
+    [C8_OP_JP]          = "1nnn",   [C8_OP_CALL]        = "2nnn",   [C8_OP_SE_BYTE]     = "3xkk",
+    [C8_OP_SNE_BYTE]    = "4xkk",   [C8_OP_SE_REG]      = "5xy0",   [C8_OP_LD_BYTE]     = "6xkk",
+    [C8_OP_ADD_BYTE]    = "7xkk",   [C8_OP_LD_REG]      = "8xy0",   [C8_OP_OR]          = "8xy1",
+    [C8_OP_AND]         = "8xy2",   [C8_OP_XOR]         = "8xy3",   [C8_OP_ADD_REG]     = "8xy4",
+    [C8_OP_SUB]         = "8xy5",   [C8_OP_SHR]         = "8xy6",   [C8_OP_SUBN]        = "8xy7",
+    [C8_OP_SHL]         = "8xyE",   [C8_OP_SNE_REG]     = "9xy0",   [C8_OP_LD_I]        = "Annn",
+    [C8_OP_JP_V0]       = "Bnnn",   [C8_OP_RND]         = "Cxkk",   [C8_OP_DRW]         = "Dxyn",
+    [C8_OP_SKP]         = "Ex9E",   [C8_OP_SKNP]        = "ExA1",   [C8_OP_LD_VX_DT]    = "Fx07",
+    [C8_OP_LD_VX_K]     = "Fx0A",   [C8_OP_LD_DT_VX]    = "Fx15",   [C8_OP_LD_ST_VX]    = "Fx18",
+    [C8_OP_ADD_I_VX]    = "Fx1E",   [C8_OP_LD_F_VX]     = "Fx29",   [C8_OP_LD_B_VX]     = "Fx33",
+    [C8_OP_LD_MEM_VX]   = "Fx55",   [C8_OP_LD_VX_MEM]   = "Fx65",   [C8_OP_SCD]         = "00Cn",
+    [C8_OP_SCU]         = "00Dn",   [C8_OP_SCR]         = "00FB",   [C8_OP_SCL]         = "00FC",
+    [C8_OP_LOW]         = "00FE",   [C8_OP_HIGH]        = "00FF",   [C8_OP_EXIT]        = "00FD",
+    [C8_OP_LD_HF_VX]    = "Fx30",   [C8_OP_LD_R_VX]     = "Fx75",   [C8_OP_LD_VX_R]     = "Fx85",
+    [C8_OP_SAVE_RANGE]  = "5xy2",   [C8_OP_LOAD_RANGE]  = "5xy3",   [C8_OP_LD_I_LONG]   = "F000",
+    [C8_OP_PLANE]       = "Fn01",   [C8_OP_AUDIO]       = "F002",   [C8_OP_PITCH]       = "Fx3A",
+};
+#else
+#define C8_PROFILE_INS(c8, pc, ins) ((void) 0)
+#define C8_PROFILE_DRAW(c8, hit)    ((void) 0)
+#endif
+
+/* the fuzzer's coverage hook, same deal */
+#ifdef C8_FUZZ
+/* libFuzzer picks counters in this section up on its own */
+#if defined(C8_LIBFUZZER) && defined(__linux__)
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+uint8_t chip8FuzzCoverage[C8_FUZZ_MAP_SIZE];
+static uint32_t _fuzzPrev;
+
+#define C8_FUZZ_EDGE(pc, ins) do {                                          \
+        uint32_t cur_ = ((uint32_t) (pc) << 6 | (ins)->op) * 0x9E3779B1U;   \
+        cur_ >>= 32 - C8_FUZZ_MAP_BITS;                                     \
+        chip8FuzzCoverage[cur_ ^ _fuzzPrev]++;                              \
+        _fuzzPrev = cur_ >> 1;                                              \
+    } while (0)
+
+_Static_assert(C8_OP_COUNT <= 64, "C8_FUZZ_EDGE packs op into 6 bits");
+
+void chip8FuzzReset(void) {
+    memset(chip8FuzzCoverage, 0, sizeof(chip8FuzzCoverage));
+    _fuzzPrev = 0;
+}
+
+#else
+#define C8_FUZZ_EDGE(pc, ins)       ((void) 0)
+#endif
+
+/* and the tracer's, after every instruction (see chip8trace.h) */
+#ifdef C8_TRACE
+#define C8_TRACE_INS(c8, pc, ins, ran) do {                                             \
+        if ((c8)->tracer) {                                                             \
+            chip8TracerPush((c8)->tracer, (c8), (pc), (ins), (c8)->cycles + (ran));     \
+        }                                                                               \
+    } while (0)
+#else
+#define C8_TRACE_INS(c8, pc, ins, ran)  ((void) 0)
+#endif
+
+/* dumps are put together in here and written out a buffer at a time */
+typedef struct Chip8Dump {
+    FILE* file;
+    size_t len;
+    char buf[C8_DUMP_BUF_SIZE];
+} Chip8Dump;
+
 static const uint8_t _chip8FontSet[80] = { 
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
     0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -39,114 +132,252 @@ static const uint8_t _chip8FontSet[80] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-static void _op_unknown(Chip8* c8);
-static void _op_nop(Chip8* c8);
-
-static void _op0_cls(Chip8* c8);        /* 00E0 */
-static void _op0_ret(Chip8* c8);        /* 00EE */
-static void _op0_sys(Chip8* c8);        /* 0nnn */
-
-static void _op1_jump_addr(Chip8* c8);          /* 1nnn */
-static void _op2_call(Chip8* c8);               /* 2nnn */
-static void _op3_skip_eq_byte(Chip8* c8);       /* 3xkk */
-static void _op4_skip_neq_byte(Chip8* c8);      /* 4xkk */
-static void _op5_skip_eq_reg(Chip8* c8);        /* 5xy0 */
-static void _op6_load_byte(Chip8* c8);          /* 6xkk */
-static void _op7_add_byte(Chip8* c8);           /* 7xkk  */
-
-static void _op8_load_reg(Chip8* c8);           /* 8xy0 */
-static void _op8_or(Chip8* c8);                 /* 8xy1 */
-static void _op8_and(Chip8* c8);                /* 8xy2 */
-static void _op8_xor(Chip8* c8);                /* 8xy3 */
-static void _op8_add_reg(Chip8* c8);            /* 8xy4 */
-static void _op8_sub_reg(Chip8* c8);            /* 8xy5 */
-static void _op8_shiftr_reg(Chip8* c8);         /* 8xy6 */
-static void _op8_sub_reversed_reg(Chip8* c8);   /* 8xy7 */
-static void _op8_shiftl_reg(Chip8* c8);         /* 8xyE*/
-
-static void _op9_skip_neq_reg(Chip8* c8);       /* 9xy0 */
-static void _opA_load_I(Chip8* c8);             /* Annn */
-static void _opB_jump_reg(Chip8* c8);           /* Bnnn */
-static void _opC_rand(Chip8* c8);               /* Cxkk */
-static void _opD_draw_sprite(Chip8* c8);        /* Dxyn */
-
-static void _opE_skip_on_keypress(Chip8* c8);       /* Ex9E */
-static void _opE_skip_on_keyrelease(Chip8* c8);     /* ExA1 */
-
-static void _opF_load_delay_timer_toreg(Chip8* c8);             /* Fx07 */
-static void _opF_load_keypress_and_wait(Chip8* c8);             /* Fx0A */
-static void _opF_load_delay_timer_set(Chip8* c8);               /* Fx15 */
-static void _opF_load_sound_timer_set(Chip8* c8);               /* Fx18 */
-static void _opF_add_I_reg(Chip8* c8);                          /* Fx1E */
-static void _opF_load_hex_sprite_for_value(Chip8* c8);          /* Fx29 */
-static void _opF_store_bcd_rep_of_reg(Chip8* c8);               /* Fx33 */
-static void _opF_store_regs_to_mem_starting_at_I(Chip8* c8);    /* Fx55 */
-static void _opF_load_regs_from_mem_starting_at_I(Chip8* c8);   /* Fx65 */
-
-static void _0prefix_ins(Chip8* c8);            /* 00E0 and 00EE - if statement */
-static void _8prefix_ins(Chip8* c8);        
-static void _Eprefix_ins(Chip8* c8);            /* Ex9E and ExA1 - if statement */ 
-static void _Fprefix_ins(Chip8* c8);            /* if statement for functions that end on 5 */
-
-static void (*_ins_arr[16])(Chip8*) = {
-    _0prefix_ins,                   // 0
-
-    _op1_jump_addr,                 // 1
-    _op2_call,                      // 2
-    _op3_skip_eq_byte,              // 3
-    _op4_skip_neq_byte,             // 4
-    _op5_skip_eq_reg,               // 5
-    _op6_load_byte,                 // 6
-    _op7_add_byte,                  // 7
-
-    _8prefix_ins,           
-
-    _op9_skip_neq_reg,              // 9
-    _opA_load_I,                    // A
-    _opB_jump_reg,                  // B
-    _opC_rand,                      // C
-    _opD_draw_sprite,               // D
-
-    _Eprefix_ins,                   // E
-    _Fprefix_ins                    // F
-};  
-
-static void (*_8ins_arr[16])(Chip8*) = {
-    _op8_load_reg,                  // 0
-    _op8_or,                        // 1
-    _op8_and,                       // 2
-    _op8_xor,                       // 3
-    _op8_add_reg,                   // 4
-    _op8_sub_reg,                   // 5
-    _op8_shiftr_reg,                // 6
-    _op8_sub_reversed_reg,          // 7
-    _op_unknown,                    // 8
-    _op_unknown,                    // 9
-    _op_unknown,                    // A
-    _op_unknown,                    // B
-    _op_unknown,                    // C
-    _op_unknown,                    // D
-    _op8_shiftl_reg,                // E
-    _op_unknown,                    // F
+static const uint8_t _chip8BigFontSet[16 * C8_BIG_FONT_SIZE] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
 };
 
-static void (*_Fins_arr[16])(Chip8*) = {
-    _op_unknown,                    // 0
-    _op_unknown,                    // 1
-    _op_unknown,                    // 2
-    _opF_store_bcd_rep_of_reg ,     // 3
-    _op_unknown,                    // 4
-    _op_unknown,                    // 5
-    _op_unknown,                    // 6
-    _opF_load_delay_timer_toreg,    // 7
-    _opF_load_sound_timer_set,      // 8
-    _opF_load_hex_sprite_for_value, // 9
-    _opF_load_keypress_and_wait,    // A
-    _op_unknown,                    // B
-    _op_unknown,                    // C
-    _op_unknown,                    // D
-    _opF_add_I_reg,                 // E
-    _op_unknown,                    // F
+static inline uint16_t _op_unknown(Chip8* c8, const Chip8Ins* ins, uint16_t pc);
+static inline uint16_t _op_nop(Chip8* c8, const Chip8Ins* ins, uint16_t pc);
+
+static inline uint16_t _op0_cls(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                       /* 00E0 */
+static inline uint16_t _op0_ret(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                       /* 00EE */
+static inline uint16_t _op0_sys(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                       /* 0nnn */
+static inline uint16_t _op0_scroll_down(Chip8* c8, const Chip8Ins* ins, uint16_t pc);               /* 00Cn */
+static inline uint16_t _op0_scroll_up(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                 /* 00Dn */
+static inline uint16_t _op0_scroll_right(Chip8* c8, const Chip8Ins* ins, uint16_t pc);              /* 00FB */
+static inline uint16_t _op0_scroll_left(Chip8* c8, const Chip8Ins* ins, uint16_t pc);               /* 00FC */
+static inline uint16_t _op0_exit(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                      /* 00FD */
+static inline uint16_t _op0_lores(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                     /* 00FE */
+static inline uint16_t _op0_hires(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                     /* 00FF */
+
+static inline uint16_t _op1_jump_addr(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                 /* 1nnn */
+static inline uint16_t _op2_call(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                      /* 2nnn */
+static inline uint16_t _op3_skip_eq_byte(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);            /* 3xkk */
+static inline uint16_t _op4_skip_neq_byte(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);           /* 4xkk */
+static inline uint16_t _op5_skip_eq_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);             /* 5xy0 */
+static inline uint16_t _op5_store_range(Chip8* c8, const Chip8Ins* ins, uint16_t pc);               /* 5xy2 */
+static inline uint16_t _op5_load_range(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                /* 5xy3 */
+static inline uint16_t _op6_load_byte(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                 /* 6xkk */
+static inline uint16_t _op7_add_byte(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                  /* 7xkk  */
+
+static inline uint16_t _op8_load_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                  /* 8xy0 */
+static inline uint16_t _op8_or(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                        /* 8xy1 */
+static inline uint16_t _op8_and(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                       /* 8xy2 */
+static inline uint16_t _op8_xor(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                       /* 8xy3 */
+static inline uint16_t _op8_add_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                   /* 8xy4 */
+static inline uint16_t _op8_sub_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                   /* 8xy5 */
+static inline uint16_t _op8_shiftr_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);                /* 8xy6 */
+static inline uint16_t _op8_sub_reversed_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc);          /* 8xy7 */
+static inline uint16_t _op8_shiftl_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);                /* 8xyE */
+
+static inline uint16_t _op9_skip_neq_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);            /* 9xy0 */
+static inline uint16_t _opA_load_I(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                    /* Annn */
+static inline uint16_t _opB_jump_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);                  /* Bnnn */
+static inline uint16_t _opC_rand(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                      /* Cxkk */
+static inline uint16_t _opD_draw_sprite(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);               /* Dxyn */
+
+static inline uint16_t _opE_skip_on_keypress(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);        /* Ex9E */
+static inline uint16_t _opE_skip_on_keyrelease(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);      /* ExA1 */
+
+static inline uint16_t _opF_load_delay_timer_toreg(Chip8* c8, const Chip8Ins* ins, uint16_t pc);    /* Fx07 */
+static inline uint16_t _opF_load_keypress_and_wait(Chip8* c8, const Chip8Ins* ins, uint16_t pc);    /* Fx0A */
+static inline uint16_t _opF_load_delay_timer_set(Chip8* c8, const Chip8Ins* ins, uint16_t pc);      /* Fx15 */
+static inline uint16_t _opF_load_sound_timer_set(Chip8* c8, const Chip8Ins* ins, uint16_t pc);      /* Fx18 */
+static inline uint16_t _opF_add_I_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);                 /* Fx1E */
+static inline uint16_t _opF_load_hex_sprite_for_value(Chip8* c8, const Chip8Ins* ins, uint16_t pc); /* Fx29 */
+static inline uint16_t _opF_store_bcd_rep_of_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc);      /* Fx33 */
+static inline uint16_t _opF_store_regs_to_mem_starting_at_I(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);/* Fx55 */
+static inline uint16_t _opF_load_regs_from_mem_starting_at_I(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);/* Fx65 */
+static inline uint16_t _opF_load_big_sprite_for_value(Chip8* c8, const Chip8Ins* ins, uint16_t pc); /* Fx30 */
+static inline uint16_t _opF_store_regs_to_flags(Chip8* c8, const Chip8Ins* ins, uint16_t pc);       /* Fx75 */
+static inline uint16_t _opF_load_regs_from_flags(Chip8* c8, const Chip8Ins* ins, uint16_t pc);      /* Fx85 */
+static inline uint16_t _opF_load_I_long(Chip8* c8, const Chip8Ins* ins, uint16_t pc);               /* F000 nnnn */
+static inline uint16_t _opF_select_planes(Chip8* c8, const Chip8Ins* ins, uint16_t pc);             /* Fn01 */
+static inline uint16_t _opF_load_audio_pattern(Chip8* c8, const Chip8Ins* ins, uint16_t pc);        /* F002 */
+static inline uint16_t _opF_set_pitch(Chip8* c8, const Chip8Ins* ins, uint16_t pc);                 /* Fx3A */
+
+static uint8_t _0prefix_ins(uint16_t opcode);        /* 00E0 and 00EE - if statement */
+static uint8_t _8prefix_ins(uint16_t opcode);
+static uint8_t _Eprefix_ins(uint16_t opcode);        /* Ex9E and ExA1 - if statement */
+static uint8_t _Fprefix_ins(uint16_t opcode);        /* if statement for functions that end on 5 */
+static uint8_t _extended_ins(uint16_t opcode, unsigned quirks, uint8_t op);
+
+/**
+ * Quirk profiles (see C8_QUIRK_PROFILES). The handlers a quirk changes take
+ * the quirks as an argument, and each profile gets its own wrappers that
+ * pass them in as a constant, so every copy has its quirk checks folded
+ * away and nothing is left to branch on per instruction.
+ */
+#define C8_QUIRKY(id, quirks, handler)                                          \
+    static inline uint16_t handler##_##id(Chip8* c8, const Chip8Ins* ins, uint16_t pc) { \
+        return handler(c8, ins, pc, quirks);                                    \
+    }
+
+#define C8_QUIRK_HANDLERS(id, name, quirks)                                     \
+    C8_QUIRKY(id, quirks, _op3_skip_eq_byte)                                    \
+    C8_QUIRKY(id, quirks, _op4_skip_neq_byte)                                   \
+    C8_QUIRKY(id, quirks, _op5_skip_eq_reg)                                     \
+    C8_QUIRKY(id, quirks, _op9_skip_neq_reg)                                    \
+    C8_QUIRKY(id, quirks, _opE_skip_on_keypress)                                \
+    C8_QUIRKY(id, quirks, _opE_skip_on_keyrelease)                              \
+    C8_QUIRKY(id, quirks, _op8_shiftr_reg)                                      \
+    C8_QUIRKY(id, quirks, _op8_shiftl_reg)                                      \
+    C8_QUIRKY(id, quirks, _opB_jump_reg)                                        \
+    C8_QUIRKY(id, quirks, _opD_draw_sprite)                                     \
+    C8_QUIRKY(id, quirks, _opF_add_I_reg)                                       \
+    C8_QUIRKY(id, quirks, _opF_store_regs_to_mem_starting_at_I)                 \
+    C8_QUIRKY(id, quirks, _opF_load_regs_from_mem_starting_at_I)
+
+C8_QUIRK_PROFILES(C8_QUIRK_HANDLERS)
+
+#undef C8_QUIRK_HANDLERS
+#undef C8_QUIRKY
+
+#define C8_QUIRKS_NAME(id, name, quirks)    [C8_QUIRKS_##id] = name,
+#define C8_QUIRKS_FLAGS(id, name, quirks)   [C8_QUIRKS_##id] = quirks,
+static const char* const _quirks_names[C8_QUIRKS_COUNT] = { C8_QUIRK_PROFILES(C8_QUIRKS_NAME) };
+static const uint8_t _quirks_flags[C8_QUIRKS_COUNT] = { C8_QUIRK_PROFILES(C8_QUIRKS_FLAGS) };
+#undef C8_QUIRKS_NAME
+#undef C8_QUIRKS_FLAGS
+
+/* one table per quirk profile. the threaded interpreter jumps to labels instead (see _run), the JIT still calls them */
+#define C8_HANDLER_TABLE(id, name, quirks) [C8_QUIRKS_##id] = {                \
+        [C8_OP_NONE]        = _op_unknown,                                      \
+        [C8_OP_UNKNOWN]     = _op_unknown,                                      \
+        [C8_OP_CLS]         = _op0_cls,                                         \
+        [C8_OP_RET]         = _op0_ret,                                         \
+        [C8_OP_SYS]         = _op0_sys,                                         \
+        [C8_OP_JP]          = _op1_jump_addr,                                   \
+        [C8_OP_CALL]        = _op2_call,                                        \
+        [C8_OP_SE_BYTE]     = _op3_skip_eq_byte_##id,                           \
+        [C8_OP_SNE_BYTE]    = _op4_skip_neq_byte_##id,                          \
+        [C8_OP_SE_REG]      = _op5_skip_eq_reg_##id,                            \
+        [C8_OP_LD_BYTE]     = _op6_load_byte,                                   \
+        [C8_OP_ADD_BYTE]    = _op7_add_byte,                                    \
+        [C8_OP_LD_REG]      = _op8_load_reg,                                    \
+        [C8_OP_OR]          = _op8_or,                                          \
+        [C8_OP_AND]         = _op8_and,                                         \
+        [C8_OP_XOR]         = _op8_xor,                                         \
+        [C8_OP_ADD_REG]     = _op8_add_reg,                                     \
+        [C8_OP_SUB]         = _op8_sub_reg,                                     \
+        [C8_OP_SHR]         = _op8_shiftr_reg_##id,                             \
+        [C8_OP_SUBN]        = _op8_sub_reversed_reg,                            \
+        [C8_OP_SHL]         = _op8_shiftl_reg_##id,                             \
+        [C8_OP_SNE_REG]     = _op9_skip_neq_reg_##id,                           \
+        [C8_OP_LD_I]        = _opA_load_I,                                      \
+        [C8_OP_JP_V0]       = _opB_jump_reg_##id,                               \
+        [C8_OP_RND]         = _opC_rand,                                        \
+        [C8_OP_DRW]         = _opD_draw_sprite_##id,                            \
+        [C8_OP_SKP]         = _opE_skip_on_keypress_##id,                       \
+        [C8_OP_SKNP]        = _opE_skip_on_keyrelease_##id,                     \
+        [C8_OP_LD_VX_DT]    = _opF_load_delay_timer_toreg,                      \
+        [C8_OP_LD_VX_K]     = _opF_load_keypress_and_wait,                      \
+        [C8_OP_LD_DT_VX]    = _opF_load_delay_timer_set,                        \
+        [C8_OP_LD_ST_VX]    = _opF_load_sound_timer_set,                        \
+        [C8_OP_ADD_I_VX]    = _opF_add_I_reg_##id,                              \
+        [C8_OP_LD_F_VX]     = _opF_load_hex_sprite_for_value,                   \
+        [C8_OP_LD_B_VX]     = _opF_store_bcd_rep_of_reg,                        \
+        [C8_OP_LD_MEM_VX]   = _opF_store_regs_to_mem_starting_at_I_##id,        \
+        [C8_OP_LD_VX_MEM]   = _opF_load_regs_from_mem_starting_at_I_##id,       \
+        [C8_OP_SCD]         = _op0_scroll_down,                                 \
+        [C8_OP_SCU]         = _op0_scroll_up,                                   \
+        [C8_OP_SCR]         = _op0_scroll_right,                                \
+        [C8_OP_SCL]         = _op0_scroll_left,                                 \
+        [C8_OP_LOW]         = _op0_lores,                                       \
+        [C8_OP_HIGH]        = _op0_hires,                                       \
+        [C8_OP_EXIT]        = _op0_exit,                                        \
+        [C8_OP_LD_HF_VX]    = _opF_load_big_sprite_for_value,                   \
+        [C8_OP_LD_R_VX]     = _opF_store_regs_to_flags,                         \
+        [C8_OP_LD_VX_R]     = _opF_load_regs_from_flags,                        \
+        [C8_OP_SAVE_RANGE]  = _op5_store_range,                                 \
+        [C8_OP_LOAD_RANGE]  = _op5_load_range,                                  \
+        [C8_OP_LD_I_LONG]   = _opF_load_I_long,                                 \
+        [C8_OP_PLANE]       = _opF_select_planes,                               \
+        [C8_OP_AUDIO]       = _opF_load_audio_pattern,                          \
+        [C8_OP_PITCH]       = _opF_set_pitch,                                   \
+    },
+
+static uint16_t (*const _op_handlers[C8_QUIRKS_COUNT][C8_OP_COUNT])(Chip8*, const Chip8Ins*, uint16_t) = {
+    C8_QUIRK_PROFILES(C8_HANDLER_TABLE)
+};
+
+#undef C8_HANDLER_TABLE
+
+/* C8_OP_NONE slots are prefixes, resolved by the matching _Xprefix_ins */
+static const uint8_t _ins_arr[16] = {
+    C8_OP_NONE,                     // 0 - _0prefix_ins
+
+    C8_OP_JP,                       // 1
+    C8_OP_CALL,                     // 2
+    C8_OP_SE_BYTE,                  // 3
+    C8_OP_SNE_BYTE,                 // 4
+    C8_OP_SE_REG,                   // 5
+    C8_OP_LD_BYTE,                  // 6
+    C8_OP_ADD_BYTE,                 // 7
+
+    C8_OP_NONE,                     // 8 - _8prefix_ins
+
+    C8_OP_SNE_REG,                  // 9
+    C8_OP_LD_I,                     // A
+    C8_OP_JP_V0,                    // B
+    C8_OP_RND,                      // C
+    C8_OP_DRW,                      // D
+
+    C8_OP_NONE,                     // E - _Eprefix_ins
+    C8_OP_NONE                      // F - _Fprefix_ins
+};
+
+static const uint8_t _8ins_arr[16] = {
+    C8_OP_LD_REG,                   // 0
+    C8_OP_OR,                       // 1
+    C8_OP_AND,                      // 2
+    C8_OP_XOR,                      // 3
+    C8_OP_ADD_REG,                  // 4
+    C8_OP_SUB,                      // 5
+    C8_OP_SHR,                      // 6
+    C8_OP_SUBN,                     // 7
+    C8_OP_UNKNOWN,                  // 8
+    C8_OP_UNKNOWN,                  // 9
+    C8_OP_UNKNOWN,                  // A
+    C8_OP_UNKNOWN,                  // B
+    C8_OP_UNKNOWN,                  // C
+    C8_OP_UNKNOWN,                  // D
+    C8_OP_SHL,                      // E
+    C8_OP_UNKNOWN,                  // F
+};
+
+static const uint8_t _Fins_arr[16] = {
+    C8_OP_UNKNOWN,                  // 0
+    C8_OP_UNKNOWN,                  // 1
+    C8_OP_UNKNOWN,                  // 2
+    C8_OP_LD_B_VX,                  // 3
+    C8_OP_UNKNOWN,                  // 4
+    C8_OP_UNKNOWN,                  // 5
+    C8_OP_UNKNOWN,                  // 6
+    C8_OP_LD_VX_DT,                 // 7
+    C8_OP_LD_ST_VX,                 // 8
+    C8_OP_LD_F_VX,                  // 9
+    C8_OP_LD_VX_K,                  // A
+    C8_OP_UNKNOWN,                  // B
+    C8_OP_UNKNOWN,                  // C
+    C8_OP_UNKNOWN,                  // D
+    C8_OP_ADD_I_VX,                 // E
+    C8_OP_UNKNOWN,                  // F
 };
 
 // ----------------------------------------------------------------------
@@ -157,11 +388,25 @@ static void (*_Fins_arr[16])(Chip8*) = {
  * 
  */
 
-static size_t _dump_memory_arr(const uint8_t* mem, size_t memcap, char** out);
-static size_t _dump_stack(const uint16_t* stack, size_t stacksize, char** out);
-static size_t _dump_regs(const uint8_t* V, size_t registerAmount, char** out);
-static size_t _dump_keys(const uint8_t* V, size_t registerAmount, char** out);
-static size_t _dump_internal_regs(const Chip8* c8, char** out);
+static void _dump_flush(Chip8Dump* d);
+static char* _dump_reserve(Chip8Dump* d, size_t size);
+static void _dump_str(Chip8Dump* d, const char* str);
+static char* _dump_hex(char* at, unsigned value, int digits);
+static void _dump_uint(Chip8Dump* d, unsigned long long value);
+static void _dump_header(Chip8Dump* d, int digits);
+static void _dump_row(Chip8Dump* d, unsigned addr, int digits, const uint8_t* bytes);
+static void _dump_memory_arr(Chip8Dump* d, const uint8_t* mem, size_t memcap);
+static void _dump_screen(Chip8Dump* d, const Chip8* c8);
+static inline const Chip8Ins* _fetch_decoded(Chip8* c8, uint16_t pc, Chip8Ins* scratch);
+static uint32_t _run(Chip8* c8, uint32_t budget, int* events);
+static inline void _memory_written(Chip8* c8, uint16_t addr, uint16_t len);
+static inline void _store(Chip8* c8, uint16_t addr, const uint8_t* data, uint16_t len);
+static inline uint16_t _skip(const Chip8* c8, uint16_t pc, unsigned quirks);
+static inline int _screen_words(const Chip8* c8);
+static inline int _screen_rows(const Chip8* c8);
+static inline uint16_t _draw_planes(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks);
+static void _drop_decoded(Chip8* c8);
+static inline uint32_t _pcg32(uint64_t* state);
 
 /**
  * Initializes the Chip8 virtual machine
@@ -174,7 +419,13 @@ int chip8Init(Chip8* chip8) {
     memset(chip8, 0, sizeof(Chip8));
     chip8->pc = C8_BEGIN_ADDRESS;
     chip8->err = C8_ERR_NO_ROM_LOADED;
-    memcpy(chip8->memory, _chip8FontSet, 80); /* initialize fontset */
+    chip8->cyclesPerTick = C8_CLOCK_SPEED / C8_TIMER_SPEED;
+    chip8->tickCountdown = chip8->cyclesPerTick;
+    chip8Seed(chip8, C8_DEFAULT_SEED);
+    chip8->planes = 1;
+    chip8->pitch = 64; /* 4000hz, the rate XO-CHIP plays patterns at by default */
+    memcpy(chip8->memory + C8_FONT_ADDRESS, _chip8FontSet, sizeof(_chip8FontSet)); /* initialize fontset */
+    chip8->dirtyPages = ~0ULL; /* nothing in common with whatever was here before */
     return 1;
 }
 
@@ -195,21 +446,22 @@ int chip8LoadRom(Chip8* chip8, const char* filename) {
     fseek(file, 0L, SEEK_SET);
     // rewind(file);
 
-    if (size >= C8_MEMORY_SIZE) {
+    if (size <= 0 || size > C8_MAX_ROM_SIZE) {
         fclose(file);
         return 0;
     }
 
 
     chip8Init(chip8); /* clean up the vm */
+    /* straight into place, a short read leaves the VM without a ROM */
+    if (fread(chip8->memory + C8_BEGIN_ADDRESS, 1, size, file) != (size_t) size) {
+        memset(chip8->memory + C8_BEGIN_ADDRESS, 0, size);
+        fclose(file);
+        return 0;
+    }
     chip8->running = 1;
     chip8->err = C8_ERR_NONE;
 
-    uint8_t* buf = malloc(size);
-    fread(buf, 1, size, file);
-    memcpy(chip8->memory + C8_BEGIN_ADDRESS, buf, size);
-
-    free(buf);
     fclose(file);
     return 1; 
 }
@@ -218,8 +470,8 @@ int chip8LoadRom(Chip8* chip8, const char* filename) {
  * Loads program from a uint8_t array. Mostly useful for debugging.
  * Big endian pls
  */
-int chip8LoadFromArray(Chip8* chip8, uint8_t* data, size_t size) {
-    if (!chip8 || !data || size == 0 || size >= C8_MEMORY_SIZE) {
+int chip8LoadFromArray(Chip8* chip8, const uint8_t* data, size_t size) {
+    if (!chip8 || !data || size == 0 || size > C8_MAX_ROM_SIZE) {
         return 0;
     }
     chip8Init(chip8);
@@ -235,21 +487,152 @@ int chip8EmulateCycle(Chip8* chip8) {
         return 0;
     }
 
-    if (!chip8->waitingForKey) {
-        /* fetch! */
-        chip8->opcode = chip8->memory[chip8->pc] << 8 | chip8->memory[chip8->pc + 1];
+    chip8RunCycles(chip8, 1, NULL);
+    return 1;
+}
 
-        /* decode and exec! */
-        _ins_arr[C8_INS_HI(chip8->opcode)](chip8);
+/**
+ * Runs up to maxCycles instructions in one go. Returns early, after the
+ * instruction that caused it, when something the host may want to react to
+ * happens; the return value is a mask of the C8_YIELD_* events that did.
+ * While waiting for a key the cycles still pass (and so do timer ticks),
+ * nothing gets executed though. Returns 0 only when chip8 is NULL.
+ */
+int chip8RunCycles(Chip8* chip8, uint32_t maxCycles, uint32_t* ran) {
+    if (!chip8) {
+        return 0;
+    }
+    uint32_t done = 0;
+    int events = 0;
+    if (!chip8->running) {
+        events = C8_YIELD_ERROR;
+    } else if (maxCycles == 0) {
+        events = C8_YIELD_BUDGET;
+    } else if (chip8->waitingForKey) {
+        done = maxCycles < chip8->tickCountdown ? maxCycles : chip8->tickCountdown;
+        chip8->tickCountdown -= done;
+        events = C8_YIELD_KEY_WAIT;
+        if (chip8->tickCountdown == 0) {
+            chip8->tickCountdown = chip8->cyclesPerTick;
+            events |= C8_YIELD_TIMER;
+        }
+        if (done == maxCycles) {
+            events |= C8_YIELD_BUDGET;
+        }
+    } else {
+        chip8->pc &= C8_ADDR_MASK; /* in case someone outside the loops put it past the end */
+        done = _run(chip8, maxCycles, &events);
+    }
+    chip8->cycles += done;
+    if (ran) {
+        *ran = done;
+    }
+    return events;
+}
 
-        if (chip8->incPcFlag) {
-            chip8->pc += 2;
-            chip8->incPcFlag = 0;
+uint64_t chip8RunFor(Chip8* chip8, uint64_t cycles) {
+    uint64_t total = 0;
+    while (chip8 && total < cycles) {
+        uint64_t left = cycles - total;
+        uint32_t ran = 0;
+        int events = chip8RunCycles(chip8, left > UINT32_MAX ? UINT32_MAX : (uint32_t) left, &ran);
+        if (events & C8_YIELD_TIMER) {
+            chip8DecrTimers(chip8);
+        }
+        if (ran == 0) {
+            break;
         }
+        total += ran;
+    }
+    return total;
+}
+
+int chip8SetClockSpeed(Chip8* chip8, uint32_t hz) {
+    if (!chip8) {
+        return 0;
+    }
+    if (hz < C8_MIN_CLOCK_SPEED) {
+        hz = C8_MIN_CLOCK_SPEED;
+    } else if (hz > C8_MAX_CLOCK_SPEED) {
+        hz = C8_MAX_CLOCK_SPEED;
+    }
+    chip8->cyclesPerTick = (uint16_t) (hz / C8_TIMER_SPEED);
+    if (chip8->tickCountdown > chip8->cyclesPerTick) {
+        chip8->tickCountdown = chip8->cyclesPerTick;
     }
     return 1;
 }
 
+uint32_t chip8GetClockSpeed(const Chip8* chip8) {
+    return chip8 ? (uint32_t) chip8->cyclesPerTick * C8_TIMER_SPEED : 0;
+}
+
+void chip8Seed(Chip8* chip8, uint64_t seed) {
+    if (!chip8) {
+        return;
+    }
+    /* the usual PCG seeding: step, mix the seed in, step again */
+    chip8->rng = 0;
+    _pcg32(&chip8->rng);
+    chip8->rng += seed;
+    _pcg32(&chip8->rng);
+}
+
+uint8_t chip8Random(Chip8* chip8) {
+    return chip8 ? (uint8_t) _pcg32(&chip8->rng) : 0;
+}
+
+int chip8SetQuirks(Chip8* chip8, int profile) {
+    if (!chip8 || profile < 0 || profile >= C8_QUIRKS_COUNT) {
+        return 0;
+    }
+    unsigned flags = _quirks_flags[profile];
+    if ((flags ^ _quirks_flags[chip8->quirks]) & C8_EXT_OPS) {
+        _drop_decoded(chip8); /* the decoder goes by them */
+    }
+    if ((flags & C8_QUIRK_SCHIP_OPS) && profile != chip8->quirks) {
+        _store(chip8, C8_BIG_FONT_ADDRESS, _chip8BigFontSet, sizeof(_chip8BigFontSet));
+    }
+    chip8->quirks = (uint8_t) profile;
+    return 1;
+}
+
+int chip8QuirksByName(const char* name) {
+    for (int i = 0; name && i < C8_QUIRKS_COUNT; i++) {
+        if (strcmp(name, _quirks_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* chip8QuirksName(int profile) {
+    return profile >= 0 && profile < C8_QUIRKS_COUNT ? _quirks_names[profile] : NULL;
+}
+
+unsigned chip8QuirksFlags(int profile) {
+    return profile >= 0 && profile < C8_QUIRKS_COUNT ? _quirks_flags[profile] : 0;
+}
+
+int chip8QuirkyOp(unsigned quirks, uint8_t op) {
+    switch (op) {
+        case C8_OP_SHR:
+        case C8_OP_SHL:         return (quirks & C8_QUIRK_SHIFT_VY) != 0;
+        case C8_OP_LD_MEM_VX:
+        case C8_OP_LD_VX_MEM:   return (quirks & C8_QUIRK_KEEP_I) != 0;
+        case C8_OP_ADD_I_VX:    return (quirks & C8_QUIRK_ADD_I_NO_VF) != 0;
+        case C8_OP_DRW:         return (quirks & (C8_QUIRK_WRAP_SPRITES | C8_EXT_OPS)) != 0;
+        case C8_OP_JP_V0:       return (quirks & C8_QUIRK_JUMP_VX) != 0;
+        case C8_OP_SE_BYTE:
+        case C8_OP_SNE_BYTE:
+        case C8_OP_SE_REG:
+        case C8_OP_SNE_REG:
+        case C8_OP_SKP:
+        case C8_OP_SKNP:        return (quirks & C8_QUIRK_XOCHIP_OPS) != 0;
+        default:                return op >= C8_OP_SCD; /* only the interpreter has these */
+    }
+}
+
 int chip8DecrTimers(Chip8* chip8) {
     if (!chip8) {
         return 0;
@@ -257,9 +640,8 @@ int chip8DecrTimers(Chip8* chip8) {
     if (chip8->delayTimer > 0) {
         chip8->delayTimer--;
     }
+    /* the GUI beeps while it's above 0, see chip8RunnerGetSound */
     if (chip8->soundTimer > 0) {
-        // TODO -- handle sound, maybe somewhere else
-        // printf("beep!!\\n");
         chip8->soundTimer--;
     }
     return 1;
@@ -298,218 +680,943 @@ int chip8PressKeys(Chip8* chip8, uint16_t keysMask) {
 }
 
 int chip8VMDump(const Chip8* chip8, FILE* outFile) {
-    if (!chip8) {
+    if (!chip8 || !outFile) {
         return 0;
     }
-
-    char* memorybuf;
-    char* gfxbuf;
-    char* regsbuf;
-    char* keysbuf;
-    char* stackbuf;
-    char* extrabuf;
-    size_t memsize = _dump_memory_arr(chip8->memory, C8_MEMORY_SIZE, &memorybuf);
-    size_t gfxsize = _dump_memory_arr(chip8->gfx, C8_SCREEN_SIZE, &gfxbuf);
-    size_t regsize = _dump_regs(chip8->V, C8_REGISTER_AMOUNT, &regsbuf);
-    size_t keyssize = _dump_keys(chip8->key, C8_KEYS_AMOUNT, &keysbuf);
-    size_t stacksize = _dump_stack(chip8->stack, C8_STACK_SIZE, &stackbuf);
-    size_t extrasize = _dump_internal_regs(chip8, &extrabuf);
-
-    // fputs(stackbuf, outFile);
-    const char* vmmem = "VM Memory:\n";
-    const char* scr = "Screen Buffer:\n";
-    const char* regs = "Registers [V0-VF]:\n";
-    const char* keys = "Keys [0-F]:\n";
-    const char* stack = "Program Stack:\n";
-    const char* regsAndFlags = "Other registers and flags:\n";
-    const char* newlines = "\n\n";
-
-    fputs(vmmem, outFile);
-    fputs(memorybuf, outFile);
-    fputs(newlines, outFile);
-
-    fputs(stack, outFile);
-    fputs(stackbuf, outFile);
-    fputs(newlines, outFile);
-
-    fputs(regs, outFile);
-    fputs(regsbuf, outFile);
-    fputs(newlines, outFile);
-
-    fputs(keys, outFile);
-    fputs(keysbuf, outFile);
-    fputs(newlines, outFile);
-
-    fputs(scr, outFile);
-    fputs(gfxbuf, outFile);
-    fputs(newlines, outFile);
-
-    fputs(regsAndFlags, outFile);
-    fputs(extrabuf, outFile);
-
-    if (memsize) free(memorybuf);
-    if (gfxsize) free(gfxbuf);
-    if (regsize) free(regsbuf);
-    if (keyssize) free(keysbuf);
-    if (stacksize) free(stackbuf);
-    if (extrasize) free(extrabuf);
-    return 1;
+    Chip8Dump d = { .file = outFile, .len = 0 };
+    char* at;
+
+    /* every section's last line goes without its newline (d.len--), like the dumps always had */
+    _dump_str(&d, "VM Memory:\n");
+    _dump_memory_arr(&d, chip8->memory, C8_MEMORY_SIZE);
+    d.len--;
+    _dump_str(&d, "\n\nProgram Stack:\n");
+    for (int i = C8_STACK_SIZE - 1; i >= 0; i--) {
+        at = _dump_reserve(&d, 11);
+        *at++ = '[';
+        at = _dump_hex(at, i, 1);
+        memcpy(at, "]=0x", 4);
+        at = _dump_hex(at + 4, chip8->stack[i], 4);
+        *at = '\n';
+        d.len += 11;
+    }
+    d.len--;
+    _dump_str(&d, "\n\nRegisters [V0-VF]:\n");
+    for (int i = 0; i < C8_REGISTER_AMOUNT; i++) {
+        at = _dump_reserve(&d, 10);
+        memcpy(at, "[V", 2);
+        at = _dump_hex(at + 2, i, 1);
+        memcpy(at, "]=0x", 4);
+        at = _dump_hex(at + 4, chip8->V[i], 2);
+        *at = '\n';
+        d.len += 10;
+    }
+    d.len--;
+    _dump_str(&d, "\n\nKeys [0-F]:\n");
+    for (int i = 0; i < C8_KEYS_AMOUNT; i++) {
+        at = _dump_reserve(&d, 7);
+        memcpy(at, "[k", 2);
+        at = _dump_hex(at + 2, i, 1);
+        memcpy(at, "]=", 2);
+        at[2] = chip8->key[i] ? '1' : '0';
+        at[3] = '\n';
+        d.len += 7;
+    }
+    d.len--;
+    _dump_str(&d, "\n\nScreen Buffer:\n");
+    _dump_screen(&d, chip8);
+    d.len--;
+    _dump_str(&d, "\n\nOther registers and flags:\n");
+
+    static const char* names[] = { "PC=0x", "opcode=0x", "SP=0x", "I=0x", "DT=0x", "ST=0x" };
+    const unsigned values[] = { chip8->pc, chip8->opcode, chip8->sp, chip8->I, chip8->delayTimer, chip8->soundTimer };
+    for (int i = 0; i < 6; i++) {
+        _dump_str(&d, names[i]);
+        at = _dump_reserve(&d, 5);
+        _dump_hex(at, values[i], 4)[0] = '\n';
+        d.len += 5;
+    }
+    _dump_str(&d, "err=");
+    _dump_uint(&d, chip8->err);
+    _dump_str(&d, "\n");
+    _dump_flush(&d);
+    return !ferror(outFile);
 }
 
-// ----------------------------------------------------------------------
+int chip8VMDumpJson(const Chip8* chip8, FILE* outFile) {
+    if (!chip8 || !outFile) {
+        return 0;
+    }
+    Chip8Dump d = { .file = outFile, .len = 0 };
+    char* at;
+
+    static const char* names[] = {
+        "{\"version\":", ",\"pc\":", ",\"opcode\":", ",\"I\":", ",\"sp\":", ",\"delayTimer\":",
+        ",\"soundTimer\":", ",\"err\":", ",\"waitingForKey\":", ",\"cycles\":"
+    };
+    const unsigned long long values[] = {
+        C8_DUMP_JSON_VERSION, chip8->pc, chip8->opcode, chip8->I, chip8->sp, chip8->delayTimer,
+        chip8->soundTimer, chip8->err, chip8->waitingForKey, chip8->cycles
+    };
+    for (int i = 0; i < 10; i++) {
+        _dump_str(&d, names[i]);
+        _dump_uint(&d, values[i]);
+    }
+    _dump_str(&d, ",\"V\":[");
+    for (int i = 0; i < C8_REGISTER_AMOUNT; i++) {
+        _dump_uint(&d, chip8->V[i]);
+        _dump_str(&d, i < C8_REGISTER_AMOUNT - 1 ? "," : "],\"stack\":[");
+    }
+    for (int i = 0; i < C8_STACK_SIZE; i++) {
+        _dump_uint(&d, chip8->stack[i]);
+        _dump_str(&d, i < C8_STACK_SIZE - 1 ? "," : "],\"keys\":[");
+    }
+    for (int i = 0; i < C8_KEYS_AMOUNT; i++) {
+        _dump_str(&d, chip8->key[i] ? "1" : "0");
+        _dump_str(&d, i < C8_KEYS_AMOUNT - 1 ? "," : "],\"memory\":\"");
+    }
+    for (int i = 0; i < C8_MEMORY_SIZE; i += 32) {
+        at = _dump_reserve(&d, 64);
+        for (int k = 0; k < 32; k++) {
+            at = _dump_hex(at, chip8->memory[i + k], 2);
+        }
+        d.len += 64;
+    }
+    _dump_str(&d, "\",\"hires\":");
+    _dump_uint(&d, chip8->hires);
+    _dump_str(&d, ",\"planes\":");
+    _dump_uint(&d, chip8->planes);
+    _dump_str(&d, ",\"screen\":[");
+    int words = _screen_words(chip8);
+    int rows = _screen_rows(chip8);
+    for (int p = 0; p < C8_PLANES; p++) {
+        _dump_str(&d, "[");
+        for (int y = 0; y < rows; y++) {
+            at = _dump_reserve(&d, 3 + 16 * words);
+            *at++ = '"';
+            for (int w = 0; w < words; w++) {
+                at = _dump_hex(at, (unsigned) (chip8->gfx[p][w][y] >> 32), 8);
+                at = _dump_hex(at, (unsigned) chip8->gfx[p][w][y], 8);
+            }
+            at[0] = '"';
+            at[1] = y < rows - 1 ? ',' : ']';
+            d.len += 3 + 16 * words;
+        }
+        _dump_str(&d, p < C8_PLANES - 1 ? "," : "]");
+    }
+    _dump_str(&d, "}");
+    _dump_flush(&d);
+    return !ferror(outFile);
+}
 
 /**
- * Auxiliary
+ * 64-bit FNV-1a hash of the architectural state (registers, stack, timers,
+ * memory and screen). Two VMs that ran the same program the same way will
+ * hash the same, which is what the headless runner reports.
  */
-
-static size_t _dump_internal_regs(const Chip8* c8, char** out) {
-    char* buf = calloc(150, sizeof(char));
-    if (!buf) {
-        *out = "";
+uint64_t chip8StateHash(const Chip8* chip8) {
+    if (!chip8) {
         return 0;
     }
-    char tp[40] = {[39] = 0};
-    int i = snprintf(tp, 40, "PC=0x%04X\n", c8->pc);
-    strcat(buf, tp);
-
-    i += snprintf(tp, 40, "opcode=0x%04X\n", c8->opcode);
-    strcat(buf, tp);
+    uint64_t h = C8_FNV_OFFSET;
+    h = chip8Fnv1a(h, &chip8->pc, sizeof(chip8->pc));
+    h = chip8Fnv1a(h, &chip8->I, sizeof(chip8->I));
+    h = chip8Fnv1a(h, &chip8->sp, sizeof(chip8->sp));
+    h = chip8Fnv1a(h, chip8->stack, sizeof(chip8->stack));
+    h = chip8Fnv1a(h, chip8->V, sizeof(chip8->V));
+    h = chip8Fnv1a(h, &chip8->delayTimer, sizeof(chip8->delayTimer));
+    h = chip8Fnv1a(h, &chip8->soundTimer, sizeof(chip8->soundTimer));
+    h = chip8Fnv1a(h, chip8->memory, sizeof(chip8->memory));
+    /* the screen is hashed unpacked, so hashes don't depend on how gfx is stored */
+    uint8_t screen[C8_MAX_SCREEN_SIZE];
+    chip8UnpackGfx(chip8, screen);
+    h = chip8Fnv1a(h, screen, (size_t) chip8ScreenWidth(chip8) * chip8ScreenHeight(chip8));
+    return h;
+}
 
-    i += snprintf(tp, 40, "SP=0x%04X\n", c8->sp);
-    strcat(buf, tp);
+/* same hash, of just the screen */
+uint64_t chip8ScreenHash(const Chip8* chip8) {
+    if (!chip8) {
+        return 0;
+    }
+    uint8_t screen[C8_MAX_SCREEN_SIZE];
+    chip8UnpackGfx(chip8, screen);
+    return chip8Fnv1a(C8_FNV_OFFSET, screen, (size_t) chip8ScreenWidth(chip8) * chip8ScreenHeight(chip8));
+}
 
-    i += snprintf(tp, 40, "I=0x%04X\n", c8->I);
-    strcat(buf, tp);
+int chip8ScreenWidth(const Chip8* chip8) {
+    return chip8 && chip8->hires ? C8_HIRES_WIDTH : C8_SCREEN_WIDTH;
+}
 
-    i += snprintf(tp, 40, "DT=0x%04X\n", c8->delayTimer);
-    strcat(buf, tp);
+int chip8ScreenHeight(const Chip8* chip8) {
+    return chip8 && chip8->hires ? C8_HIRES_HEIGHT : C8_SCREEN_HEIGHT;
+}
 
-    i += snprintf(tp, 40, "ST=0x%04X\n", c8->soundTimer);
-    strcat(buf, tp);
+int chip8GetPixel(const Chip8* chip8, int x, int y) {
+    if (!chip8 || x < 0 || y < 0 || x >= chip8ScreenWidth(chip8) || y >= chip8ScreenHeight(chip8)) {
+        return 0;
+    }
+    int color = 0;
+    for (int p = 0; p < C8_PLANES; p++) {
+        color |= (int) ((chip8->gfx[p][x >> 6][y] >> (63 - (x & 63))) & 1) << p;
+    }
+    return color;
+}
 
-    i += snprintf(tp, 40, "err=%d\n", c8->err);
-    strcat(buf, tp);
+void chip8UnpackGfx(const Chip8* chip8, uint8_t* out) {
+    if (!chip8 || !out) {
+        return;
+    }
+    int width = chip8ScreenWidth(chip8);
+    int height = chip8ScreenHeight(chip8);
+    memset(out, 0, (size_t) width * height);
+    for (int p = 0; p < C8_PLANES; p++) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                out[y * width + x] |= (uint8_t) (((chip8->gfx[p][x >> 6][y] >> (63 - (x & 63))) & 1) << p);
+            }
+        }
+    }
+}
 
-    char* tmp = realloc(buf, i);
-    if (!tmp) {
-        free(buf);
-        *out = "";
+/**
+ * Layout: magic, version, size (32 bits), then pc, I, sp, opcode, err,
+ * running, waitingForKey, delayTimer, soundTimer, drawFlag, keys (bit n =
+ * key n), cyclesPerTick, tickCountdown, cycles, rng, V, stack, hires,
+ * planes, pitch, audio, rpl, gfx (every plane and word column, whatever
+ * the resolution) and memory.
+ * opcode goes in because a pending Fx0A needs it to know which register
+ * gets the key.
+ */
+size_t chip8SaveState(const Chip8* chip8, uint8_t* buf, size_t size) {
+    if (!chip8 || !buf || size < C8_STATE_SIZE) {
         return 0;
     }
-    *out = tmp;
-    return (size_t) i;
+    uint8_t* p = buf;
+    memcpy(p, C8_STATE_MAGIC, 4);
+    p += 4;
+    p = chip8Put16(p, C8_STATE_VERSION);
+    p = chip8Put32(p, C8_STATE_SIZE);
+    p = chip8Put16(p, chip8->pc);
+    p = chip8Put16(p, chip8->I);
+    p = chip8Put16(p, chip8->sp);
+    p = chip8Put16(p, chip8->opcode);
+    *p++ = chip8->err;
+    *p++ = chip8->running;
+    *p++ = chip8->waitingForKey;
+    *p++ = chip8->delayTimer;
+    *p++ = chip8->soundTimer;
+    *p++ = chip8->drawFlag;
+    uint16_t keys = 0;
+    for (int i = 0; i < C8_KEYS_AMOUNT; i++) {
+        keys |= (uint16_t) ((chip8->key[i] != 0) << i);
+    }
+    p = chip8Put16(p, keys);
+    p = chip8Put16(p, chip8->cyclesPerTick);
+    p = chip8Put16(p, chip8->tickCountdown);
+    p = chip8Put64(p, chip8->cycles);
+    p = chip8Put64(p, chip8->rng);
+    memcpy(p, chip8->V, C8_REGISTER_AMOUNT);
+    p += C8_REGISTER_AMOUNT;
+    for (int i = 0; i < C8_STACK_SIZE; i++) {
+        p = chip8Put16(p, chip8->stack[i]);
+    }
+    *p++ = chip8->hires;
+    *p++ = chip8->planes;
+    *p++ = chip8->pitch;
+    memcpy(p, chip8->audio, sizeof(chip8->audio));
+    p += sizeof(chip8->audio);
+    memcpy(p, chip8->rpl, sizeof(chip8->rpl));
+    p += sizeof(chip8->rpl);
+    for (int i = 0; i < C8_PLANES; i++) {
+        for (int w = 0; w < C8_ROW_WORDS; w++) {
+            for (int y = 0; y < C8_HIRES_HEIGHT; y++) {
+                p = chip8Put64(p, chip8->gfx[i][w][y]);
+            }
+        }
+    }
+    memcpy(p, chip8->memory, C8_MEMORY_SIZE);
+    return C8_STATE_SIZE;
 }
 
-static size_t _dump_regs(const uint8_t* V, size_t registerAmount, char** out) {
-    size_t written = 0;
-    size_t cap = (registerAmount * 10);
-    char* regbuf = calloc(cap, sizeof(char));
-    if (!regbuf) {
-        *out = "";
+int chip8LoadState(Chip8* chip8, const uint8_t* buf, size_t size) {
+    if (!chip8 || !buf || size < C8_STATE_SIZE
+            || memcmp(buf, C8_STATE_MAGIC, 4) != 0
+            || chip8Get16(buf + 4) != C8_STATE_VERSION
+            || chip8Get32(buf + 6) != C8_STATE_SIZE) {
+        return 0;
+    }
+    const uint8_t* p = buf + 10;
+    unsigned pc = chip8Get16(p);
+    uint16_t sp = chip8Get16(p + 4);
+    uint16_t cyclesPerTick = chip8Get16(p + 16);
+    uint16_t tickCountdown = chip8Get16(p + 18);
+    const uint8_t* mode = p + 84;   /* hires and planes, right after the stack */
+    if (pc >= C8_MEMORY_SIZE || sp > C8_STACK_SIZE || cyclesPerTick == 0
+            || tickCountdown == 0 || tickCountdown > cyclesPerTick
+            || mode[0] > 1 || mode[1] >= (1 << C8_PLANES)) {
         return 0;
     }
 
-    for (int i = 0; i < registerAmount; i++) {
-        char tmp[20] = {[19] = 0};
-        int c = snprintf(tmp, 20, "[V%X]=0x%02X\n", i, V[i]);
-        written += c;
-        if (i == 0xF) {
-            tmp[c] = '\0';
+    chip8->pc = (uint16_t) pc;
+    chip8->I = chip8Get16(p + 2);
+    chip8->sp = sp;
+    chip8->opcode = chip8Get16(p + 6);
+    p += 8;
+    chip8->err = *p++;
+    chip8->running = *p++;
+    chip8->waitingForKey = *p++;
+    chip8->delayTimer = *p++;
+    chip8->soundTimer = *p++;
+    chip8->drawFlag = *p++;
+    uint16_t keys = chip8Get16(p);
+    for (int i = 0; i < C8_KEYS_AMOUNT; i++) {
+        chip8->key[i] = (keys >> i) & 1;
+    }
+    chip8->cyclesPerTick = cyclesPerTick;
+    chip8->tickCountdown = tickCountdown;
+    p += 6;
+    chip8->cycles = chip8Get64(p);
+    chip8->rng = chip8Get64(p + 8);
+    p += 16;
+    memcpy(chip8->V, p, C8_REGISTER_AMOUNT);
+    p += C8_REGISTER_AMOUNT;
+    for (int i = 0; i < C8_STACK_SIZE; i++, p += 2) {
+        chip8->stack[i] = chip8Get16(p);
+    }
+    chip8->hires = *p++;
+    chip8->planes = *p++;
+    chip8->pitch = *p++;
+    memcpy(chip8->audio, p, sizeof(chip8->audio));
+    p += sizeof(chip8->audio);
+    memcpy(chip8->rpl, p, sizeof(chip8->rpl));
+    p += sizeof(chip8->rpl);
+    for (int i = 0; i < C8_PLANES; i++) {
+        for (int w = 0; w < C8_ROW_WORDS; w++) {
+            for (int y = 0; y < C8_HIRES_HEIGHT; y++, p += 8) {
+                chip8->gfx[i][w][y] = chip8Get64(p);
+            }
+        }
+    }
+    /* keep the decode cache warm, only the words that changed get dropped */
+    for (int i = 0; i < C8_DECODED_AMOUNT; i++) {
+        const uint8_t* word = p + 2 * i;
+        if (word[0] != chip8->memory[2 * i] || word[1] != chip8->memory[2 * i + 1]) {
+            _memory_written(chip8, (uint16_t) (2 * i), 2);
         }
-        strncat(regbuf, tmp, c);
     }
-    regbuf[cap - 1] = '\0';
-    written -= 1;
-    *out = regbuf;
-    return written;
+    memcpy(chip8->memory, p, C8_MEMORY_SIZE);
+    return 1;
 }
 
-static size_t _dump_keys(const uint8_t* V, size_t registerAmount, char** out) {
-    size_t written = 0;
-    size_t cap = (registerAmount * 2) + (registerAmount * 5);
-    char* regbuf = calloc(cap, 1);
-    if (!regbuf) {
-        *out = "";
+/**
+ * Everything outside memory and the decode cache is a few hundred bytes
+ * and just gets copied. Dirty pages get from's bytes back, and the 8-byte
+ * chunks that really differed count as written, so their decodings get
+ * dropped and a JIT notices. Everything else keeps its decodings, they
+ * still match what's in memory.
+ */
+int chip8Restore(Chip8* chip8, const Chip8* from) {
+    if (!chip8 || !from || chip8 == from) {
         return 0;
     }
+    uint32_t codeWrites = chip8->codeWrites;
+    uint64_t dirty = chip8->dirtyPages;
+    memcpy(chip8, from, offsetof(Chip8, memory));
+    memcpy(&chip8->drawFlag, &from->drawFlag, offsetof(Chip8, decoded) - offsetof(Chip8, drawFlag));
+#ifdef C8_PROFILE
+    chip8->profile = from->profile;
+#endif
+    chip8->codeWrites = codeWrites;
+    for (int page = 0; dirty; page++, dirty >>= 1) {
+        uint16_t addr = (uint16_t) (page * C8_PAGE_SIZE);
+        if (!(dirty & 1) || memcmp(chip8->memory + addr, from->memory + addr, C8_PAGE_SIZE) == 0) {
+            continue;
+        }
+        for (int w = addr; w < addr + C8_PAGE_SIZE; w += 8) {
+            uint64_t mine, theirs;
+            memcpy(&mine, chip8->memory + w, 8);
+            memcpy(&theirs, from->memory + w, 8);
+            if (mine != theirs) {
+                _memory_written(chip8, (uint16_t) w, 8);
+            }
+        }
+        memcpy(chip8->memory + addr, from->memory + addr, C8_PAGE_SIZE);
+    }
+    chip8->dirtyPages = 0;
+    return 1;
+}
+
+#ifdef C8_PROFILE
 
-    for (int i = 0; i < registerAmount; i++) {
-        char tmp[9] = {[8] = 0};
-        written += snprintf(tmp, 9, "[k%X]=%d\n", i, V[i]);
-        if (i == 0xF) {
-            tmp[7] = '\0';
+int chip8ProfileWriteJson(const Chip8* chip8, FILE* outFile) {
+    if (!chip8 || !outFile) {
+        return 0;
+    }
+    const Chip8Profile* prof = &chip8->profile;
+    uint64_t total = 0;
+    for (int i = 0; i < C8_OP_COUNT; i++) {
+        total += prof->ops[i];
+    }
+    fprintf(outFile, "{\"cycles\":%llu,\"instructions\":%llu,\"draws\":%llu,\"collisions\":%llu,\"ops\":{",
+        (unsigned long long) chip8->cycles,
+        (unsigned long long) total,
+        (unsigned long long) prof->ops[C8_OP_DRW],
+        (unsigned long long) prof->collisions);
+    const char* sep = "";
+    for (int i = C8_OP_UNKNOWN; i < C8_OP_COUNT; i++) {
+        if (prof->ops[i]) {
+            fprintf(outFile, "%s\"%s\":%llu", sep, _op_names[i], (unsigned long long) prof->ops[i]);
+            sep = ",";
+        }
+    }
+    /* the opcode is whatever sits at the address now, self-modifying code may have run others */
+    fprintf(outFile, "},\"pcs\":[");
+    sep = "";
+    for (int pc = 0; pc < C8_MEMORY_SIZE; pc++) {
+        if (prof->pcs[pc]) {
+            uint16_t opcode = chip8->memory[pc] << 8 | (pc + 1 < C8_MEMORY_SIZE ? chip8->memory[pc + 1] : 0);
+            fprintf(outFile, "%s{\"pc\":\"0x%03X\",\"opcode\":\"%04X\",\"count\":%llu}",
+                sep, pc, opcode, (unsigned long long) prof->pcs[pc]);
+            sep = ",";
         }
-        strncat(regbuf, tmp, 9);
     }
-    regbuf[cap - 1] = '\0';
-    written -= 1;
-    *out = regbuf;
-    return written;
+    fprintf(outFile, "]}");
+    return !ferror(outFile);
 }
 
-static size_t _dump_stack(const uint16_t* stack, size_t stacksize, char** out) {
-    size_t written = 0;
-    size_t cap = (stacksize * 11);
-    char* stackbuf = calloc(cap, sizeof(char));
-    if (!stackbuf) {
-        *out = "";
+int chip8ProfileWriteCsv(const Chip8* chip8, FILE* outFile, const char* rom) {
+    if (!chip8 || !outFile) {
         return 0;
     }
+    const Chip8Profile* prof = &chip8->profile;
+    rom = rom ? rom : "";
+    for (int i = C8_OP_UNKNOWN; i < C8_OP_COUNT; i++) {
+        if (prof->ops[i]) {
+            fprintf(outFile, "%s,op,%s,%llu\n", rom, _op_names[i], (unsigned long long) prof->ops[i]);
+        }
+    }
+    for (int pc = 0; pc < C8_MEMORY_SIZE; pc++) {
+        if (prof->pcs[pc]) {
+            fprintf(outFile, "%s,pc,0x%03X,%llu\n", rom, pc, (unsigned long long) prof->pcs[pc]);
+        }
+    }
+    fprintf(outFile, "%s,draw,calls,%llu\n", rom, (unsigned long long) prof->ops[C8_OP_DRW]);
+    fprintf(outFile, "%s,draw,collisions,%llu\n", rom, (unsigned long long) prof->collisions);
+    return !ferror(outFile);
+}
+
+#else
+
+int chip8ProfileWriteJson(const Chip8* chip8, FILE* outFile) {
+    (void) chip8;
+    (void) outFile;
+    return 0;
+}
+
+int chip8ProfileWriteCsv(const Chip8* chip8, FILE* outFile, const char* rom) {
+    (void) chip8;
+    (void) outFile;
+    (void) rom;
+    return 0;
+}
+
+#endif /* C8_PROFILE */
+
+// ----------------------------------------------------------------------
 
-    for (int i = stacksize - 1; i >= 0; i--) {
-        char tmp[20] = {[19] = 0};
-        int c = snprintf(tmp, 20, "[%X]=0x%04X\n", i, stack[i]);
-        written += c;
-        if (i == 0) {
-            tmp[c] = '\0';
+/**
+ * Auxiliary
+ */
+
+/**
+ * Fills in a decode cache entry: resolves the handler through the
+ * instruction tables and unpacks the operands once.
+ */
+void chip8DecodeOp(uint16_t opcode, unsigned quirks, Chip8Ins* out) {
+    uint8_t op = _ins_arr[C8_INS_HI(opcode)];
+    if (op == C8_OP_NONE) {
+        switch (C8_INS_HI(opcode)) {
+            case 0x0: op = _0prefix_ins(opcode); break;
+            case 0x8: op = _8prefix_ins(opcode); break;
+            case 0xE: op = _Eprefix_ins(opcode); break;
+            default:  op = _Fprefix_ins(opcode); break;
         }
-        strncat(stackbuf, tmp, c);
     }
+    if (quirks & C8_EXT_OPS) {
+        op = _extended_ins(opcode, quirks, op);
+    }
+    out->opcode = opcode;
+    out->op = op;
+    out->x = C8_EXTR_X(opcode);
+    out->y = C8_EXTR_Y(opcode);
+    out->n = C8_EXTR_NIBBLE(opcode);
+    out->nn = C8_EXTR_BYTE(opcode);
+}
 
-    stackbuf[cap - 1] = '\0';
-    written -= 1;
-    *out = stackbuf;
-    return written;
+/**
+ * Instructions at even addresses are decoded once and cached in
+ * c8->decoded. Odd addresses (rare, but legal jump targets) are decoded
+ * into the scratch entry every time.
+ */
+static inline const Chip8Ins* _fetch_decoded(Chip8* c8, uint16_t pc, Chip8Ins* scratch) {
+    if (pc & 1) {
+        /* the last address takes its second byte from 0x000 */
+        chip8DecodeOp(c8->memory[pc] << 8 | c8->memory[(pc + 1) & C8_ADDR_MASK], _quirks_flags[c8->quirks], scratch);
+        return scratch;
+    }
+    Chip8Ins* ins = &c8->decoded[pc >> 1];
+    if (ins->op == C8_OP_NONE) {
+        chip8DecodeOp(c8->memory[pc] << 8 | c8->memory[pc + 1], _quirks_flags[c8->quirks], ins);
+    }
+    return ins;
 }
 
-// horrible. could've been written better
-static size_t _dump_memory_arr(const uint8_t* mem, size_t memcap, char** out) {
-    size_t written = 0;
-    size_t cap = (memcap * 3) + (memcap / 16 * 5) + (5 + 3 * 16) + 1;
-    char* memorybuf = calloc(cap, sizeof(char));
-    if (!memorybuf) {
-        *out = "";
-        return 0;
+/**
+ * The interpreter loops behind chip8RunCycles. Both run up to budget (>= 1)
+ * instructions and stop after any instruction that raises a C8_YIELD_*
+ * event. The VM must be running and not waiting when they're called. pc
+ * and the timer countdown live in locals while they run and, like opcode,
+ * are only written back on the way out.
+ */
+#ifndef C8_THREADED_DISPATCH
+
+/* default: indirect calls through the quirk profile's _op_handlers */
+static uint32_t _run(Chip8* c8, uint32_t budget, int* events) {
+    uint16_t (*const* handlers)(Chip8*, const Chip8Ins*, uint16_t) = _op_handlers[c8->quirks];
+    Chip8Ins scratch;
+    const Chip8Ins* ins;
+    uint16_t pc = c8->pc;
+    uint16_t tick = c8->tickCountdown;
+    uint32_t ran = 0;
+    int ev = 0;
+    do {
+        ins = _fetch_decoded(c8, pc, &scratch);
+        C8_PROFILE_INS(c8, pc, ins);
+        C8_FUZZ_EDGE(pc, ins);
+        uint16_t next = handlers[ins->op](c8, ins, pc) & C8_ADDR_MASK;
+        C8_TRACE_INS(c8, pc, ins, ran);
+        pc = next;
+        ran++;
+        if (--tick == 0) {
+            tick = c8->cyclesPerTick;
+            ev |= C8_YIELD_TIMER;
+        }
+        if (C8_OP_DRAWS(ins->op)) {
+            ev |= C8_YIELD_DRAW;
+        }
+        if (!c8->running) {
+            ev |= C8_YIELD_ERROR;
+        }
+        if (c8->waitingForKey) {
+            ev |= C8_YIELD_KEY_WAIT;
+        }
+    } while (ran < budget && !ev);
+    if (ran == budget) {
+        ev |= C8_YIELD_BUDGET;
     }
+    c8->pc = pc;
+    c8->opcode = ins->opcode;
+    c8->tickCountdown = tick;
+    *events = ev;
+    return ran;
+}
+
+#else
+
+#ifndef __GNUC__
+#error "C8_THREADED_DISPATCH needs GCC's labels as values"
+#endif
 
-    written += sprintf(memorybuf, "     ");
-    for (int i = 0; i < 16; i++) {
-        char tmp[4] = {[3] = 0};
-        written += snprintf(tmp, 4, "%02X ", i);
-        strcat(memorybuf, tmp);
+/**
+ * 'make THREADED=1': threaded code using labels as values. Every handler
+ * gets inlined into its own label and jumps straight to the next one, so
+ * each opcode has its own indirect branch to predict. Only the handlers
+ * that can stop the VM or draw pay for checking it.
+ */
+#define C8_NEXT() do {                                      \
+        ran++;                                              \
+        if (--tick == 0) {                                  \
+            tick = c8->cyclesPerTick;                       \
+            ev |= C8_YIELD_TIMER;                           \
+        }                                                   \
+        if (ev || ran == budget) goto done;                 \
+        ins = _fetch_decoded(c8, pc, &scratch);             \
+        C8_PROFILE_INS(c8, pc, ins);                        \
+        C8_FUZZ_EDGE(pc, ins);                              \
+        goto *labels[ins->op];                              \
+    } while (0)
+
+#define C8_NEXT_CHECKED() do {                              \
+        if (!c8->running) ev |= C8_YIELD_ERROR;             \
+        if (c8->waitingForKey) ev |= C8_YIELD_KEY_WAIT;     \
+        C8_NEXT();                                          \
+    } while (0)
+
+#define C8_NEXT_DRAW() do {                                 \
+        ev |= C8_YIELD_DRAW;                                \
+        C8_NEXT();                                          \
+    } while (0)
+
+#define C8_EXEC(handler)                next = handler(c8, ins, pc) & C8_ADDR_MASK; C8_TRACE_INS(c8, pc, ins, ran); pc = next
+#define C8_LABEL(op, handler)           L_##op: C8_EXEC(handler); C8_NEXT();
+#define C8_LABEL_CHECKED(op, handler)   L_##op: C8_EXEC(handler); C8_NEXT_CHECKED();
+#define C8_LABEL_DRAW(op, handler)      L_##op: C8_EXEC(handler); C8_NEXT_DRAW();
+
+/**
+ * One of these per quirk profile, as _run_<id>. Labels as values can't
+ * leave the function they're in, so the compiler can't make the copies
+ * by inlining, this macro does.
+ */
+#define C8_DEFINE_RUN(id, name, quirks)                                                            \
+static uint32_t _run_##id(Chip8* c8, uint32_t budget, int* events) {                               \
+    static void* const labels[C8_OP_COUNT] = {                                                     \
+        [C8_OP_NONE]        = &&L_C8_OP_UNKNOWN,                                                   \
+        [C8_OP_UNKNOWN]     = &&L_C8_OP_UNKNOWN,                                                   \
+        [C8_OP_CLS]         = &&L_C8_OP_CLS,                                                       \
+        [C8_OP_RET]         = &&L_C8_OP_RET,                                                       \
+        [C8_OP_SYS]         = &&L_C8_OP_SYS,                                                       \
+        [C8_OP_JP]          = &&L_C8_OP_JP,                                                        \
+        [C8_OP_CALL]        = &&L_C8_OP_CALL,                                                      \
+        [C8_OP_SE_BYTE]     = &&L_C8_OP_SE_BYTE,                                                   \
+        [C8_OP_SNE_BYTE]    = &&L_C8_OP_SNE_BYTE,                                                  \
+        [C8_OP_SE_REG]      = &&L_C8_OP_SE_REG,                                                    \
+        [C8_OP_LD_BYTE]     = &&L_C8_OP_LD_BYTE,                                                   \
+        [C8_OP_ADD_BYTE]    = &&L_C8_OP_ADD_BYTE,                                                  \
+        [C8_OP_LD_REG]      = &&L_C8_OP_LD_REG,                                                    \
+        [C8_OP_OR]          = &&L_C8_OP_OR,                                                        \
+        [C8_OP_AND]         = &&L_C8_OP_AND,                                                       \
+        [C8_OP_XOR]         = &&L_C8_OP_XOR,                                                       \
+        [C8_OP_ADD_REG]     = &&L_C8_OP_ADD_REG,                                                   \
+        [C8_OP_SUB]         = &&L_C8_OP_SUB,                                                       \
+        [C8_OP_SHR]         = &&L_C8_OP_SHR,                                                       \
+        [C8_OP_SUBN]        = &&L_C8_OP_SUBN,                                                      \
+        [C8_OP_SHL]         = &&L_C8_OP_SHL,                                                       \
+        [C8_OP_SNE_REG]     = &&L_C8_OP_SNE_REG,                                                   \
+        [C8_OP_LD_I]        = &&L_C8_OP_LD_I,                                                      \
+        [C8_OP_JP_V0]       = &&L_C8_OP_JP_V0,                                                     \
+        [C8_OP_RND]         = &&L_C8_OP_RND,                                                       \
+        [C8_OP_DRW]         = &&L_C8_OP_DRW,                                                       \
+        [C8_OP_SKP]         = &&L_C8_OP_SKP,                                                       \
+        [C8_OP_SKNP]        = &&L_C8_OP_SKNP,                                                      \
+        [C8_OP_LD_VX_DT]    = &&L_C8_OP_LD_VX_DT,                                                  \
+        [C8_OP_LD_VX_K]     = &&L_C8_OP_LD_VX_K,                                                   \
+        [C8_OP_LD_DT_VX]    = &&L_C8_OP_LD_DT_VX,                                                  \
+        [C8_OP_LD_ST_VX]    = &&L_C8_OP_LD_ST_VX,                                                  \
+        [C8_OP_ADD_I_VX]    = &&L_C8_OP_ADD_I_VX,                                                  \
+        [C8_OP_LD_F_VX]     = &&L_C8_OP_LD_F_VX,                                                   \
+        [C8_OP_LD_B_VX]     = &&L_C8_OP_LD_B_VX,                                                   \
+        [C8_OP_LD_MEM_VX]   = &&L_C8_OP_LD_MEM_VX,                                                 \
+        [C8_OP_LD_VX_MEM]   = &&L_C8_OP_LD_VX_MEM,                                                 \
+        [C8_OP_SCD]         = &&L_C8_OP_SCD,                                                       \
+        [C8_OP_SCU]         = &&L_C8_OP_SCU,                                                       \
+        [C8_OP_SCR]         = &&L_C8_OP_SCR,                                                       \
+        [C8_OP_SCL]         = &&L_C8_OP_SCL,                                                       \
+        [C8_OP_LOW]         = &&L_C8_OP_LOW,                                                       \
+        [C8_OP_HIGH]        = &&L_C8_OP_HIGH,                                                      \
+        [C8_OP_EXIT]        = &&L_C8_OP_EXIT,                                                      \
+        [C8_OP_LD_HF_VX]    = &&L_C8_OP_LD_HF_VX,                                                  \
+        [C8_OP_LD_R_VX]     = &&L_C8_OP_LD_R_VX,                                                   \
+        [C8_OP_LD_VX_R]     = &&L_C8_OP_LD_VX_R,                                                   \
+        [C8_OP_SAVE_RANGE]  = &&L_C8_OP_SAVE_RANGE,                                                \
+        [C8_OP_LOAD_RANGE]  = &&L_C8_OP_LOAD_RANGE,                                                \
+        [C8_OP_LD_I_LONG]   = &&L_C8_OP_LD_I_LONG,                                                 \
+        [C8_OP_PLANE]       = &&L_C8_OP_PLANE,                                                     \
+        [C8_OP_AUDIO]       = &&L_C8_OP_AUDIO,                                                     \
+        [C8_OP_PITCH]       = &&L_C8_OP_PITCH,                                                     \
+    };                                                                                             \
+    Chip8Ins scratch;                                                                              \
+    const Chip8Ins* ins;                                                                           \
+    uint16_t pc = c8->pc;                                                                          \
+    uint16_t next;                                                                                 \
+    uint16_t tick = c8->tickCountdown;                                                             \
+    uint32_t ran = 0;                                                                              \
+    int ev = 0;                                                                                    \
+                                                                                                   \
+    ins = _fetch_decoded(c8, pc, &scratch);                                                        \
+    C8_PROFILE_INS(c8, pc, ins);                                                                   \
+    C8_FUZZ_EDGE(pc, ins);                                                                         \
+    goto *labels[ins->op];                                                                         \
+                                                                                                   \
+    C8_LABEL_CHECKED(C8_OP_UNKNOWN,  _op_unknown)                                                  \
+    C8_LABEL_DRAW(C8_OP_CLS,         _op0_cls)                                                     \
+    C8_LABEL_CHECKED(C8_OP_RET,      _op0_ret)                                                     \
+    C8_LABEL(C8_OP_SYS,              _op0_sys)                                                     \
+    C8_LABEL_CHECKED(C8_OP_JP,       _op1_jump_addr)                                               \
+    C8_LABEL_CHECKED(C8_OP_CALL,     _op2_call)                                                    \
+    C8_LABEL(C8_OP_SE_BYTE,          _op3_skip_eq_byte_##id)                                       \
+    C8_LABEL(C8_OP_SNE_BYTE,         _op4_skip_neq_byte_##id)                                      \
+    C8_LABEL(C8_OP_SE_REG,           _op5_skip_eq_reg_##id)                                        \
+    C8_LABEL(C8_OP_LD_BYTE,          _op6_load_byte)                                               \
+    C8_LABEL(C8_OP_ADD_BYTE,         _op7_add_byte)                                                \
+    C8_LABEL(C8_OP_LD_REG,           _op8_load_reg)                                                \
+    C8_LABEL(C8_OP_OR,               _op8_or)                                                      \
+    C8_LABEL(C8_OP_AND,              _op8_and)                                                     \
+    C8_LABEL(C8_OP_XOR,              _op8_xor)                                                     \
+    C8_LABEL(C8_OP_ADD_REG,          _op8_add_reg)                                                 \
+    C8_LABEL(C8_OP_SUB,              _op8_sub_reg)                                                 \
+    C8_LABEL(C8_OP_SHR,              _op8_shiftr_reg_##id)                                         \
+    C8_LABEL(C8_OP_SUBN,             _op8_sub_reversed_reg)                                        \
+    C8_LABEL(C8_OP_SHL,              _op8_shiftl_reg_##id)                                         \
+    C8_LABEL(C8_OP_SNE_REG,          _op9_skip_neq_reg_##id)                                       \
+    C8_LABEL_CHECKED(C8_OP_LD_I,     _opA_load_I)                                                  \
+    C8_LABEL_CHECKED(C8_OP_JP_V0,    _opB_jump_reg_##id)                                           \
+    C8_LABEL(C8_OP_RND,              _opC_rand)                                                    \
+    C8_LABEL_DRAW(C8_OP_DRW,         _opD_draw_sprite_##id)                                        \
+    C8_LABEL(C8_OP_SKP,              _opE_skip_on_keypress_##id)                                   \
+    C8_LABEL(C8_OP_SKNP,             _opE_skip_on_keyrelease_##id)                                 \
+    C8_LABEL(C8_OP_LD_VX_DT,         _opF_load_delay_timer_toreg)                                  \
+    C8_LABEL_CHECKED(C8_OP_LD_VX_K,  _opF_load_keypress_and_wait)                                  \
+    C8_LABEL(C8_OP_LD_DT_VX,         _opF_load_delay_timer_set)                                    \
+    C8_LABEL(C8_OP_LD_ST_VX,         _opF_load_sound_timer_set)                                    \
+    C8_LABEL(C8_OP_ADD_I_VX,         _opF_add_I_reg_##id)                                          \
+    C8_LABEL(C8_OP_LD_F_VX,          _opF_load_hex_sprite_for_value)                               \
+    C8_LABEL(C8_OP_LD_B_VX,          _opF_store_bcd_rep_of_reg)                                    \
+    C8_LABEL(C8_OP_LD_MEM_VX,        _opF_store_regs_to_mem_starting_at_I_##id)                    \
+    C8_LABEL(C8_OP_LD_VX_MEM,        _opF_load_regs_from_mem_starting_at_I_##id)                   \
+    C8_LABEL_DRAW(C8_OP_SCD,         _op0_scroll_down)                                             \
+    C8_LABEL_DRAW(C8_OP_SCU,         _op0_scroll_up)                                               \
+    C8_LABEL_DRAW(C8_OP_SCR,         _op0_scroll_right)                                            \
+    C8_LABEL_DRAW(C8_OP_SCL,         _op0_scroll_left)                                             \
+    C8_LABEL_DRAW(C8_OP_LOW,         _op0_lores)                                                   \
+    C8_LABEL_DRAW(C8_OP_HIGH,        _op0_hires)                                                   \
+    C8_LABEL_CHECKED(C8_OP_EXIT,     _op0_exit)                                                    \
+    C8_LABEL(C8_OP_LD_HF_VX,         _opF_load_big_sprite_for_value)                               \
+    C8_LABEL(C8_OP_LD_R_VX,          _opF_store_regs_to_flags)                                     \
+    C8_LABEL(C8_OP_LD_VX_R,          _opF_load_regs_from_flags)                                    \
+    C8_LABEL(C8_OP_SAVE_RANGE,       _op5_store_range)                                             \
+    C8_LABEL(C8_OP_LOAD_RANGE,       _op5_load_range)                                              \
+    C8_LABEL_CHECKED(C8_OP_LD_I_LONG, _opF_load_I_long)                                            \
+    C8_LABEL(C8_OP_PLANE,            _opF_select_planes)                                           \
+    C8_LABEL(C8_OP_AUDIO,            _opF_load_audio_pattern)                                      \
+    C8_LABEL(C8_OP_PITCH,            _opF_set_pitch)                                               \
+                                                                                                   \
+done:                                                                                              \
+    if (ran == budget) {                                                                           \
+        ev |= C8_YIELD_BUDGET;                                                                     \
+    }                                                                                              \
+    c8->pc = pc;                                                                                   \
+    c8->opcode = ins->opcode;                                                                      \
+    c8->tickCountdown = tick;                                                                      \
+    *events = ev;                                                                                  \
+    return ran;                                                                                    \
+}
+
+C8_QUIRK_PROFILES(C8_DEFINE_RUN)
+
+#define C8_RUN_ENTRY(id, name, quirks) [C8_QUIRKS_##id] = _run_##id,
+static uint32_t (*const _runs[C8_QUIRKS_COUNT])(Chip8*, uint32_t, int*) = {
+    C8_QUIRK_PROFILES(C8_RUN_ENTRY)
+};
+
+static uint32_t _run(Chip8* c8, uint32_t budget, int* events) {
+    return _runs[c8->quirks](c8, budget, events);
+}
+
+#undef C8_DEFINE_RUN
+#undef C8_RUN_ENTRY
+#undef C8_EXEC
+#undef C8_LABEL
+#undef C8_LABEL_CHECKED
+#undef C8_LABEL_DRAW
+#undef C8_NEXT
+#undef C8_NEXT_CHECKED
+#undef C8_NEXT_DRAW
+
+#endif /* C8_THREADED_DISPATCH */
+
+const Chip8Ins* chip8DecodeAt(Chip8* c8, uint16_t addr) {
+    Chip8Ins* ins = &c8->decoded[addr >> 1];
+    if (ins->op == C8_OP_NONE) {
+        chip8DecodeOp(c8->memory[addr] << 8 | c8->memory[addr + 1], _quirks_flags[c8->quirks], ins);
     }
-    written += 1;
-    strcat(memorybuf, "\n");
-    int k = 0;
-    for (int i = 0; i < memcap; i++) {
-        k++;
-        char tmp[5] = {[4] = 0};
-        char addr[6] = {[5] = 0};
-        if (i % 16 == 0) {
-            written += snprintf(addr, 6, "%03X  ", i);
-            strcat(memorybuf, addr);
+    return ins;
+}
+
+Chip8OpHandler chip8OpHandler(uint8_t quirks, uint8_t op) {
+    return _op_handlers[quirks < C8_QUIRKS_COUNT ? quirks : C8_QUIRKS_DEFAULT][op < C8_OP_COUNT ? op : C8_OP_UNKNOWN];
+}
+
+/**
+ * Marks memory[addr, addr + len) as written: its pages go dirty and the
+ * cached decodings that overlap it are dropped. codeWrites only moves
+ * when one of them had actually been decoded, so plain data writes don't
+ * look like self-modifying code.
+ */
+static inline void _memory_written(Chip8* c8, uint16_t addr, uint16_t len) {
+    unsigned firstPage = addr / C8_PAGE_SIZE;
+    unsigned lastPage = (unsigned) (addr + len - 1) / C8_PAGE_SIZE;
+    for (unsigned p = firstPage; p <= lastPage && p < C8_MEMORY_SIZE / C8_PAGE_SIZE; p++) {
+        c8->dirtyPages |= 1ULL << p;
+    }
+    unsigned first = addr >> 1;
+    unsigned last = (unsigned) (addr + len - 1) >> 1;
+    if (last >= C8_DECODED_AMOUNT) {
+        last = C8_DECODED_AMOUNT - 1;
+    }
+    for (unsigned i = first; i <= last; i++) {
+        if (c8->decoded[i].op != C8_OP_NONE) {
+            c8->decoded[i].op = C8_OP_NONE;
+            c8->codeWrites++;
         }
-        written += snprintf(tmp, 5, "%02X ", mem[i]);
-        if (k == 16) {
-            tmp[2] = '\n';
-            k = 0;
+    }
+}
+
+/* stores len bytes from addr on (usually I, so it may point anywhere), wrapping past the end of memory to 0 */
+static inline void _store(Chip8* c8, uint16_t addr, const uint8_t* data, uint16_t len) {
+    addr &= C8_ADDR_MASK;
+    uint16_t first = addr + len <= C8_MEMORY_SIZE ? len : C8_MEMORY_SIZE - addr;
+    memcpy(c8->memory + addr, data, first);
+    _memory_written(c8, addr, first);
+    if (first < len) {
+        memcpy(c8->memory, data + first, len - first);
+        _memory_written(c8, 0, len - first);
+    }
+}
+
+/**
+ * Where a taken skip lands. XO-CHIP skips F000 nnnn whole, it's the one
+ * instruction that's 4 bytes long.
+ */
+static inline uint16_t _skip(const Chip8* c8, uint16_t pc, unsigned quirks) {
+    if ((quirks & C8_QUIRK_XOCHIP_OPS)
+            && c8->memory[(pc + 2) & C8_ADDR_MASK] == 0xF0 && c8->memory[(pc + 3) & C8_ADDR_MASK] == 0x00) {
+        return pc + 6;
+    }
+    return pc + 4;
+}
+
+/* how much of each plane the current resolution uses: words per row, and rows */
+static inline int _screen_words(const Chip8* c8) {
+    return c8->hires ? C8_ROW_WORDS : 1;
+}
+
+static inline int _screen_rows(const Chip8* c8) {
+    return c8->hires ? C8_HIRES_HEIGHT : C8_SCREEN_HEIGHT;
+}
+
+/* forgets every decoding, for when what the opcodes mean changes */
+static void _drop_decoded(Chip8* c8) {
+    for (int i = 0; i < C8_DECODED_AMOUNT; i++) {
+        if (c8->decoded[i].op != C8_OP_NONE) {
+            c8->decoded[i].op = C8_OP_NONE;
+            c8->codeWrites++;
+        }
+    }
+}
+
+/**
+ * PCG32 (XSH RR). Cheap, and the state is one word in the VM, so parallel
+ * VMs don't share anything and a seed replays the same numbers.
+ */
+static inline uint32_t _pcg32(uint64_t* state) {
+    uint64_t old = *state;
+    *state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t xorshifted = (uint32_t) (((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t) (old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+uint64_t chip8Fnv1a(uint64_t h, const void* data, size_t size) {
+    const uint8_t* p = data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= C8_FNV_PRIME;
+    }
+    return h;
+}
+
+static void _dump_flush(Chip8Dump* d) {
+    fwrite(d->buf, 1, d->len, d->file);
+    d->len = 0;
+}
+
+/* room for size more bytes at the end of the buffer. the caller bumps len */
+static char* _dump_reserve(Chip8Dump* d, size_t size) {
+    if (d->len + size > sizeof(d->buf)) {
+        _dump_flush(d);
+    }
+    return d->buf + d->len;
+}
+
+static void _dump_str(Chip8Dump* d, const char* str) {
+    size_t size = strlen(str);
+    memcpy(_dump_reserve(d, size), str, size);
+    d->len += size;
+}
+
+/* writes value as that many uppercase hex digits, returns the end */
+static char* _dump_hex(char* at, unsigned value, int digits) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (int i = digits - 1; i >= 0; i--) {
+        at[i] = hex[value & 0xF];
+        value >>= 4;
+    }
+    return at + digits;
+}
+
+static void _dump_uint(Chip8Dump* d, unsigned long long value) {
+    char tmp[20];
+    int i = sizeof(tmp);
+    do {
+        tmp[--i] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+    memcpy(_dump_reserve(d, sizeof(tmp) - i), tmp + i, sizeof(tmp) - i);
+    d->len += sizeof(tmp) - i;
+}
+
+/* a hex table's column numbers, past where the addresses go */
+static void _dump_header(Chip8Dump* d, int digits) {
+    char* at = _dump_reserve(d, digits + 2);
+    memset(at, ' ', digits + 2);
+    d->len += digits + 2;
+    _dump_str(d, C8_DUMP_TABLE_HEADER);
+}
+
+/* one row of a hex table: the address, then 16 bytes */
+static void _dump_row(Chip8Dump* d, unsigned addr, int digits, const uint8_t* bytes) {
+    char* at = _dump_reserve(d, digits + 2 + 16 * 3);
+    at = _dump_hex(at, addr, digits);
+    memcpy(at, "  ", 2);
+    at += 2;
+    for (int k = 0; k < 16; k++) {
+        at = _dump_hex(at, bytes[k], 2);
+        *at++ = ' ';
+    }
+    at[-1] = '\n';
+    d->len += digits + 2 + 16 * 3;
+}
+
+static void _dump_memory_arr(Chip8Dump* d, const uint8_t* mem, size_t memcap) {
+    int digits = C8_DUMP_ADDR_DIGITS(memcap);
+    _dump_header(d, digits);
+    for (size_t i = 0; i < memcap; i += 16) {
+        _dump_row(d, (unsigned) i, digits, mem + i);
+    }
+}
+
+/**
+ * Same table as memory, one byte per pixel (its color, like chip8GetPixel),
+ * straight from the packed rows. 16 pixels never straddle two words.
+ */
+static void _dump_screen(Chip8Dump* d, const Chip8* c8) {
+    int width = chip8ScreenWidth(c8);
+    int size = width * chip8ScreenHeight(c8);
+    int digits = C8_DUMP_ADDR_DIGITS(size);
+    uint8_t pixels[16];
+    _dump_header(d, digits);
+    for (int i = 0; i < size; i += 16) {
+        int x = i % width;
+        memset(pixels, 0, sizeof(pixels));
+        for (int p = 0; p < C8_PLANES; p++) {
+            uint64_t bits = c8->gfx[p][x >> 6][i / width] << (x & 63);
+            for (int k = 0; k < 16; k++) {
+                pixels[k] |= (uint8_t) ((bits >> (63 - k) & 1) << p);
+            }
         }
-        strcat(memorybuf, tmp);
+        _dump_row(d, (unsigned) i, digits, pixels);
     }
-    memorybuf[cap - 1] = '\0';
-    written -= 1;
-    *out = memorybuf;
-    return written;
 }
 
 /**
@@ -517,340 +1624,611 @@ static size_t _dump_memory_arr(const uint8_t* mem, size_t memcap, char** out) {
  * 
  */
 
-static void _0prefix_ins(Chip8* c8) {
-    switch (C8_EXTR_NIBBLE(c8->opcode)) {
-        case 0x0: _op0_cls(c8); break;
-        case 0xE: _op0_ret(c8); break;
+static uint8_t _0prefix_ins(uint16_t opcode) {
+    switch (C8_EXTR_NIBBLE(opcode)) {
+        case 0x0: return C8_OP_CLS;
+        case 0xE: return C8_OP_RET;
         default:
-            _op0_sys(c8);
+            return C8_OP_SYS;
     }
 } 
 
-static void _8prefix_ins(Chip8* c8) {
-    _8ins_arr[C8_EXTR_NIBBLE(c8->opcode)](c8);
+static uint8_t _8prefix_ins(uint16_t opcode) {
+    return _8ins_arr[C8_EXTR_NIBBLE(opcode)];
 } 
 
-static void _Eprefix_ins(Chip8* c8) {
-    switch (C8_EXTR_NIBBLE(c8->opcode)) {
-        case 0xE: _opE_skip_on_keypress(c8);    break;
-        case 0x1: _opE_skip_on_keyrelease(c8);  break;
+static uint8_t _Eprefix_ins(uint16_t opcode) {
+    switch (C8_EXTR_NIBBLE(opcode)) {
+        case 0xE: return C8_OP_SKP;
+        case 0x1: return C8_OP_SKNP;
         default:
-            _op_unknown(c8);
+            return C8_OP_UNKNOWN;
     }
 }  
 
-static void _Fprefix_ins(Chip8* c8) {
-    uint16_t lo = C8_EXTR_NIBBLE(c8->opcode);
+static uint8_t _Fprefix_ins(uint16_t opcode) {
+    uint16_t lo = C8_EXTR_NIBBLE(opcode);
     if (lo == 0x5) {
-        switch (C8_EXTR_Y(c8->opcode)) {
-            case 1: _opF_load_delay_timer_set(c8);              break;
-            case 5: _opF_store_regs_to_mem_starting_at_I(c8);   break;
-            case 6: _opF_load_regs_from_mem_starting_at_I(c8);  break;
+        switch (C8_EXTR_Y(opcode)) {
+            case 1: return C8_OP_LD_DT_VX;
+            case 5: return C8_OP_LD_MEM_VX;
+            case 6: return C8_OP_LD_VX_MEM;
             default:
-                _op_unknown(c8);
+                return C8_OP_UNKNOWN;
+        }
+    }
+    return _Fins_arr[lo];
+}
+
+/**
+ * SUPER-CHIP's and XO-CHIP's instructions, for the profiles that have
+ * them. op is what the opcode decodes to without them, and it stays that
+ * for anything else.
+ */
+static uint8_t _extended_ins(uint16_t opcode, unsigned quirks, uint8_t op) {
+    if (quirks & C8_QUIRK_SCHIP_OPS) {
+        if ((opcode & 0xFFF0) == 0x00C0) {
+            return C8_OP_SCD;
+        }
+        switch (opcode) {
+            case 0x00FB: return C8_OP_SCR;
+            case 0x00FC: return C8_OP_SCL;
+            case 0x00FD: return C8_OP_EXIT;
+            case 0x00FE: return C8_OP_LOW;
+            case 0x00FF: return C8_OP_HIGH;
+        }
+        switch (opcode & 0xF0FF) {
+            case 0xF030: return C8_OP_LD_HF_VX;
+            case 0xF075: return C8_OP_LD_R_VX;
+            case 0xF085: return C8_OP_LD_VX_R;
+        }
+    }
+    if (quirks & C8_QUIRK_XOCHIP_OPS) {
+        if ((opcode & 0xFFF0) == 0x00D0) {
+            return C8_OP_SCU;
+        }
+        switch (opcode) {
+            case 0xF000: return C8_OP_LD_I_LONG;
+            case 0xF002: return C8_OP_AUDIO;
+        }
+        switch (opcode & 0xF00F) {
+            case 0x5002: return C8_OP_SAVE_RANGE;
+            case 0x5003: return C8_OP_LOAD_RANGE;
+        }
+        switch (opcode & 0xF0FF) {
+            case 0xF001: return C8_OP_PLANE;
+            case 0xF03A: return C8_OP_PITCH;
         }
-    } else {
-        _Fins_arr[lo](c8);
     }
+    return op;
 }
 
-static void _op_unknown(Chip8* c8) {
-    printf("Unknown opcode. [0x%X]\n", c8->opcode);
+static inline uint16_t _op_unknown(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins; /* traced, see chip8trace.h */
     c8->err = C8_ERR_UNKNOWN_INS;
     c8->running = 0;
-    c8->incPcFlag = 0;
+    return pc;
 }
 
-static void _op_nop(Chip8* c8) {
-    printf("nop... [0x%X]\n", c8->opcode);
-    c8->incPcFlag = 1;
+static inline uint16_t _op_nop(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) c8;
+    (void) ins;
+    return pc + 2;
 }
 
-static void _op0_cls(Chip8* c8) {
-    memset(c8->gfx, 0, C8_SCREEN_SIZE);
-    c8->incPcFlag = 1;
+/* only the selected planes, and only as much of them as the resolution uses (the rest is always blank) */
+static inline uint16_t _op0_cls(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
+    int rows = _screen_rows(c8);
+    for (int p = 0; p < C8_PLANES; p++) {
+        for (int w = 0; (c8->planes >> p & 1) && w < _screen_words(c8); w++) {
+            memset(c8->gfx[p][w], 0, rows * sizeof(uint64_t));
+        }
+    }
+    c8->drawFlag = 1;
+    return pc + 2;
 }
 
-static void _op0_ret(Chip8* c8) {
+static inline uint16_t _op0_ret(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
     if (c8->sp == 0) {
         c8->err = C8_ERR_STACK_UNDERFLOW;
         c8->running = 0;
-        c8->incPcFlag = 0;
-    } else {
-        c8->sp -= 1;
-        c8->pc = c8->stack[c8->sp];
-        c8->incPcFlag = 1;
+        return pc;
+    }
+    c8->sp -= 1;
+    return c8->stack[c8->sp] + 2;
+}
+
+static inline uint16_t _op0_sys(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) c8;
+    (void) ins; /* traced, see chip8trace.h */
+    return pc + 2;
+}
+
+/**
+ * Scrolls move the selected planes by pixels of the current resolution.
+ * Up and down are a memmove per word column, left and right shift each
+ * row's words and carry the bits from one word to the next.
+ */
+static inline uint16_t _op0_scroll_down(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    int rows = _screen_rows(c8);
+    for (int p = 0; p < C8_PLANES; p++) {
+        for (int w = 0; (c8->planes >> p & 1) && w < _screen_words(c8); w++) {
+            uint64_t* col = c8->gfx[p][w];
+            memmove(col + ins->n, col, (rows - ins->n) * sizeof(uint64_t));
+            memset(col, 0, ins->n * sizeof(uint64_t));
+        }
+    }
+    c8->drawFlag = 1;
+    return pc + 2;
+}
+
+static inline uint16_t _op0_scroll_up(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    int rows = _screen_rows(c8);
+    for (int p = 0; p < C8_PLANES; p++) {
+        for (int w = 0; (c8->planes >> p & 1) && w < _screen_words(c8); w++) {
+            uint64_t* col = c8->gfx[p][w];
+            memmove(col, col + ins->n, (rows - ins->n) * sizeof(uint64_t));
+            memset(col + rows - ins->n, 0, ins->n * sizeof(uint64_t));
+        }
     }
+    c8->drawFlag = 1;
+    return pc + 2;
 }
 
-static void _op0_sys(Chip8* c8) {
-    printf("nop... [0x%X]\n", c8->opcode);
-    c8->incPcFlag = 1;
+static inline uint16_t _op0_scroll_right(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
+    int rows = _screen_rows(c8);
+    int last = _screen_words(c8) - 1;
+    for (int p = 0; p < C8_PLANES; p++) {
+        if (!(c8->planes >> p & 1)) {
+            continue;
+        }
+        for (int y = 0; y < rows; y++) {
+            for (int w = last; w > 0; w--) {
+                c8->gfx[p][w][y] = c8->gfx[p][w][y] >> 4 | c8->gfx[p][w - 1][y] << 60;
+            }
+            c8->gfx[p][0][y] >>= 4;
+        }
+    }
+    c8->drawFlag = 1;
+    return pc + 2;
+}
+
+static inline uint16_t _op0_scroll_left(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
+    int rows = _screen_rows(c8);
+    int last = _screen_words(c8) - 1;
+    for (int p = 0; p < C8_PLANES; p++) {
+        if (!(c8->planes >> p & 1)) {
+            continue;
+        }
+        for (int y = 0; y < rows; y++) {
+            for (int w = 0; w < last; w++) {
+                c8->gfx[p][w][y] = c8->gfx[p][w][y] << 4 | c8->gfx[p][w + 1][y] >> 60;
+            }
+            c8->gfx[p][last][y] <<= 4;
+        }
+    }
+    c8->drawFlag = 1;
+    return pc + 2;
 }
 
-static void _op1_jump_addr(Chip8* c8) {
-    uint16_t addr = C8_EXTR_ADDR(c8->opcode);
+/* the VM stops like it does on an error, but err stays C8_ERR_NONE */
+static inline uint16_t _op0_exit(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
+    c8->running = 0;
+    return pc;
+}
+
+/* switching resolutions clears every plane, selected or not */
+static inline uint16_t _op0_lores(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
+    c8->hires = 0;
+    memset(c8->gfx, 0, sizeof(c8->gfx));
+    c8->drawFlag = 1;
+    return pc + 2;
+}
+
+static inline uint16_t _op0_hires(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
+    c8->hires = 1;
+    memset(c8->gfx, 0, sizeof(c8->gfx));
+    c8->drawFlag = 1;
+    return pc + 2;
+}
+
+static inline uint16_t _op1_jump_addr(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    unsigned addr = C8_EXTR_ADDR(ins->opcode);
     if (addr >= C8_MEMORY_SIZE) {
         c8->running = 0;
         c8->err = C8_ERR_ADDR_OUT_OF_BOUNDS;
-        c8->incPcFlag = 0;
-        return;
+        return pc;
     }
-    c8->pc = addr;
-    c8->incPcFlag = 0;
+    return addr;
 }
 
-static void _op2_call(Chip8* c8) {
+static inline uint16_t _op2_call(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
     if (c8->sp == C8_STACK_SIZE) {
         c8->err = C8_ERR_STACK_OVERFLOW;
         c8->running = 0;
-    } else {
-        uint16_t addr = C8_EXTR_ADDR(c8->opcode);
-        if (addr >= C8_MEMORY_SIZE) {
-            c8->running = 0;
-            c8->err = C8_ERR_ADDR_OUT_OF_BOUNDS;
-        } else {
-            c8->stack[c8->sp] = c8->pc;
-            c8->sp += 1;
-            c8->pc = addr;
-        }
+        return pc;
+    }
+    unsigned addr = C8_EXTR_ADDR(ins->opcode);
+    if (addr >= C8_MEMORY_SIZE) {
+        c8->running = 0;
+        c8->err = C8_ERR_ADDR_OUT_OF_BOUNDS;
+        return pc;
     }
-    c8->incPcFlag = 0;
+    c8->stack[c8->sp] = pc;
+    c8->sp += 1;
+    return addr;
 }
 
-static void _op3_skip_eq_byte(Chip8* c8) {
-    uint8_t byte = C8_EXTR_BYTE(c8->opcode);
-    uint8_t vx = c8->V[C8_EXTR_X(c8->opcode)];
-    if (vx == byte) {
-        c8->pc += 2;
-    }
-    c8->incPcFlag = 1;
+static inline uint16_t _op3_skip_eq_byte(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    return c8->V[ins->x] == ins->nn ? _skip(c8, pc, quirks) : pc + 2;
+}
+
+static inline uint16_t _op4_skip_neq_byte(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    return c8->V[ins->x] != ins->nn ? _skip(c8, pc, quirks) : pc + 2;
+}
+
+static inline uint16_t _op5_skip_eq_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    return c8->V[ins->x] == c8->V[ins->y] ? _skip(c8, pc, quirks) : pc + 2;
 }
 
-static void _op4_skip_neq_byte(Chip8* c8) {
-    uint8_t byte = C8_EXTR_BYTE(c8->opcode);
-    uint8_t vx = c8->V[C8_EXTR_X(c8->opcode)];
-    if (vx != byte) {
-        c8->pc += 2;
+/* Vx to Vy go to memory from I on, in that order even when x > y. I stays put */
+static inline uint16_t _op5_store_range(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    int step = ins->x <= ins->y ? 1 : -1;
+    int len = (ins->x <= ins->y ? ins->y - ins->x : ins->x - ins->y) + 1;
+    uint8_t regs[C8_REGISTER_AMOUNT];
+    for (int i = 0; i < len; i++) {
+        regs[i] = c8->V[ins->x + i * step];
     }
-    c8->incPcFlag = 1;
+    _store(c8, c8->I, regs, (uint16_t) len);
+    return pc + 2;
 }
 
-static void _op5_skip_eq_reg(Chip8* c8) {
-    uint8_t vx = c8->V[C8_EXTR_X(c8->opcode)];
-    uint8_t vy = c8->V[C8_EXTR_Y(c8->opcode)];
-    if (vx == vy) {
-        c8->pc += 2;
+static inline uint16_t _op5_load_range(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    int step = ins->x <= ins->y ? 1 : -1;
+    int len = (ins->x <= ins->y ? ins->y - ins->x : ins->x - ins->y) + 1;
+    for (int i = 0; i < len; i++) {
+        c8->V[ins->x + i * step] = c8->memory[(c8->I + i) & C8_ADDR_MASK];
     }
-    c8->incPcFlag = 1;
+    return pc + 2;
 }
 
-static void _op6_load_byte(Chip8* c8) {
-    uint8_t byte = C8_EXTR_BYTE(c8->opcode);
-    c8->V[C8_EXTR_X(c8->opcode)] = byte;
-    c8->incPcFlag = 1;
+static inline uint16_t _op6_load_byte(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->V[ins->x] = ins->nn;
+    return pc + 2;
 }
 
-static void _op7_add_byte(Chip8* c8) {
-    uint8_t byte = C8_EXTR_BYTE(c8->opcode);
-    c8->V[C8_EXTR_X(c8->opcode)] += byte;
-    c8->incPcFlag = 1;
+static inline uint16_t _op7_add_byte(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->V[ins->x] += ins->nn;
+    return pc + 2;
 }
 
 
-static void _op8_load_reg(Chip8* c8) {
-    c8->V[C8_EXTR_X(c8->opcode)] = c8->V[C8_EXTR_Y(c8->opcode)];
-    c8->incPcFlag = 1;
+static inline uint16_t _op8_load_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->V[ins->x] = c8->V[ins->y];
+    return pc + 2;
 }
 
-static void _op8_or(Chip8* c8) {
-    c8->V[C8_EXTR_X(c8->opcode)] |= c8->V[C8_EXTR_Y(c8->opcode)];
-    c8->incPcFlag = 1;
+static inline uint16_t _op8_or(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->V[ins->x] |= c8->V[ins->y];
+    return pc + 2;
 }
 
-static void _op8_and(Chip8* c8) {
-    c8->V[C8_EXTR_X(c8->opcode)] &= c8->V[C8_EXTR_Y(c8->opcode)];
-    c8->incPcFlag = 1;
+static inline uint16_t _op8_and(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->V[ins->x] &= c8->V[ins->y];
+    return pc + 2;
 }
 
-static void _op8_xor(Chip8* c8) {
-    c8->V[C8_EXTR_X(c8->opcode)] ^= c8->V[C8_EXTR_Y(c8->opcode)];
-    c8->incPcFlag = 1;
+static inline uint16_t _op8_xor(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->V[ins->x] ^= c8->V[ins->y];
+    return pc + 2;
 }
 
-static void _op8_add_reg(Chip8* c8) {
-    if (c8->V[C8_EXTR_X(c8->opcode)] > UINT8_MAX - c8->V[C8_EXTR_Y(c8->opcode)]) {
+static inline uint16_t _op8_add_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    if (c8->V[ins->x] > UINT8_MAX - c8->V[ins->y]) {
         c8->V[0xF] = 1;
     } else {
         c8->V[0xF] = 0;
     }
-    c8->V[C8_EXTR_X(c8->opcode)] += c8->V[C8_EXTR_Y(c8->opcode)];
-    c8->incPcFlag = 1;
+    c8->V[ins->x] += c8->V[ins->y];
+    return pc + 2;
 }
 
-static void _op8_sub_reg(Chip8* c8) {
-    if (c8->V[C8_EXTR_X(c8->opcode)] > c8->V[C8_EXTR_Y(c8->opcode)]) {
+static inline uint16_t _op8_sub_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    if (c8->V[ins->x] > c8->V[ins->y]) {
         c8->V[0xF] = 1;
     } else {
         c8->V[0xF] = 0;
     }
-    c8->V[C8_EXTR_X(c8->opcode)] -= c8->V[C8_EXTR_Y(c8->opcode)];
-    c8->incPcFlag = 1;
+    c8->V[ins->x] -= c8->V[ins->y];
+    return pc + 2;
 }
 
-static void _op8_shiftr_reg(Chip8* c8) {
-    c8->V[0xF] = c8->V[C8_EXTR_X(c8->opcode)] & 0x1;
-    c8->V[C8_EXTR_X(c8->opcode)] >>= 1;
-    c8->incPcFlag = 1;
+static inline uint16_t _op8_shiftr_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    if (quirks & C8_QUIRK_SHIFT_VY) {
+        /* the VIP's way: Vy goes in, and the flag is written last */
+        uint8_t vy = c8->V[ins->y];
+        c8->V[ins->x] = vy >> 1;
+        c8->V[0xF] = vy & 0x1;
+        return pc + 2;
+    }
+    c8->V[0xF] = c8->V[ins->x] & 0x1;
+    c8->V[ins->x] >>= 1;
+    return pc + 2;
 }
 
-static void _op8_sub_reversed_reg(Chip8* c8) {
-    if (c8->V[C8_EXTR_Y(c8->opcode)] > c8->V[C8_EXTR_X(c8->opcode)] ) {
+static inline uint16_t _op8_sub_reversed_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    if (c8->V[ins->y] > c8->V[ins->x] ) {
         c8->V[0xF] = 1;
     } else {
         c8->V[0xF] = 0;
     }
-    c8->V[C8_EXTR_X(c8->opcode)] = c8->V[C8_EXTR_Y(c8->opcode)] - c8->V[C8_EXTR_X(c8->opcode)] ;
-    c8->incPcFlag = 1;
+    c8->V[ins->x] = c8->V[ins->y] - c8->V[ins->x] ;
+    return pc + 2;
 }
 
-static void _op8_shiftl_reg(Chip8* c8) {
-    c8->V[0xF] = (c8->V[C8_EXTR_X(c8->opcode)] & 0x80) >> 7;
-    c8->V[C8_EXTR_X(c8->opcode)] <<= 1;
-    c8->incPcFlag = 1;
+static inline uint16_t _op8_shiftl_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    if (quirks & C8_QUIRK_SHIFT_VY) {
+        uint8_t vy = c8->V[ins->y];
+        c8->V[ins->x] = (uint8_t) (vy << 1);
+        c8->V[0xF] = (vy & 0x80) >> 7;
+        return pc + 2;
+    }
+    c8->V[0xF] = (c8->V[ins->x] & 0x80) >> 7;
+    c8->V[ins->x] <<= 1;
+    return pc + 2;
 }
 
 
-static void _op9_skip_neq_reg(Chip8* c8) {
-    uint8_t vx = c8->V[C8_EXTR_X(c8->opcode)];
-    uint8_t vy = c8->V[C8_EXTR_Y(c8->opcode)];
-    if (vx != vy) {
-        c8->pc += 2;
-    }
-    c8->incPcFlag = 1;
+static inline uint16_t _op9_skip_neq_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    return c8->V[ins->x] != c8->V[ins->y] ? _skip(c8, pc, quirks) : pc + 2;
 }
 
-static void _opA_load_I(Chip8* c8) {
-    uint16_t addr = C8_EXTR_ADDR(c8->opcode);
+static inline uint16_t _opA_load_I(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    unsigned addr = C8_EXTR_ADDR(ins->opcode);
     if (addr >= C8_MEMORY_SIZE) {
         c8->running = 0;
         c8->err = C8_ERR_ADDR_OUT_OF_BOUNDS;
-        c8->incPcFlag = 0;
-        return;
+        return pc;
     }
     c8->I = addr;
-    c8->incPcFlag = 1;
+    return pc + 2;
 }
 
-static void _opB_jump_reg(Chip8* c8) {
-    uint16_t addr = C8_EXTR_ADDR(c8->opcode) + c8->V[0];
+static inline uint16_t _opB_jump_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    unsigned addr = C8_EXTR_ADDR(ins->opcode) + c8->V[quirks & C8_QUIRK_JUMP_VX ? ins->x : 0];
     if (addr >= C8_MEMORY_SIZE) {
         c8->running = 0;
         c8->err = C8_ERR_ADDR_OUT_OF_BOUNDS;
-        c8->incPcFlag = 0;
-        return;
+        return pc;
     }
-    c8->pc = addr;
-    c8->incPcFlag = 0;
+    return addr;
 }
 
-static void _opC_rand(Chip8* c8) {
-    SetRandomSeed(time(NULL));
-    c8->V[C8_EXTR_X(c8->opcode)] =((uint8_t) GetRandomValue(0, 255)) & C8_EXTR_BYTE(c8->opcode);
-    c8->incPcFlag = 1;
+static inline uint16_t _opC_rand(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->V[ins->x] = ((uint8_t) _pcg32(&c8->rng)) & ins->nn;
+    return pc + 2;
 }
 
-static void _opD_draw_sprite(Chip8* c8) {
-    uint8_t x = c8->V[C8_EXTR_X(c8->opcode)];
-    uint8_t y = c8->V[C8_EXTR_Y(c8->opcode)];
-    uint8_t height = C8_EXTR_NIBBLE(c8->opcode);
-
-    c8->V[0xF] = 0;
-    for (int yln = 0; yln < height && y + yln < C8_SCREEN_HEIGHT; yln++) {
-        uint8_t pixel = c8->memory[c8->I + yln];
-
-        for (int xln = 0; xln < 8 && x + xln < C8_SCREEN_WIDTH; xln++) {
-            int idx = (x + xln + ((y + yln) * 64));
+static inline uint16_t _opD_draw_sprite(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    if (quirks & C8_EXT_OPS) {
+        return _draw_planes(c8, ins, pc, quirks);
+    }
+    /* plain CHIP-8 only ever draws on the first plane, in lo-res */
+    uint64_t* gfx = c8->gfx[0][0];
+    uint8_t x = c8->V[ins->x];
+    uint8_t y = c8->V[ins->y];
+    uint8_t height = ins->n;
+    uint16_t I = c8->I;
+
+    uint8_t collision = 0;
+    if (quirks & C8_QUIRK_WRAP_SPRITES) {
+        /* rotated instead of shifted, so what goes past the right edge comes back on the left */
+        x &= C8_SCREEN_WIDTH - 1;
+        for (int yln = 0; yln < height; yln++) {
+            uint64_t bits = (uint64_t) c8->memory[(I + yln) & C8_ADDR_MASK] << (C8_SCREEN_WIDTH - 8);
+            uint64_t row = x ? bits >> x | bits << (C8_SCREEN_WIDTH - x) : bits;
+            uint64_t* line = &gfx[(y + yln) & (C8_SCREEN_HEIGHT - 1)];
+            collision |= (*line & row) != 0;
+            *line ^= row;
+        }
+    } else if (x < C8_SCREEN_WIDTH) {
+        /* each sprite row is lined up with x as one word, the right edge clips it */
+        for (int yln = 0; yln < height && y + yln < C8_SCREEN_HEIGHT; yln++) {
+            uint64_t row = ((uint64_t) c8->memory[(I + yln) & C8_ADDR_MASK] << (C8_SCREEN_WIDTH - 8)) >> x;
+            uint64_t* line = &gfx[y + yln];
+            collision |= (*line & row) != 0;
+            *line ^= row;
+        }
+    }
+    c8->V[0xF] = collision;
+    c8->drawFlag = 1;
+    C8_PROFILE_DRAW(c8, collision);
+    return pc + 2;
+}
 
-            if ((pixel & (0x80U >> xln))) {
-                if (c8->gfx[idx]) {
-                    c8->V[0xF] = 1;
+/**
+ * Dxyn with SUPER-CHIP's or XO-CHIP's instructions: either resolution,
+ * Dxy0 draws 16x16, and every selected plane gets a sprite of its own,
+ * right after the previous plane's in memory. Each sprite row is lined up
+ * with x as a word and xored into the one or two words of the row it
+ * lands on. Where it starts always wraps, the rest clips or wraps.
+ */
+static inline uint16_t _draw_planes(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    int words = _screen_words(c8);
+    int rows = _screen_rows(c8);
+    int wide = ins->n == 0;
+    int height = wide ? 16 : ins->n;
+    int x = c8->V[ins->x] & (words * 64 - 1);
+    int y = c8->V[ins->y] & (rows - 1);
+    int w = x >> 6;
+    int shift = x & 63;
+    int next = w + 1 < words ? w + 1 : (quirks & C8_QUIRK_WRAP_SPRITES) ? 0 : -1;
+    uint16_t I = c8->I;
+
+    uint8_t collision = 0;
+    for (int p = 0; p < C8_PLANES; p++) {
+        if (!(c8->planes >> p & 1)) {
+            continue;
+        }
+        for (int yln = 0; yln < height; yln++) {
+            int line = y + yln;
+            if (line >= rows) {
+                if (!(quirks & C8_QUIRK_WRAP_SPRITES)) {
+                    break;
                 }
-                c8->gfx[idx] ^= 1;
+                line -= rows;
+            }
+            uint64_t bits;
+            if (wide) {
+                bits = (uint64_t) (c8->memory[(I + 2 * yln) & C8_ADDR_MASK] << 8
+                    | c8->memory[(I + 2 * yln + 1) & C8_ADDR_MASK]) << 48;
+            } else {
+                bits = (uint64_t) c8->memory[(I + yln) & C8_ADDR_MASK] << 56;
+            }
+            uint64_t* left = &c8->gfx[p][w][line];
+            collision |= (*left & bits >> shift) != 0;
+            *left ^= bits >> shift;
+            if (shift && next >= 0) {
+                uint64_t* right = &c8->gfx[p][next][line];
+                collision |= (*right & bits << (64 - shift)) != 0;
+                *right ^= bits << (64 - shift);
             }
         }
+        I += wide ? 32 : height;
     }
+    c8->V[0xF] = collision;
     c8->drawFlag = 1;
-    c8->incPcFlag = 1;
+    C8_PROFILE_DRAW(c8, collision);
+    return pc + 2;
 }
 
 
-static void _opE_skip_on_keypress(Chip8* c8) {
-    if (c8->key[c8->V[C8_EXTR_X(c8->opcode)]] == 1) {
-        c8->pc += 2;
-    }
-    c8->incPcFlag = 1;
+static inline uint16_t _opE_skip_on_keypress(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    /* there's no key past F, so it's never down */
+    uint8_t vx = c8->V[ins->x];
+    return vx < C8_KEYS_AMOUNT && c8->key[vx] == 1 ? _skip(c8, pc, quirks) : pc + 2;
 }
 
-static void _opE_skip_on_keyrelease(Chip8* c8) {
-    if (c8->key[c8->V[C8_EXTR_X(c8->opcode)]] == 0) {
-        c8->pc += 2;
-    }
-    c8->incPcFlag = 1;
+static inline uint16_t _opE_skip_on_keyrelease(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    uint8_t vx = c8->V[ins->x];
+    return vx >= C8_KEYS_AMOUNT || c8->key[vx] == 0 ? _skip(c8, pc, quirks) : pc + 2;
 }
 
 
-static void _opF_load_delay_timer_toreg(Chip8* c8) {
-    c8->V[C8_EXTR_X(c8->opcode)] = c8->delayTimer;
-    c8->incPcFlag = 1;
+static inline uint16_t _opF_load_delay_timer_toreg(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->V[ins->x] = c8->delayTimer;
+    return pc + 2;
 }
 
-static void _opF_load_keypress_and_wait(Chip8* c8) {
+static inline uint16_t _opF_load_keypress_and_wait(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
     c8->waitingForKey = 1;
-    c8->incPcFlag = 1;
+    return pc + 2;
 }
 
-static void _opF_load_delay_timer_set(Chip8* c8) {
-    c8->delayTimer = c8->V[C8_EXTR_X(c8->opcode)];
-    c8->incPcFlag = 1;
+static inline uint16_t _opF_load_delay_timer_set(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->delayTimer = c8->V[ins->x];
+    return pc + 2;
 }
 
-static void _opF_load_sound_timer_set(Chip8* c8) {
-    c8->soundTimer = c8->V[C8_EXTR_X(c8->opcode)];
-    c8->incPcFlag = 1;
+static inline uint16_t _opF_load_sound_timer_set(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->soundTimer = c8->V[ins->x];
+    return pc + 2;
 }
 
-static void _opF_add_I_reg(Chip8* c8) {
-    if (c8->I + c8->V[C8_EXTR_X(c8->opcode)] > 0xFFF) {
-        c8->V[0xF] = 1;
+static inline uint16_t _opF_add_I_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    /* "past the end" is wherever memory ends, so 0xFFFF with XOCHIP=1 */
+    if (!(quirks & C8_QUIRK_ADD_I_NO_VF)) {
+        c8->V[0xF] = c8->I + c8->V[ins->x] > C8_ADDR_MASK;
+    }
+    c8->I += c8->V[ins->x];
+    return pc + 2;
+}
+
+static inline uint16_t _opF_load_hex_sprite_for_value(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->I = c8->V[ins->x] * 5;
+    return pc + 2;
+}
+
+static inline uint16_t _opF_store_bcd_rep_of_reg(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    uint8_t vx = c8->V[ins->x];
+    uint8_t digits[3] = { vx / 100, vx % 100 / 10, vx % 10 };  /* hundreds, tens, ones */
+    _store(c8, c8->I, digits, 3);
+    return pc + 2;
+}
+
+static inline uint16_t _opF_store_regs_to_mem_starting_at_I(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    _store(c8, c8->I, c8->V, ins->x + 1);
+    if (!(quirks & C8_QUIRK_KEEP_I)) {
+        c8->I = c8->I + ins->x + 1;
+    }
+    return pc + 2;
+}
+
+static inline uint16_t _opF_load_regs_from_mem_starting_at_I(Chip8* c8, const Chip8Ins* ins, uint16_t pc, unsigned quirks) {
+    uint16_t addr = c8->I & C8_ADDR_MASK;
+    if (addr + ins->x < C8_MEMORY_SIZE) {
+        memcpy(c8->V, c8->memory + addr, ins->x + 1);
     } else {
-        c8->V[0xF] = 0;
+        for (int r = 0; r <= ins->x; r++) {
+            c8->V[r] = c8->memory[(addr + r) & C8_ADDR_MASK];
+        }
+    }
+    if (!(quirks & C8_QUIRK_KEEP_I)) {
+        c8->I = c8->I + ins->x + 1;
     }
-    c8->I += c8->V[C8_EXTR_X(c8->opcode)];
-    c8->incPcFlag = 1;
+    return pc + 2;
 }
 
-static void _opF_load_hex_sprite_for_value(Chip8* c8) {
-    c8->I = c8->V[C8_EXTR_X(c8->opcode)] * 5;
-    c8->incPcFlag = 1;
+static inline uint16_t _opF_load_big_sprite_for_value(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->I = C8_BIG_FONT_ADDRESS + (c8->V[ins->x] & 0xF) * C8_BIG_FONT_SIZE;
+    return pc + 2;
 }
 
-static void _opF_store_bcd_rep_of_reg(Chip8* c8) {
-    uint8_t vx = c8->V[C8_EXTR_X(c8->opcode)];
-    c8->memory[c8->I]       = vx / 100;         /* hundreds */
-    c8->memory[c8->I + 1]   = vx % 100 / 10;    /* tens */
-    c8->memory[c8->I + 2]   = vx % 10;          /* ones */
-    c8->incPcFlag = 1;
+static inline uint16_t _opF_store_regs_to_flags(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    memcpy(c8->rpl, c8->V, ins->x + 1);
+    return pc + 2;
 }
 
-static void _opF_store_regs_to_mem_starting_at_I(Chip8* c8) {
-    memcpy(c8->memory + c8->I, c8->V, C8_EXTR_X(c8->opcode) + 1);
-    c8->I = c8->I + C8_EXTR_X(c8->opcode) + 1;
-    c8->incPcFlag = 1;
+static inline uint16_t _opF_load_regs_from_flags(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    memcpy(c8->V, c8->rpl, ins->x + 1);
+    return pc + 2;
+}
+
+/* the address is the next word, which makes this the one 4-byte instruction */
+static inline uint16_t _opF_load_I_long(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
+    unsigned addr = c8->memory[(pc + 2) & C8_ADDR_MASK] << 8 | c8->memory[(pc + 3) & C8_ADDR_MASK];
+    if (addr >= C8_MEMORY_SIZE) {
+        c8->running = 0;
+        c8->err = C8_ERR_ADDR_OUT_OF_BOUNDS;
+        return pc;
+    }
+    c8->I = (uint16_t) addr;
+    return pc + 4;
+}
+
+static inline uint16_t _opF_select_planes(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->planes = ins->x & ((1 << C8_PLANES) - 1);
+    return pc + 2;
+}
+
+static inline uint16_t _opF_load_audio_pattern(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    (void) ins;
+    for (int i = 0; i < (int) sizeof(c8->audio); i++) {
+        c8->audio[i] = c8->memory[(c8->I + i) & C8_ADDR_MASK];
+    }
+    return pc + 2;
 }
 
-static void _opF_load_regs_from_mem_starting_at_I(Chip8* c8) {
-    memcpy(c8->V, c8->memory + c8->I, C8_EXTR_X(c8->opcode) + 1);    
-    c8->I = c8->I + C8_EXTR_X(c8->opcode) + 1;
-    c8->incPcFlag = 1;
+static inline uint16_t _opF_set_pitch(Chip8* c8, const Chip8Ins* ins, uint16_t pc) {
+    c8->pitch = c8->V[ins->x];
+    return pc + 2;
 }
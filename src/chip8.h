@@ -11,24 +11,121 @@
 #define C8_ERR_NO_ROM_LOADED        4
 #define C8_ERR_ADDR_OUT_OF_BOUNDS   5
 
+/* chip8RunCycles events, as a mask */
+#define C8_YIELD_BUDGET             0x01    /* ran the whole budget */
+#define C8_YIELD_DRAW               0x02    /* the screen changed (00E0, Dxyn, a scroll or a resolution switch) */
+#define C8_YIELD_KEY_WAIT           0x04    /* waiting for a key press (Fx0A) */
+#define C8_YIELD_ERROR              0x08    /* the VM stopped, see err */
+#define C8_YIELD_TIMER              0x10    /* a 60hz tick is due, call chip8DecrTimers */
+
 #define C8_STACK_SIZE               16
+#ifdef C8_XOCHIP
+#define C8_MEMORY_SIZE              0x10000 /* 'make XOCHIP=1': XO-CHIP's whole address space */
+#else
 #define C8_MEMORY_SIZE              4096
+#endif
 #define C8_REGISTER_AMOUNT          16
 #define C8_KEYS_AMOUNT              16
+#define C8_MAX_ROM_SIZE             (C8_MEMORY_SIZE - 0x200)        /* ROMs load at 0x200 */
 
-#define C8_SCREEN_HEIGHT            32
+#define C8_SCREEN_HEIGHT            32      /* lo-res, the only mode CHIP-8 had */
 #define C8_SCREEN_WIDTH             64
 #define C8_SCREEN_SIZE              (C8_SCREEN_WIDTH * C8_SCREEN_HEIGHT)
+#define C8_HIRES_HEIGHT             64      /* SUPER-CHIP's hi-res mode (00FF) */
+#define C8_HIRES_WIDTH              128
+#define C8_MAX_SCREEN_SIZE          (C8_HIRES_WIDTH * C8_HIRES_HEIGHT)
+#define C8_ROW_WORDS                (C8_HIRES_WIDTH / 64)   /* 64-bit words in a hi-res row */
+#define C8_PLANES                   2       /* XO-CHIP's bitplanes */
+
+#define C8_FONT_ADDRESS             0x000   /* 4x5 hex digits, Fx29 */
+#define C8_BIG_FONT_ADDRESS         0x050   /* SUPER-CHIP's 8x10 ones, Fx30 */
+
+#define C8_DECODED_AMOUNT           (C8_MEMORY_SIZE / 2)
+#define C8_PAGE_SIZE                (C8_MEMORY_SIZE / 64)   /* granularity of Chip8::dirtyPages, a bit per page */
+
+/**
+ * Quirks, the places where CHIP-8 interpreters never agreed. None set is
+ * how this one always behaved.
+ */
+#define C8_QUIRK_SHIFT_VY           0x01    /* 8xy6/8xyE shift Vy into Vx (COSMAC VIP), not Vx in place */
+#define C8_QUIRK_KEEP_I             0x02    /* Fx55/Fx65 leave I alone instead of moving it past the registers */
+#define C8_QUIRK_ADD_I_NO_VF        0x04    /* Fx1E doesn't set VF when I goes past the end of memory */
+#define C8_QUIRK_WRAP_SPRITES       0x08    /* sprites wrap around the screen edges instead of getting clipped */
+#define C8_QUIRK_JUMP_VX            0x10    /* Bxnn jumps to xnn + Vx, not nnn + V0 */
+#define C8_QUIRK_SCHIP_OPS          0x20    /* SUPER-CHIP's instructions: hi-res, scrolling, 16x16 sprites, Fx30, Fx75/Fx85 */
+#define C8_QUIRK_XOCHIP_OPS         0x40    /* XO-CHIP's: bitplanes, 00Dn, 5xy2/5xy3, F000 nnnn, F002, Fx3A */
+
+/**
+ * The quirk sets the interpreter comes in, X(id, name, quirks). Every one
+ * gets its own copy of the interpreter with the quirks compiled in, so
+ * a line here costs code size, not speed.
+ */
+#define C8_QUIRK_PROFILES(X)                                                                    \
+    X(DEFAULT,  "default",  0)                                                                  \
+    X(VIP,      "vip",      C8_QUIRK_SHIFT_VY | C8_QUIRK_ADD_I_NO_VF)                           \
+    X(SCHIP,    "schip",    C8_QUIRK_KEEP_I | C8_QUIRK_ADD_I_NO_VF | C8_QUIRK_JUMP_VX           \
+                            | C8_QUIRK_SCHIP_OPS)                                               \
+    X(XOCHIP,   "xochip",   C8_QUIRK_SHIFT_VY | C8_QUIRK_ADD_I_NO_VF | C8_QUIRK_WRAP_SPRITES    \
+                            | C8_QUIRK_SCHIP_OPS | C8_QUIRK_XOCHIP_OPS)
+
+#define C8_QUIRKS_ENUM(id, name, quirks) C8_QUIRKS_##id,
+enum {
+    C8_QUIRK_PROFILES(C8_QUIRKS_ENUM)
+    C8_QUIRKS_COUNT
+};
+#undef C8_QUIRKS_ENUM
 
 #define C8_CLOCK_SPEED              600
 #define C8_TIMER_SPEED              60
 #define C8_DEFAULT_CLOCK_SPEED      (1.0 / C8_CLOCK_SPEED)
 #define C8_TIMER_CLOCK_SPEED        (1.0 / C8_TIMER_SPEED)
+#define C8_MIN_CLOCK_SPEED          C8_TIMER_SPEED                  /* one cycle per timer tick */
+#define C8_MAX_CLOCK_SPEED          (C8_TIMER_SPEED * 65535U)
+
+#define C8_STATE_VERSION            2
+#define C8_STATE_HEADER_SIZE        129     /* everything but the screen and memory */
+#define C8_STATE_SIZE               (C8_STATE_HEADER_SIZE + (C8_PLANES * C8_ROW_WORDS * C8_HIRES_HEIGHT) * 8 + C8_MEMORY_SIZE)
+
+#define C8_DUMP_JSON_VERSION        2
+
+#define C8_PROFILE_OPS              64      /* room for every decoded instruction kind */
+#define C8_PROFILE_CSV_HEADER       "rom,kind,key,count\n"
+
+#define C8_FUZZ_MAP_BITS            16
+#define C8_FUZZ_MAP_SIZE            (1 << C8_FUZZ_MAP_BITS)
+
+#define C8_DEFAULT_SEED             0x853C49E6748FEA9BULL   /* what chip8Init seeds Cxkk with */
+
+/**
+ * An instruction after decoding: the handler it resolved to plus its
+ * operands, already unpacked. Cached per even address in Chip8::decoded.
+ */
+typedef struct Chip8Ins {
+    uint16_t opcode;                /* raw instruction */
+    uint8_t op;                     /* handler id, 0 when not decoded yet */
+    uint8_t x;                      /* 0x0F00 */
+    uint8_t y;                      /* 0x00F0 */
+    uint8_t n;                      /* 0x000F */
+    uint8_t nn;                     /* 0x00FF */
+} Chip8Ins;
+
+#ifdef C8_PROFILE
+/**
+ * Execution counts, only there in 'make PROFILE=1' builds. Reset by
+ * chip8Init (so by loading a ROM too).
+ */
+typedef struct Chip8Profile {
+    uint64_t ops[C8_PROFILE_OPS];   /* per decoded instruction kind */
+    uint64_t pcs[C8_MEMORY_SIZE];   /* per address instructions ran from */
+    uint64_t collisions;            /* Dxyn that set VF */
+} Chip8Profile;
+#endif
 
 /**
  * 0x000 - 0x1FF = Chip 8 interpreter (will contain font set)
- * 0x050 - 0x0A0 = Used for the built in 4x5 pixel font set (0-F)
- * 0x200 - 0xFFF = Program ROM and working RAM
+ * 0x000 - 0x04F = Used for the built in 4x5 pixel font set (0-F)
+ * 0x050 - 0x0EF = The 8x10 one, with SUPER-CHIP's instructions on
+ * 0x200 - 0xFFF = Program ROM and working RAM (up to 0xFFFF with XOCHIP=1)
  */
 typedef struct Chip8 {
     uint8_t err;
@@ -41,23 +138,155 @@ typedef struct Chip8 {
     uint16_t sp;                    /* stack pointer */ 
     uint16_t stack[C8_STACK_SIZE];  /* stack memory */ 
     uint8_t V[C8_REGISTER_AMOUNT];  /* V0-F registers */
-    uint8_t incPcFlag;              /* flag that tells to increment the program counter */
     uint16_t pc;                    /* program counter */
+    uint8_t quirks;                 /* C8_QUIRKS_*, which interpreter runs it */
     uint8_t memory[C8_MEMORY_SIZE]; /* ROM + RAM*/      // TODO - consider malloc'ing
     uint8_t drawFlag;               /* tells when to draw on the "screen" */
-    uint8_t gfx[C8_SCREEN_SIZE];    /* screen */        // TODO - consider malloc'ing
+    /**
+     * Screen, as bitplanes of 64-bit words: gfx[plane][w][y] is x = 64w to
+     * 64w + 63 of row y, msb first. Each word column is contiguous, so
+     * scrolling up or down is a memmove. Lo-res only uses gfx[p][0][0-31].
+     */
+    uint64_t gfx[C8_PLANES][C8_ROW_WORDS][C8_HIRES_HEIGHT];
+    uint8_t hires;                  /* 128x64 instead of 64x32 (00FF/00FE) */
+    uint8_t planes;                 /* bitplanes drawing goes to, bit n = gfx[n] (Fn01) */
+    uint8_t pitch;                  /* XO-CHIP's playback rate, Fx3A */
+    uint8_t audio[16];              /* and the 1-bit sample pattern it plays, F002 */
+    uint8_t rpl[C8_REGISTER_AMOUNT];/* SUPER-CHIP's flag registers, Fx75/Fx85 */
     uint8_t key[C8_KEYS_AMOUNT];    /* keypad keys */
+    uint64_t cycles;                /* cycles run since the ROM was loaded */
+    uint16_t cyclesPerTick;         /* cycles between two 60hz timer ticks */
+    uint16_t tickCountdown;         /* cycles left until the next tick */
+    uint64_t rng;                   /* Cxkk's generator state (PCG32) */
+    uint32_t codeWrites;            /* bumped every time a write lands on decoded code */
+    uint64_t dirtyPages;            /* one bit per C8_PAGE_SIZE bytes of memory written, see chip8Restore */
+    Chip8Ins decoded[C8_DECODED_AMOUNT]; /* decode cache, one entry per even address */
+#ifdef C8_PROFILE
+    Chip8Profile profile;
+#endif
+#ifdef C8_TRACE
+    struct Chip8Tracer* tracer;     /* where every instruction gets traced, see chip8trace.h */
+#endif
 } Chip8;
 
 int chip8Init(Chip8* chip8);
 int chip8LoadRom(Chip8* chip8, const char* filename);
-int chip8LoadFromArray(Chip8* chip8, uint8_t* data, size_t size);
+int chip8LoadFromArray(Chip8* chip8, const uint8_t* data, size_t size);
 int chip8EmulateCycle(Chip8* chip8);
+int chip8RunCycles(Chip8* chip8, uint32_t maxCycles, uint32_t* ran);
 int chip8DecrTimers(Chip8* chip8);
+/**
+ * chip8RunCycles until cycles have run, ticking the timers whenever it asks
+ * for it. Stops early only if the VM stops. Returns how many ran.
+ */
+uint64_t chip8RunFor(Chip8* chip8, uint64_t cycles);
+
+/**
+ * Instructions per emulated second, C8_CLOCK_SPEED after loading a ROM.
+ * It's kept as cycles per 60hz tick, so it gets rounded down to a multiple
+ * of C8_TIMER_SPEED (and clamped to C8_MIN/MAX_CLOCK_SPEED).
+ */
+int chip8SetClockSpeed(Chip8* chip8, uint32_t hz);
+uint32_t chip8GetClockSpeed(const Chip8* chip8);
 void chip8Destroy(Chip8* chip8);
 
+/**
+ * Seeds the VM's random generator (Cxkk). The same seed and inputs give
+ * the same run. Loading a ROM goes back to C8_DEFAULT_SEED, so seed after
+ * loading.
+ */
+void chip8Seed(Chip8* chip8, uint64_t seed);
+/* next byte from the VM's generator, same as a Cxkk would get */
+uint8_t chip8Random(Chip8* chip8);
+
+/**
+ * Picks the quirk profile (C8_QUIRKS_*) the VM runs with, 0 if there's no
+ * such profile. Like the seed, loading a ROM goes back to
+ * C8_QUIRKS_DEFAULT, so set it after loading. Save states don't keep it.
+ * Profiles with SUPER-CHIP's instructions also put the big font in at
+ * C8_BIG_FONT_ADDRESS.
+ */
+int chip8SetQuirks(Chip8* chip8, int profile);
+/* the profile called name, -1 if there isn't one */
+int chip8QuirksByName(const char* name);
+const char* chip8QuirksName(int profile);
+/* the profile's C8_QUIRK_* mask */
+unsigned chip8QuirksFlags(int profile);
+
 /* 0-F = keys, lsb to msb. should be updated on both press and release*/
 int chip8PressKeys(Chip8* chip8, uint16_t keysMask);
+/**
+ * Dumps the whole VM for people to read: memory, stack, registers, keys,
+ * screen and the rest. Nothing gets allocated, so it's fine from a crash
+ * handler.
+ */
 int chip8VMDump(const Chip8* chip8, FILE* outFile);
+/**
+ * Same thing as one JSON object, for tools: numbers are plain integers,
+ * "memory" is one hex string, and "screen" has an array per bitplane with
+ * a hex string per row (the row's gfx words, msb is x = 0), so 16 digits
+ * in lo-res and 32 in hi-res. C8_DUMP_JSON_VERSION goes up when keys
+ * change meaning.
+ */
+int chip8VMDumpJson(const Chip8* chip8, FILE* outFile);
+
+/**
+ * Save states. The format is versioned binary, little endian whatever the
+ * host, and always C8_STATE_SIZE bytes. That size takes in all of memory
+ * and is in the header, so builds with and without XOCHIP=1 can't load
+ * each other's states, they just get rejected. Saving writes into the
+ * caller's buffer and never allocates, so it's fine to do every frame.
+ * Returns the bytes written, 0 if buf is too small.
+ */
+size_t chip8SaveState(const Chip8* chip8, uint8_t* buf, size_t size);
+/**
+ * Restores a saved state into an initialized VM. Anything that doesn't look
+ * like a valid state is rejected (returns 0) and leaves the VM alone. Only
+ * the decoded code whose bytes actually changed is thrown away.
+ */
+int chip8LoadState(Chip8* chip8, const uint8_t* buf, size_t size);
+/**
+ * Puts chip8 back into the state from is in, where chip8 is a copy of from
+ * (a plain struct copy with dirtyPages cleared) that has run since. Only
+ * the memory pages chip8 wrote get copied back, so it costs a few hundred
+ * bytes instead of a whole init and load. After chip8Init or a ROM load
+ * every page counts as written. Copies from from any other VM are wrong.
+ */
+int chip8Restore(Chip8* chip8, const Chip8* from);
+
+/**
+ * Profiler output. Both return 0 and write nothing unless the build has
+ * C8_PROFILE. The JSON is one object; the CSV is rows of C8_PROFILE_CSV_HEADER,
+ * with rom in the first column. Only addresses that ran show up.
+ */
+int chip8ProfileWriteJson(const Chip8* chip8, FILE* outFile);
+int chip8ProfileWriteCsv(const Chip8* chip8, FILE* outFile, const char* rom);
+
+#ifdef C8_FUZZ
+/**
+ * Guest edge coverage, only there in 'make fuzz' builds. Every instruction
+ * the interpreter dispatches bumps the counter of the edge from the last
+ * (pc, handler) pair to this one, AFL style. The counters are global and
+ * shared by every VM, so only fuzz one at a time. chip8FuzzReset clears
+ * them before a run.
+ */
+extern uint8_t chip8FuzzCoverage[C8_FUZZ_MAP_SIZE];
+void chip8FuzzReset(void);
+#endif
+
+/**
+ * Screen access, in whichever resolution the VM is in. gfx is bit-packed,
+ * these give pixels back as colors: bit n set when plane n has the pixel,
+ * so 0/1 for anything that only draws on the first one.
+ */
+int chip8ScreenWidth(const Chip8* chip8);
+int chip8ScreenHeight(const Chip8* chip8);
+int chip8GetPixel(const Chip8* chip8, int x, int y);
+/* out must hold C8_MAX_SCREEN_SIZE bytes, it gets width * height of them, row by row */
+void chip8UnpackGfx(const Chip8* chip8, uint8_t* out);
+
+/* hash of registers, stack, timers, memory and screen. useful for comparing runs */
+uint64_t chip8StateHash(const Chip8* chip8);
+uint64_t chip8ScreenHash(const Chip8* chip8);
 
 #endif /* CHIP8_H */
\ No newline at end of file
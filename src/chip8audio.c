@@ -0,0 +1,156 @@
+#include "raylib.h"
+#include "chip8audio.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+
+#define C8_AUDIO_PATTERN_BITS   128
+#define C8_AUDIO_XO_RATE        4000.0  /* pattern bits per second at pitch 64 */
+
+/**
+ * Everything the callback touches. The tables get built before the stream
+ * starts, the rest belongs to the audio thread, except for the latency
+ * counters, which the GUI reads.
+ */
+static struct {
+    Chip8Runner* runner;
+    AudioStream stream;
+    int started;
+
+    uint32_t steps[256];                /* phase step per sample, by pitch */
+    uint32_t beepStep;
+    uint8_t beep[C8_AUDIO_PATTERN_BITS / 8];
+
+    Chip8RunnerSound sound;             /* the last state read */
+    uint8_t playing;
+    uint32_t phase;                     /* the top 7 bits are the pattern bit being played */
+
+    atomic_uint_least64_t lastNs;
+    atomic_uint_least64_t maxNs;
+    atomic_uint_least64_t totalNs;
+    atomic_uint_least64_t changes;
+} _audio;
+
+static void _fill(void* buffer, unsigned int frames);
+static int _silent_pattern(const uint8_t* pattern);
+static void _measure(uint64_t changedAt, unsigned int frames);
+
+int chip8AudioStart(Chip8Runner* runner) {
+    if (!runner || _audio.started) {
+        return 0;
+    }
+    InitAudioDevice();
+    if (!IsAudioDeviceReady()) {
+        return 0;
+    }
+    /* one bit of the pattern is 1/128 of the phase, so a step is bits per sample << 25 */
+    for (int pitch = 0; pitch < 256; pitch++) {
+        double rate = C8_AUDIO_XO_RATE * pow(2.0, (pitch - 64) / 48.0);
+        _audio.steps[pitch] = (uint32_t) (rate / C8_AUDIO_SAMPLE_RATE * (1u << 25));
+    }
+    _audio.beepStep = (uint32_t) ((double) C8_AUDIO_BEEP_HZ / C8_AUDIO_SAMPLE_RATE * 4294967296.0);
+    memset(_audio.beep, 0xFF, sizeof(_audio.beep) / 2);
+    memset(_audio.beep + sizeof(_audio.beep) / 2, 0x00, sizeof(_audio.beep) / 2);
+    memset(&_audio.sound, 0, sizeof(_audio.sound));
+    _audio.playing = 0;
+    _audio.phase = 0;
+    atomic_store(&_audio.lastNs, 0);
+    atomic_store(&_audio.maxNs, 0);
+    atomic_store(&_audio.totalNs, 0);
+    atomic_store(&_audio.changes, 0);
+    _audio.runner = runner;
+
+    SetAudioStreamBufferSizeDefault(C8_AUDIO_BUFFER_FRAMES);
+    _audio.stream = LoadAudioStream(C8_AUDIO_SAMPLE_RATE, 16, 1);
+    SetAudioStreamCallback(_audio.stream, _fill);
+    PlayAudioStream(_audio.stream);
+    _audio.started = 1;
+    return 1;
+}
+
+void chip8AudioStop(void) {
+    if (!_audio.started) {
+        return;
+    }
+    StopAudioStream(_audio.stream);
+    UnloadAudioStream(_audio.stream);
+    CloseAudioDevice();
+    _audio.runner = NULL;
+    _audio.started = 0;
+}
+
+void chip8AudioGetLatency(Chip8AudioLatency* latency) {
+    if (!latency) {
+        return;
+    }
+    uint64_t changes = atomic_load_explicit(&_audio.changes, memory_order_relaxed);
+    uint64_t total = atomic_load_explicit(&_audio.totalNs, memory_order_relaxed);
+    latency->lastMs = atomic_load_explicit(&_audio.lastNs, memory_order_relaxed) / 1e6;
+    latency->maxMs = atomic_load_explicit(&_audio.maxNs, memory_order_relaxed) / 1e6;
+    latency->averageMs = changes ? total / 1e6 / changes : 0;
+    latency->changes = changes;
+}
+
+// ----------------------------------------------------------------------
+
+/**
+ * raylib's callback, on its audio thread. The state is read once per
+ * buffer, so a change gets heard at most a buffer (plus the runner's
+ * slice) after the VM made it.
+ */
+static void _fill(void* buffer, unsigned int frames) {
+    int16_t* out = buffer;
+    Chip8RunnerSound s;
+    if (chip8RunnerGetSound(_audio.runner, &s)) {
+        _audio.sound = s;
+    }
+    const Chip8RunnerSound* sound = &_audio.sound;
+    if (sound->on != _audio.playing) {
+        _measure(sound->changedAt, frames);
+        _audio.playing = sound->on;
+        _audio.phase = 0;
+    }
+    if (!sound->on) {
+        memset(out, 0, frames * sizeof(int16_t));
+        return;
+    }
+
+    /* an XO-CHIP ROM that never loaded a pattern still gets its beep */
+    const uint8_t* pattern = _audio.beep;
+    uint32_t step = _audio.beepStep;
+    if (sound->patterned && !_silent_pattern(sound->pattern)) {
+        pattern = sound->pattern;
+        step = _audio.steps[sound->pitch];
+    }
+    uint32_t phase = _audio.phase;
+    for (unsigned int i = 0; i < frames; i++) {
+        unsigned bit = phase >> 25;
+        out[i] = (pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? C8_AUDIO_VOLUME : -C8_AUDIO_VOLUME;
+        phase += step;
+    }
+    _audio.phase = phase;
+}
+
+static int _silent_pattern(const uint8_t* pattern) {
+    for (int i = 0; i < C8_AUDIO_PATTERN_BITS / 8; i++) {
+        if (pattern[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* the buffer being filled plays once the one queued ahead of it is done */
+static void _measure(uint64_t changedAt, unsigned int frames) {
+    uint64_t now = chip8RunnerTime();
+    uint64_t ns = (now > changedAt ? now - changedAt : 0)
+        + (uint64_t) frames * 1000000000u / C8_AUDIO_SAMPLE_RATE;
+    atomic_store_explicit(&_audio.lastNs, ns, memory_order_relaxed);
+    if (ns > atomic_load_explicit(&_audio.maxNs, memory_order_relaxed)) {
+        atomic_store_explicit(&_audio.maxNs, ns, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&_audio.totalNs, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&_audio.changes, 1, memory_order_relaxed);
+}
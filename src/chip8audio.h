@@ -0,0 +1,39 @@
+#ifndef CHIP8AUDIO_H
+#define CHIP8AUDIO_H
+
+#include "chip8runner.h"
+
+#include <stdint.h>
+
+#define C8_AUDIO_SAMPLE_RATE    44100
+#define C8_AUDIO_BUFFER_FRAMES  128     /* per callback, ~2.9ms at 44.1khz */
+#define C8_AUDIO_BEEP_HZ        440     /* the plain CHIP-8 beep */
+#define C8_AUDIO_VOLUME         4000    /* of 32767 */
+
+/**
+ * Sound for the GUI, on raylib's audio thread. The stream's callback reads
+ * the runner's sound state (see chip8RunnerGetSound) and makes a square
+ * wave, or XO-CHIP's pattern at its pitch, out of tables built when it's
+ * started: it never allocates or locks. Needs a window (raylib's audio
+ * device) and one runner at a time.
+ */
+int chip8AudioStart(Chip8Runner* runner);
+/* call it before the runner is destroyed */
+void chip8AudioStop(void);
+
+/**
+ * How long the speaker took to follow the sound timer: from the runner
+ * publishing a change to the first sample of it coming out of the stream,
+ * counting the buffer queued ahead of it (not the sound card's own).
+ */
+typedef struct Chip8AudioLatency {
+    double lastMs;
+    double averageMs;
+    double maxMs;
+    uint64_t changes;               /* how many changes were measured, 0 means none yet */
+} Chip8AudioLatency;
+
+/* can be called from any thread */
+void chip8AudioGetLatency(Chip8AudioLatency* latency);
+
+#endif /* CHIP8AUDIO_H */
@@ -0,0 +1,630 @@
+#include "chip8batch.h"
+#include "chip8ops.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * Lane arrays. The loops over them are written without branches so -O3
+ * vectorizes them (SSE2 by default, AVX2 with -mavx2 or -march=native):
+ * lanes are picked with all-ones/all-zeros masks, and C8_SEL blends.
+ */
+#define C8_SEL(m, a, b)     (((a) & (m)) | ((b) & ~(m)))
+struct Chip8Batch {
+    int lanes;
+    Chip8* vms;
+    uint8_t* V[C8_REGISTER_AMOUNT];
+    uint16_t* I;
+    uint16_t* pc;
+    uint16_t* opcode;
+    uint8_t* delayTimer;
+    uint8_t* soundTimer;
+    uint16_t* tickCountdown;
+    uint16_t* cyclesPerTick;
+    uint16_t* keys;         /* key[] as a mask, bit n = key n */
+    uint32_t* left;         /* cycles the lane still has to run in this call */
+    uint16_t* live;         /* 0xFFFF while left isn't 0 */
+    uint64_t* target;       /* the lane's cycles count once left gets to 0 */
+    uint16_t* writeLo;      /* [writeLo, writeHi) covers every byte the lane stored to */
+    uint16_t* writeHi;
+    uint8_t* grp;           /* lanes taking part in the current step */
+    uint16_t* grp16;        /* the same, as wide as the 16-bit arrays */
+    uint8_t* cand;          /* lanes sitting on the current pc */
+    uint8_t* tmp;
+    void* block;            /* everything above comes out of this one allocation */
+    unsigned quirks;        /* lane 0's C8_QUIRK_* flags, every lane is taken to run the same ones */
+    uint64_t lockstepCycles;
+    uint64_t scalarCycles;
+};
+
+/**
+ * How the instructions run for a group of lanes: SIMD ones as a loop the
+ * compiler vectorizes, PER_LANE ones lane by lane on the lane arrays (they
+ * touch the lanes' own memory, stack or screen), and the rest through
+ * chip8RunCycles.
+ */
+enum {
+    C8_BATCH_SCALAR,
+    C8_BATCH_SIMD,
+    C8_BATCH_PER_LANE
+};
+
+static void _load_lane(Chip8Batch* b, int lane);
+static void _store_lane(Chip8Batch* b, int lane);
+static void _scalar_step(Chip8Batch* b, int lane);
+static void _burn(Chip8Batch* b, int lane);
+static int _lane_wide(const Chip8Batch* b, uint8_t op);
+static int _per_lane_op(Chip8Batch* b, const Chip8Ins* ins);
+static void _advance(int n, const uint16_t* restrict grp16, uint16_t opcode,
+    uint32_t* restrict left, uint16_t* restrict live, uint16_t* restrict opcodes,
+    uint16_t* restrict tickCountdown, const uint16_t* restrict cyclesPerTick,
+    uint8_t* restrict delayTimer, uint8_t* restrict soundTimer);
+static void _lane_wide_op(Chip8Batch* b, const Chip8Ins* ins);
+
+Chip8Batch* chip8BatchCreate(int lanes) {
+    if (lanes <= 0) {
+        return NULL;
+    }
+    Chip8Batch* b = calloc(1, sizeof(Chip8Batch));
+    if (!b) {
+        return NULL;
+    }
+    size_t n = (size_t) lanes;
+    size_t per = C8_REGISTER_AMOUNT * sizeof(uint8_t)
+        + 10 * sizeof(uint16_t)
+        + 5 * sizeof(uint8_t)
+        + sizeof(uint32_t)
+        + sizeof(uint64_t);
+    b->vms = calloc(n, sizeof(Chip8));
+    b->block = calloc(n, per);
+    if (!b->vms || !b->block) {
+        free(b->vms);
+        free(b->block);
+        free(b);
+        return NULL;
+    }
+    b->lanes = lanes;
+
+    /* widest first, so every array stays aligned to its element size */
+    uint8_t* p = b->block;
+    b->target = (uint64_t*) p;          p += n * sizeof(uint64_t);
+    b->left = (uint32_t*) p;            p += n * sizeof(uint32_t);
+    b->I = (uint16_t*) p;               p += n * sizeof(uint16_t);
+    b->pc = (uint16_t*) p;              p += n * sizeof(uint16_t);
+    b->opcode = (uint16_t*) p;          p += n * sizeof(uint16_t);
+    b->tickCountdown = (uint16_t*) p;   p += n * sizeof(uint16_t);
+    b->cyclesPerTick = (uint16_t*) p;   p += n * sizeof(uint16_t);
+    b->keys = (uint16_t*) p;            p += n * sizeof(uint16_t);
+    b->writeLo = (uint16_t*) p;         p += n * sizeof(uint16_t);
+    b->writeHi = (uint16_t*) p;         p += n * sizeof(uint16_t);
+    b->live = (uint16_t*) p;            p += n * sizeof(uint16_t);
+    b->grp16 = (uint16_t*) p;           p += n * sizeof(uint16_t);
+    for (int r = 0; r < C8_REGISTER_AMOUNT; r++) {
+        b->V[r] = p;                    p += n;
+    }
+    b->delayTimer = p;                  p += n;
+    b->soundTimer = p;                  p += n;
+    b->grp = p;                         p += n;
+    b->cand = p;                        p += n;
+    b->tmp = p;
+
+    for (int i = 0; i < lanes; i++) {
+        chip8Init(&b->vms[i]);
+    }
+    return b;
+}
+
+void chip8BatchDestroy(Chip8Batch* batch) {
+    if (!batch) {
+        return;
+    }
+    for (int i = 0; i < batch->lanes; i++) {
+        chip8Destroy(&batch->vms[i]);
+    }
+    free(batch->vms);
+    free(batch->block);
+    free(batch);
+}
+
+int chip8BatchLoad(Chip8Batch* batch, const uint8_t* rom, size_t size) {
+    if (!batch) {
+        return 0;
+    }
+    for (int i = 0; i < batch->lanes; i++) {
+        if (!chip8LoadFromArray(&batch->vms[i], rom, size)) {
+            return 0;
+        }
+        /* nothing stored yet, the lanes' code is the ROM's */
+        batch->writeLo[i] = UINT16_MAX;
+        batch->writeHi[i] = 0;
+    }
+    return 1;
+}
+
+int chip8BatchLaneCount(const Chip8Batch* batch) {
+    return batch ? batch->lanes : 0;
+}
+
+Chip8* chip8BatchGetVM(Chip8Batch* batch, int lane) {
+    if (!batch || lane < 0 || lane >= batch->lanes) {
+        return NULL;
+    }
+    return &batch->vms[lane];
+}
+
+void chip8BatchGetStats(const Chip8Batch* batch, uint64_t* lockstep, uint64_t* scalar) {
+    if (!batch) {
+        return;
+    }
+    if (lockstep) *lockstep = batch->lockstepCycles;
+    if (scalar) *scalar = batch->scalarCycles;
+}
+
+/**
+ * Every step picks the lowest pc any lane still running is at (so lanes
+ * that fell behind get to catch up and merge back) and runs that
+ * instruction for all the lanes on it.
+ */
+uint64_t chip8BatchRun(Chip8Batch* batch, uint32_t cycles) {
+    if (!batch) {
+        return 0;
+    }
+    Chip8Batch* b = batch;
+    int n = b->lanes;
+    uint64_t before = b->lockstepCycles + b->scalarCycles;
+    b->quirks = chip8QuirksFlags(b->vms[0].quirks);
+    for (int i = 0; i < n; i++) {
+        _load_lane(b, i);
+        b->left[i] = b->vms[i].running ? cycles : 0;
+        b->target[i] = b->vms[i].cycles + b->left[i];
+        if (b->vms[i].waitingForKey) {
+            /* the burn ticked the VM's timers, the lane needs them too */
+            _burn(b, i);
+            _load_lane(b, i);
+        }
+        b->live[i] = b->left[i] ? 0xFFFF : 0;
+    }
+
+    /**
+     * The arrays go through locals: stores through the uint8_t ones could
+     * alias b itself, and the compiler wouldn't vectorize the loops.
+     */
+    uint32_t* left = b->left;
+    uint16_t* live = b->live;
+    uint16_t* pcs = b->pc;
+    uint16_t* writeLo = b->writeLo;
+    uint16_t* writeHi = b->writeHi;
+    uint16_t* tickCountdown = b->tickCountdown;
+    const uint16_t* cyclesPerTick = b->cyclesPerTick;
+    uint16_t* opcodes = b->opcode;
+    uint8_t* delayTimer = b->delayTimer;
+    uint8_t* soundTimer = b->soundTimer;
+    uint8_t* cand = b->cand;
+    uint8_t* grp = b->grp;
+    uint16_t* grp16 = b->grp16;
+
+    for (;;) {
+        uint16_t P = UINT16_MAX;
+        for (int i = 0; i < n; i++) {
+            uint16_t pc = pcs[i] | ~live[i];
+            P = pc < P ? pc : P;
+        }
+        if (P == UINT16_MAX) {
+            break;
+        }
+
+        /* cand: every lane on P. grp: the ones that can't have stored over it */
+        int cands = 0;
+        int shared = 0;
+        for (int i = 0; i < n; i++) {
+            uint16_t on = live[i] & -(uint16_t) (pcs[i] == P);
+            uint16_t clean = -(uint16_t) ((P + 2 <= writeLo[i]) | (P >= writeHi[i]));
+            cand[i] = (uint8_t) on;
+            grp[i] = (uint8_t) (on & clean);
+            cands += on & 1;
+            shared += on & clean & 1;
+        }
+        int leader = 0;
+        while (!cand[leader]) {
+            leader++;
+        }
+
+        const Chip8Ins* ins = NULL;
+        if (!(P & 1) && P < C8_MEMORY_SIZE - 1) {
+            ins = chip8DecodeAt(&b->vms[leader], P);
+        }
+        int kind = ins ? _lane_wide(b, ins->op) : C8_BATCH_SCALAR;
+        if (kind == C8_BATCH_SCALAR || cands == 1) {
+            /* each lane runs whatever its own memory holds there */
+            for (int i = 0; i < n; i++) {
+                if (cand[i]) {
+                    _scalar_step(b, i);
+                }
+            }
+            continue;
+        }
+
+        /**
+         * Lanes only share code while none of them stored over it. The ones
+         * that did get their bytes compared with the leader's, one by one.
+         */
+        if (shared < cands) {
+            const uint8_t* code = &b->vms[leader].memory[P];
+            int leaderClean = grp[leader] != 0;
+            for (int i = 0; i < n; i++) {
+                if (!cand[i] || (leaderClean && grp[i])) {
+                    continue;
+                }
+                const uint8_t* mine = &b->vms[i].memory[P];
+                grp[i] = (mine[0] == code[0] && mine[1] == code[1]) ? 0xFF : 0;
+            }
+        }
+        shared = 0;
+        for (int i = 0; i < n; i++) {
+            grp16[i] = (uint16_t) (int8_t) grp[i];
+            shared += grp[i] & 1;
+        }
+
+        Chip8Ins op = *ins;
+        int stopped = 0;
+        if (kind == C8_BATCH_SIMD) {
+            _lane_wide_op(b, &op);
+        } else {
+            stopped = _per_lane_op(b, &op);
+        }
+
+        _advance(n, grp16, op.opcode, left, live, opcodes, tickCountdown, cyclesPerTick, delayTimer, soundTimer);
+        b->lockstepCycles += shared;
+
+        /* lanes that hit a stack error are done, the same as in the interpreter */
+        for (int i = 0; stopped && i < n; i++) {
+            if (grp[i] && !b->vms[i].running) {
+                b->target[i] -= left[i];
+                left[i] = 0;
+                live[i] = 0;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        _store_lane(b, i);
+        b->vms[i].cycles = b->target[i];
+    }
+    return b->lockstepCycles + b->scalarCycles - before;
+}
+
+// ----------------------------------------------------------------------
+
+/* VM -> lane arrays */
+static void _load_lane(Chip8Batch* b, int lane) {
+    const Chip8* vm = &b->vms[lane];
+    for (int r = 0; r < C8_REGISTER_AMOUNT; r++) {
+        b->V[r][lane] = vm->V[r];
+    }
+    b->I[lane] = vm->I;
+    b->pc[lane] = vm->pc;
+    b->opcode[lane] = vm->opcode;
+    b->delayTimer[lane] = vm->delayTimer;
+    b->soundTimer[lane] = vm->soundTimer;
+    b->tickCountdown[lane] = vm->tickCountdown;
+    b->cyclesPerTick[lane] = vm->cyclesPerTick;
+    uint16_t keys = 0;
+    for (int k = 0; k < C8_KEYS_AMOUNT; k++) {
+        keys |= (uint16_t) (vm->key[k] ? 1 : 0) << k;
+    }
+    b->keys[lane] = keys;
+}
+
+/* lane arrays -> VM */
+static void _store_lane(Chip8Batch* b, int lane) {
+    Chip8* vm = &b->vms[lane];
+    for (int r = 0; r < C8_REGISTER_AMOUNT; r++) {
+        vm->V[r] = b->V[r][lane];
+    }
+    vm->I = b->I[lane];
+    vm->pc = b->pc[lane];
+    vm->opcode = b->opcode[lane];
+    vm->delayTimer = b->delayTimer[lane];
+    vm->soundTimer = b->soundTimer[lane];
+    vm->tickCountdown = b->tickCountdown[lane];
+}
+
+/* one instruction of one lane, on its own VM */
+static void _scalar_step(Chip8Batch* b, int lane) {
+    Chip8* vm = &b->vms[lane];
+    _store_lane(b, lane);
+
+    uint16_t I = vm->I;
+    uint32_t ran = (uint32_t) chip8RunFor(vm, 1);
+    b->left[lane] -= ran;
+    b->scalarCycles += ran;
+
+    /* Fx33, Fx55 and XO-CHIP's 5xy2 are the only stores, remember where they went */
+    uint16_t len = 0;
+    if ((vm->opcode & 0xF0FF) == 0xF033) {
+        len = 3;
+    } else if ((vm->opcode & 0xF0FF) == 0xF055) {
+        len = ((vm->opcode >> 8) & 0xF) + 1;
+    } else if ((vm->opcode & 0xF00F) == 0x5002 && (b->quirks & C8_QUIRK_XOCHIP_OPS)) {
+        int x = (vm->opcode >> 8) & 0xF;
+        int y = (vm->opcode >> 4) & 0xF;
+        len = (uint16_t) ((x > y ? x - y : y - x) + 1);
+    }
+    if (len && vm->running) {
+        uint32_t past = (uint32_t) I + len;
+        uint16_t end = past > UINT16_MAX ? UINT16_MAX : (uint16_t) past;
+        b->writeLo[lane] = I < b->writeLo[lane] ? I : b->writeLo[lane];
+        b->writeHi[lane] = end > b->writeHi[lane] ? end : b->writeHi[lane];
+    }
+
+    if (!vm->running) {
+        b->target[lane] -= b->left[lane];
+        b->left[lane] = 0;
+    } else if (vm->waitingForKey) {
+        _burn(b, lane);
+    }
+    _load_lane(b, lane);
+    b->live[lane] = b->left[lane] ? 0xFFFF : 0;
+}
+
+/**
+ * A lane waiting for a key can't get one before the call is over, so the
+ * rest of its budget goes by right away (the timers still tick).
+ */
+static void _burn(Chip8Batch* b, int lane) {
+    Chip8* vm = &b->vms[lane];
+    uint32_t ran = (uint32_t) chip8RunFor(vm, b->left[lane]);
+    b->left[lane] -= ran;
+    b->scalarCycles += ran;
+    b->target[lane] -= b->left[lane];
+    b->left[lane] = 0;
+}
+
+/* one cycle for everyone in the group, and the timer tick if it's due */
+static void _advance(int n, const uint16_t* restrict grp16, uint16_t opcode,
+    uint32_t* restrict left, uint16_t* restrict live, uint16_t* restrict opcodes,
+    uint16_t* restrict tickCountdown, const uint16_t* restrict cyclesPerTick,
+    uint8_t* restrict delayTimer, uint8_t* restrict soundTimer) {
+    for (int i = 0; i < n; i++) {
+        uint16_t g = grp16[i];
+        uint16_t one = g & 1;
+        uint16_t tick = tickCountdown[i] - one;
+        uint16_t due = g & -(uint16_t) (tick == 0);
+        uint8_t due8 = (uint8_t) due & 1;
+        delayTimer[i] -= due8 & -(uint8_t) (delayTimer[i] != 0);
+        soundTimer[i] -= due8 & -(uint8_t) (soundTimer[i] != 0);
+        tickCountdown[i] = C8_SEL(due, cyclesPerTick[i], tick);
+        opcodes[i] = C8_SEL(g, opcode, opcodes[i]);
+        left[i] -= one;
+        live[i] = -(uint16_t) (left[i] != 0);
+    }
+}
+
+static int _lane_wide(const Chip8Batch* b, uint8_t op) {
+#ifdef C8_PROFILE
+    /* the profiler counts in the interpreter, so every lane goes through it */
+    (void) b;
+    (void) op;
+    return C8_BATCH_SCALAR;
+#endif
+    /* the lane-wide versions are the default ones, the interpreter has the others */
+    if (chip8QuirkyOp(b->quirks, op)) {
+        return C8_BATCH_SCALAR;
+    }
+    switch (op) {
+    case C8_OP_JP:
+    case C8_OP_SE_BYTE:     case C8_OP_SNE_BYTE:
+    case C8_OP_SE_REG:      case C8_OP_SNE_REG:
+    case C8_OP_LD_BYTE:     case C8_OP_ADD_BYTE:
+    case C8_OP_LD_REG:      case C8_OP_OR:
+    case C8_OP_AND:         case C8_OP_XOR:
+    case C8_OP_ADD_REG:     case C8_OP_SUB:
+    case C8_OP_SHR:         case C8_OP_SUBN:
+    case C8_OP_SHL:         case C8_OP_LD_I:
+    case C8_OP_SKP:         case C8_OP_SKNP:
+    case C8_OP_LD_VX_DT:    case C8_OP_LD_DT_VX:
+    case C8_OP_LD_ST_VX:    case C8_OP_ADD_I_VX:
+    case C8_OP_LD_F_VX:
+        return C8_BATCH_SIMD;
+    case C8_OP_CALL:        case C8_OP_RET:
+    case C8_OP_DRW:         case C8_OP_RND:
+    case C8_OP_LD_VX_MEM:
+        return C8_BATCH_PER_LANE;
+    default:
+        return C8_BATCH_SCALAR;
+    }
+}
+
+/**
+ * Same as the interpreter's handlers for these, minus the round trip
+ * through the Chip8. Returns 1 when a lane stopped on a stack error.
+ */
+static int _per_lane_op(Chip8Batch* b, const Chip8Ins* ins) {
+    int stopped = 0;
+    uint16_t nnn = ins->opcode & 0x0FFF;
+    for (int i = 0; i < b->lanes; i++) {
+        if (!b->grp[i]) {
+            continue;
+        }
+        Chip8* vm = &b->vms[i];
+        uint16_t pc = b->pc[i];
+        switch (ins->op) {
+        case C8_OP_CALL:
+            if (vm->sp == C8_STACK_SIZE) {
+                vm->err = C8_ERR_STACK_OVERFLOW;
+                vm->running = 0;
+                stopped = 1;
+                break;
+            }
+            vm->stack[vm->sp] = pc;
+            vm->sp += 1;
+            pc = nnn;
+            break;
+        case C8_OP_RET:
+            if (vm->sp == 0) {
+                vm->err = C8_ERR_STACK_UNDERFLOW;
+                vm->running = 0;
+                stopped = 1;
+                break;
+            }
+            vm->sp -= 1;
+            pc = vm->stack[vm->sp] + 2;
+            break;
+        case C8_OP_DRW: {
+            uint8_t x = b->V[ins->x][i];
+            uint8_t y = b->V[ins->y][i];
+            uint16_t I = b->I[i];
+            uint8_t collision = 0;
+            if (x < C8_SCREEN_WIDTH) {
+                for (int yln = 0; yln < ins->n && y + yln < C8_SCREEN_HEIGHT; yln++) {
+                    uint64_t row = ((uint64_t) vm->memory[(I + yln) & (C8_MEMORY_SIZE - 1)] << (C8_SCREEN_WIDTH - 8)) >> x;
+                    collision |= (vm->gfx[0][0][y + yln] & row) != 0;
+                    vm->gfx[0][0][y + yln] ^= row;
+                }
+            }
+            b->V[0xF][i] = collision;
+            vm->drawFlag = 1;
+            pc += 2;
+            break;
+        }
+        case C8_OP_RND: {
+            b->V[ins->x][i] = chip8Random(vm) & ins->nn;
+            pc += 2;
+            break;
+        }
+        case C8_OP_LD_VX_MEM:
+            for (int r = 0; r <= ins->x; r++) {
+                b->V[r][i] = vm->memory[(b->I[i] + r) & (C8_MEMORY_SIZE - 1)];
+            }
+            b->I[i] += ins->x + 1;
+            pc += 2;
+            break;
+        default:
+            break;
+        }
+        b->pc[i] = pc & (C8_MEMORY_SIZE - 1);
+    }
+    return stopped;
+}
+
+#define C8_LANES(stmt) for (int i = 0; i < n; i++) { stmt; }
+
+/**
+ * The interpreter's handlers, a lane at a time. Like there, VF gets
+ * written before Vx, and Vx is read again afterwards (it matters when x
+ * or y is F).
+ */
+static void _lane_wide_op(Chip8Batch* b, const Chip8Ins* ins) {
+    int n = b->lanes;
+    const uint8_t* g = b->grp;
+    const uint16_t* g16 = b->grp16;
+    uint8_t* vx = b->V[ins->x];
+    uint8_t* vy = b->V[ins->y];
+    uint8_t* vf = b->V[0xF];
+    uint8_t* t = b->tmp;
+    uint16_t* pc = b->pc;
+    uint16_t* I = b->I;
+    const uint16_t* keys = b->keys;
+    uint8_t* delayTimer = b->delayTimer;
+    uint8_t* soundTimer = b->soundTimer;
+    uint8_t nn = ins->nn;
+    uint16_t nnn = ins->opcode & 0x0FFF;
+
+    switch (ins->op) {
+    case C8_OP_JP:
+        C8_LANES(pc[i] = C8_SEL(g16[i], nnn, pc[i]));
+        return;
+    case C8_OP_SE_BYTE:
+        C8_LANES(t[i] = -(uint8_t) (vx[i] == nn));
+        break;
+    case C8_OP_SNE_BYTE:
+        C8_LANES(t[i] = -(uint8_t) (vx[i] != nn));
+        break;
+    case C8_OP_SE_REG:
+        C8_LANES(t[i] = -(uint8_t) (vx[i] == vy[i]));
+        break;
+    case C8_OP_SNE_REG:
+        C8_LANES(t[i] = -(uint8_t) (vx[i] != vy[i]));
+        break;
+    case C8_OP_SKP:
+        C8_LANES(t[i] = -(uint8_t) ((vx[i] < C8_KEYS_AMOUNT) & (keys[i] >> (vx[i] & 0xF))));
+        break;
+    case C8_OP_SKNP:
+        C8_LANES(t[i] = -(uint8_t) !((vx[i] < C8_KEYS_AMOUNT) & (keys[i] >> (vx[i] & 0xF))));
+        break;
+
+    case C8_OP_LD_BYTE:
+        C8_LANES(vx[i] = C8_SEL(g[i], nn, vx[i]));
+        goto next;
+    case C8_OP_ADD_BYTE:
+        C8_LANES(vx[i] += g[i] & nn);
+        goto next;
+    case C8_OP_LD_REG:
+        C8_LANES(vx[i] = C8_SEL(g[i], vy[i], vx[i]));
+        goto next;
+    case C8_OP_OR:
+        C8_LANES(vx[i] |= g[i] & vy[i]);
+        goto next;
+    case C8_OP_AND:
+        C8_LANES(vx[i] &= vy[i] | ~g[i]);
+        goto next;
+    case C8_OP_XOR:
+        C8_LANES(vx[i] ^= g[i] & vy[i]);
+        goto next;
+    case C8_OP_ADD_REG:
+        C8_LANES(t[i] = vx[i] > UINT8_MAX - vy[i]);
+        C8_LANES(vf[i] = C8_SEL(g[i], t[i], vf[i]));
+        C8_LANES(vx[i] += g[i] & vy[i]);
+        goto next;
+    case C8_OP_SUB:
+        C8_LANES(t[i] = vx[i] > vy[i]);
+        C8_LANES(vf[i] = C8_SEL(g[i], t[i], vf[i]));
+        C8_LANES(vx[i] -= g[i] & vy[i]);
+        goto next;
+    case C8_OP_SUBN:
+        C8_LANES(t[i] = vy[i] > vx[i]);
+        C8_LANES(vf[i] = C8_SEL(g[i], t[i], vf[i]));
+        C8_LANES(vx[i] = C8_SEL(g[i], (uint8_t) (vy[i] - vx[i]), vx[i]));
+        goto next;
+    case C8_OP_SHR:
+        C8_LANES(vf[i] = C8_SEL(g[i], vx[i] & 0x1, vf[i]));
+        C8_LANES(vx[i] = C8_SEL(g[i], vx[i] >> 1, vx[i]));
+        goto next;
+    case C8_OP_SHL:
+        C8_LANES(vf[i] = C8_SEL(g[i], (vx[i] & 0x80) >> 7, vf[i]));
+        C8_LANES(vx[i] = C8_SEL(g[i], (uint8_t) (vx[i] << 1), vx[i]));
+        goto next;
+    case C8_OP_LD_I:
+        C8_LANES(I[i] = C8_SEL(g16[i], nnn, I[i]));
+        goto next;
+    case C8_OP_ADD_I_VX:
+        C8_LANES(t[i] = I[i] + vx[i] > C8_MEMORY_SIZE - 1);
+        C8_LANES(vf[i] = C8_SEL(g[i], t[i], vf[i]));
+        C8_LANES(I[i] += g16[i] & vx[i]);
+        goto next;
+    case C8_OP_LD_F_VX:
+        C8_LANES(I[i] = C8_SEL(g16[i], (uint16_t) (vx[i] * 5), I[i]));
+        goto next;
+    case C8_OP_LD_VX_DT:
+        C8_LANES(vx[i] = C8_SEL(g[i], delayTimer[i], vx[i]));
+        goto next;
+    case C8_OP_LD_DT_VX:
+        C8_LANES(delayTimer[i] = C8_SEL(g[i], vx[i], delayTimer[i]));
+        goto next;
+    case C8_OP_LD_ST_VX:
+        C8_LANES(soundTimer[i] = C8_SEL(g[i], vx[i], soundTimer[i]));
+        goto next;
+    default:
+        return;
+    }
+
+    /* the skips: t says which lanes skip. pc wraps at the end of memory, the same as in the interpreter */
+    C8_LANES(pc[i] = (pc[i] + (g16[i] & ((t[i] & 2) + 2))) & (C8_MEMORY_SIZE - 1));
+    return;
+
+next:
+    C8_LANES(pc[i] = (pc[i] + (g16[i] & 2)) & (C8_MEMORY_SIZE - 1));
+}
+
+#undef C8_LANES
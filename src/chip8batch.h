@@ -0,0 +1,43 @@
+#ifndef CHIP8BATCH_H
+#define CHIP8BATCH_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Runs many copies of the same ROM side by side (say, one per input
+ * stream). While running, registers, I, pc and the timers are kept as
+ * arrays with one slot per VM ("lane"), and every step executes one opcode
+ * for all the lanes sitting on the same pc at once, in loops the compiler
+ * turns into SIMD code. Lanes that went elsewhere just wait their turn,
+ * and the instructions without a lane-wide version (draws, calls, memory
+ * stores...) go through chip8RunCycles one lane at a time.
+ *
+ * Outside of chip8BatchRun the lanes are plain Chip8s, so keys can be
+ * pressed and state read through chip8BatchGetVM as usual. Lanes all run
+ * with lane 0's quirk profile, set the same one on every lane.
+ */
+typedef struct Chip8Batch Chip8Batch;
+
+Chip8Batch* chip8BatchCreate(int lanes);
+void chip8BatchDestroy(Chip8Batch* batch);
+
+/* loads the same ROM into every lane */
+int chip8BatchLoad(Chip8Batch* batch, const uint8_t* rom, size_t size);
+
+/**
+ * Runs every lane for up to cycles cycles, ticking each lane's timers like
+ * the headless runner does. Lanes that stop or wait for a key drop out
+ * early. Returns the cycles run, summed over all lanes.
+ */
+uint64_t chip8BatchRun(Chip8Batch* batch, uint32_t cycles);
+
+int chip8BatchLaneCount(const Chip8Batch* batch);
+Chip8* chip8BatchGetVM(Chip8Batch* batch, int lane);
+
+/* cycles so far that ran lane-wide vs. through the per-lane fallback */
+void chip8BatchGetStats(const Chip8Batch* batch, uint64_t* lockstep, uint64_t* scalar);
+
+#endif /* CHIP8BATCH_H */
@@ -1,25 +1,69 @@
 #include "raylib.h"
 #include "chip8.h"
 #include "chip8gui.h"
+#include "chip8rewind.h"
+#include "chip8movie.h"
+#include "chip8runner.h"
+#include "chip8audio.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <math.h>
 #include <signal.h>
+#include <time.h>
 
 #define MAX(a, b) ((a)>(b)? (a) : (b))
 #define MIN(a, b) ((a)<(b)? (a) : (b))
 
-// Might be useful if I ever try using raygui
-extern size_t _dump_memory_arr(const uint8_t* mem, size_t memcap, char** out);
-extern size_t _dump_stack(const uint16_t* stack, size_t stacksize, char** out);
-extern size_t _dump_regs(const uint8_t* V, size_t registerAmount, char** out);
-extern size_t _dump_keys(const uint8_t* V, size_t registerAmount, char** out);
-extern size_t _dump_internal_regs(const Chip8* c8, char** out);
+#define GUI_REWIND_KEY      KEY_BACKSPACE   /* hold to play backwards */
+#define GUI_TURBO_KEY       KEY_TAB         /* toggles running uncapped */
+#define GUI_FASTER_KEY      KEY_EQUAL
+#define GUI_SLOWER_KEY      KEY_MINUS
+#define GUI_STATS_KEY       KEY_F1          /* toggles the speed readout */
 
-static inline void _draw_screen(GameWindow* win, RenderTexture2D rTexture);
+#define GUI_CLOCK_STEP      C8_TIMER_SPEED  /* one more (or less) cycle per timer tick */
+#define GUI_PROFILE_PATH    "chip8-profile.json"    /* where 'make PROFILE=1' builds leave their counts */
+
+/* what each color (bit n = plane n) looks like */
+#define GUI_PALETTE         { BLACK, RAYWHITE, ORANGE, MAROON }
+#define GUI_COLORS          (1 << C8_PLANES)
+#define GUI_SCREEN_ROWS     (C8_PLANES * C8_ROW_WORDS * C8_HIRES_HEIGHT)
+
+/**
+ * The screen texture is the VM's gfx as is, one 64-bit word per two RGBA8
+ * texels, and this works out which bit a pixel is on the GPU. Which byte
+ * of the word a bit lands in depends on the host's byte order, so that
+ * comes in too (see _host_byte_flip). The %d are GUI_COLORS, the flip,
+ * C8_PLANES, C8_ROW_WORDS and C8_HIRES_HEIGHT.
+ */
+static const char* _screenShaderFmt =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec2 size;\n"
+    "uniform vec4 palette[%d];\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "    ivec2 px = min(ivec2(fragTexCoord * size), ivec2(size) - 1);\n"
+    "    int bit = 63 - px.x %% 64;\n"
+    "    int byteAt = %d ^ (bit / 8);\n"
+    "    int color = 0;\n"
+    "    for (int p = 0; p < %d; p++) {\n"
+    "        vec4 t = texelFetch(texture0, ivec2(byteAt / 4, (p * %d + px.x / 64) * %d + px.y), 0);\n"
+    "        uint bits = uint(t[byteAt %% 4] * 255.0 + 0.5);\n"
+    "        color |= int((bits >> uint(bit %% 8)) & 1u) << p;\n"
+    "    }\n"
+    "    finalColor = palette[color];\n"
+    "}\n";
+
+static inline void _draw_screen(GameWindow* win, RenderTexture2D errTexture);
+static inline void _upload_screen(GameWindow* win, const void* gfx, int hires);
+static inline void _load_screen_shader(GameWindow* win);
+static inline int _host_byte_flip(void);
 static inline void _window_init(GameWindow* win);
+static inline void _handle_speed_keys(GameWindow* win);
 static inline uint16_t _get_pressed_keys(void);
 
 typedef struct GameWindow {
@@ -30,7 +74,17 @@ typedef struct GameWindow {
     int integerScalingFactor;
     int gameWidth;
     int gameHeight;
-    Chip8* vm;
+    int quirks;                         /* the C8_QUIRKS_* profile the game runs with */
+    Chip8* vm;                          /* belongs to runner while the game is on */
+    Chip8Runner* runner;                /* runs vm on its own thread */
+    Chip8Rewind* rewind;                /* one snapshot per frame, NULL if it couldn't be allocated */
+    const char* moviePath;              /* record the keys into this movie, if set */
+    int vmRunning;                      /* running flag of the last frame shown */
+    int showStats;
+    Texture2D screen;                   /* the VM's gfx words, updated only when they change */
+    Shader screenShader;                /* turns screen into pixels */
+    int sizeLoc;
+    int hires;                          /* of the last frame shown */
 } GameWindow;
 
 GameWindow* guiCreateGameWindow(Chip8* chip8, const char* windowName, const char* gamePath) {
@@ -39,7 +93,9 @@ GameWindow* guiCreateGameWindow(Chip8* chip8, const char* windowName, const char
     win->gamePath = gamePath;
     win->gameWidth = C8_SCREEN_WIDTH;
     win->gameHeight = C8_SCREEN_HEIGHT;
+    win->quirks = C8_QUIRKS_DEFAULT;
     win->vm = chip8;
+    win->showStats = 1;
     chip8Init(win->vm);
     return win;
 }
@@ -48,9 +104,11 @@ void guiFreeWindow(GameWindow* win) {
     free(win);
 }
 
-void guiInitAndRun(const char* gamePath) {
+void guiInitAndRun(const char* gamePath, const char* moviePath, int quirks) {
     Chip8* vm = calloc(1 ,sizeof(Chip8));
     GameWindow* w = guiCreateGameWindow(vm, "Chip-8", gamePath);
+    w->moviePath = moviePath;
+    w->quirks = quirks;
     guiRun(w);
     guiFreeWindow(w);
     chip8Destroy(vm);
@@ -60,34 +118,75 @@ void guiInitAndRun(const char* gamePath) {
 void guiRun(GameWindow* window) {
     InitWindow(1, 1, window->windowName);
     _window_init(window);
-    RenderTexture2D actualGame = LoadRenderTexture(window->gameWidth, window->gameHeight);
+    Image blank = GenImageColor(2, GUI_SCREEN_ROWS, BLANK);
+    window->screen = LoadTextureFromImage(blank);
+    UnloadImage(blank);
+    SetTextureFilter(window->screen, TEXTURE_FILTER_POINT);
+    _load_screen_shader(window);
+
+    /* what gets shown once the VM stops. it never changes, so draw it once */
+    RenderTexture2D errorScreen = LoadRenderTexture(window->gameWidth, window->gameHeight);
+    BeginTextureMode(errorScreen);
+        ClearBackground(RAYWHITE);
+        DrawText("uh oh", 15,15,1, BLACK);
+    EndTextureMode();
     
     window->windowHeight = GetScreenHeight();
     window->windowWidth = GetScreenWidth();
 
-    float keyboardAcc = 0;
     chip8Init(window->vm);
     chip8LoadRom(window->vm, window->gamePath);
+    chip8SetQuirks(window->vm, window->quirks);
+    uint64_t seed = (uint64_t) time(NULL); /* a different game every time */
+    chip8Seed(window->vm, seed);
+    Chip8Movie* movie = window->moviePath ? chip8MovieCreate(window->vm, seed) : NULL;
+    window->rewind = chip8RewindCreate(C8_REWIND_DEFAULT_BYTES);
+    chip8RewindPush(window->rewind, window->vm);
+    _upload_screen(window, window->vm->gfx, window->vm->hires);
+    window->vmRunning = window->vm->running;
+
+    /* from here on the VM runs on its own thread, this one only handles input and drawing */
+    window->runner = chip8RunnerCreate(window->vm, movie, window->rewind);
+    if (!chip8RunnerStart(window->runner)) {
+        printf("could not start the emulation thread\n");
+    }
+    if (!chip8AudioStart(window->runner)) {
+        printf("could not open the audio device, no sound\n");
+    }
     while (!WindowShouldClose()) {
-        float delta = GetFrameTime();
-        keyboardAcc += delta;
-        if (keyboardAcc >= C8_DEFAULT_CLOCK_SPEED) {
-            uint16_t keys = _get_pressed_keys();
-            chip8PressKeys(window->vm, keys);
-            keyboardAcc = 0;
+        chip8RunnerSetKeys(window->runner, _get_pressed_keys());
+        chip8RunnerSetRewinding(window->runner, IsKeyDown(GUI_REWIND_KEY));
+        _handle_speed_keys(window);
+        const Chip8RunnerFrame* frame = NULL;
+        if (chip8RunnerAcquireFrame(window->runner, &frame)) {
+            _upload_screen(window, frame->gfx, frame->hires);
+            window->vmRunning = frame->running;
         }
-        int insNum = (int) ceilf(delta * C8_CLOCK_SPEED);
-        for (int i = 0; i < insNum; i++) {
-            chip8EmulateCycle(window->vm);
-        }
-
-        int decrNum = (int) ceilf(delta * C8_TIMER_SPEED);
-        for (int i = 0; i < decrNum; i++) {
-            chip8DecrTimers(window->vm);
+        _draw_screen(window, errorScreen);
+    }
+    chip8AudioStop();
+    chip8RunnerDestroy(window->runner);
+    window->runner = NULL;
+#ifdef C8_PROFILE
+    FILE* prof = fopen(GUI_PROFILE_PATH, "w");
+    if (prof) {
+        chip8ProfileWriteJson(window->vm, prof);
+        fclose(prof);
+        printf("execution counts written to %s\n", GUI_PROFILE_PATH);
+    }
+#endif
+    if (movie) {
+        chip8MovieFinish(movie, window->vm);
+        if (!chip8MovieSave(movie, window->moviePath)) {
+            printf("could not save the movie to %s\n", window->moviePath);
         }
-        _draw_screen(window, actualGame);
+        chip8MovieDestroy(movie);
     }
-    UnloadRenderTexture(actualGame);
+    chip8RewindDestroy(window->rewind);
+    window->rewind = NULL;
+    UnloadRenderTexture(errorScreen);
+    UnloadTexture(window->screen);
+    UnloadShader(window->screenShader);
     CloseWindow();
 }
 
@@ -122,6 +221,23 @@ static inline uint16_t _get_pressed_keys(void) {
     return mask;
 }
 
+/* clock speed, turbo and the stats readout. the runner ignores clock changes while recording */
+static inline void _handle_speed_keys(GameWindow* win) {
+    if (IsKeyPressed(GUI_TURBO_KEY)) {
+        chip8RunnerSetTurbo(win->runner, !chip8RunnerGetTurbo(win->runner));
+    }
+    if (IsKeyPressed(GUI_STATS_KEY)) {
+        win->showStats = !win->showStats;
+    }
+    uint32_t hz = chip8RunnerGetClockSpeed(win->runner);
+    if (IsKeyPressed(GUI_FASTER_KEY) || IsKeyPressed(KEY_KP_ADD)) {
+        chip8RunnerSetClockSpeed(win->runner, MIN(hz + GUI_CLOCK_STEP, C8_MAX_CLOCK_SPEED));
+    }
+    if (IsKeyPressed(GUI_SLOWER_KEY) || IsKeyPressed(KEY_KP_SUBTRACT)) {
+        chip8RunnerSetClockSpeed(win->runner, MAX(hz - GUI_CLOCK_STEP, C8_MIN_CLOCK_SPEED));
+    }
+}
+
 static inline void _window_init(GameWindow* win) {
     SetWindowState(FLAG_WINDOW_RESIZABLE | FLAG_VSYNC_HINT);
 
@@ -141,34 +257,71 @@ static inline void _window_init(GameWindow* win) {
     );
 }
 
-static inline void _draw_screen(GameWindow* win, RenderTexture2D rTexture) {
+static inline void _load_screen_shader(GameWindow* win) {
+    char code[1024];
+    snprintf(code, sizeof(code), _screenShaderFmt, GUI_COLORS, _host_byte_flip(), C8_PLANES, C8_ROW_WORDS, C8_HIRES_HEIGHT);
+    win->screenShader = LoadShaderFromMemory(NULL, code);
+    win->sizeLoc = GetShaderLocation(win->screenShader, "size");
+    Color palette[GUI_COLORS] = GUI_PALETTE;
+    float colors[GUI_COLORS * 4];
+    for (int i = 0; i < GUI_COLORS; i++) {
+        colors[4 * i + 0] = palette[i].r / 255.0f;
+        colors[4 * i + 1] = palette[i].g / 255.0f;
+        colors[4 * i + 2] = palette[i].b / 255.0f;
+        colors[4 * i + 3] = palette[i].a / 255.0f;
+    }
+    SetShaderValueV(win->screenShader, GetShaderLocation(win->screenShader, "palette"),
+            colors, SHADER_UNIFORM_VEC4, GUI_COLORS);
+    win->hires = -1;
+}
+
+/**
+ * XORed with a byte's place in a word (0 is the low byte), gives where it
+ * sits in memory: 0 on little endian hosts, 7 on big endian ones.
+ */
+static inline int _host_byte_flip(void) {
+    const uint64_t one = 1;
+    return *(const uint8_t*) &one ? 0 : 7;
+}
+
+/* the words go up untouched, the shader does the unpacking */
+static inline void _upload_screen(GameWindow* win, const void* gfx, int hires) {
+    UpdateTexture(win->screen, gfx);
+    if (hires != win->hires) {
+        float size[2] = { C8_SCREEN_WIDTH, C8_SCREEN_HEIGHT };
+        if (hires) {
+            size[0] = C8_HIRES_WIDTH;
+            size[1] = C8_HIRES_HEIGHT;
+        }
+        SetShaderValue(win->screenShader, win->sizeLoc, size, SHADER_UNIFORM_VEC2);
+        win->hires = hires;
+    }
+}
+
+static inline void _draw_screen(GameWindow* win, RenderTexture2D errTexture) {
     if (IsWindowResized()) {
         win->windowHeight = GetScreenHeight();
         win->windowWidth = GetScreenWidth();
         win->integerScalingFactor = MIN(win->windowHeight / win->gameHeight, win->windowWidth / win->gameWidth);
     }
 
-    BeginTextureMode(rTexture);
-        ClearBackground(BLACK);
-        if (win->vm->running) {
-            for (int i = 0; i < win->gameHeight; i++) {
-                for (int j = 0; j < win->gameWidth; j++) {
-                    DrawRectangle(j, i, 1, 1, win->vm->gfx[i * win->gameWidth + j] ? RAYWHITE : BLACK);
-                }   
-            }
-        } else {
-            DrawRectangle(0, 0, win->gameWidth, win->gameHeight, RAYWHITE);
-            DrawText("uh oh", 15,15,1, BLACK);
-        }
-    EndTextureMode();
+    Texture2D tex = win->screen;
+    float srcHeight = tex.height;
+    if (!win->vmRunning) {
+        // NOTE: OpenGL's (0,0) point is at the bottom left of the screen (I didn't know that),
+        // which explains why the height's sign has to be flipped for render textures
+        tex = errTexture.texture;
+        srcHeight = -tex.height;
+    }
 
     BeginDrawing();
         ClearBackground(BLACK);
-        // NOTE: OpenGL's (0,0) point is at the bottom left of the screen (I didn't know that),
-        // which explains why the height's sign has to be flipped
+        if (win->vmRunning) {
+            BeginShaderMode(win->screenShader);
+        }
         DrawTexturePro(
-            rTexture.texture,
-            (Rectangle){0, 0, rTexture.texture.width, -rTexture.texture.height},
+            tex,
+            (Rectangle){0, 0, tex.width, srcHeight},
             (Rectangle){
                 (win->windowWidth - (win->gameWidth * win->integerScalingFactor)) / 2,
                 (win->windowHeight - (win->gameHeight * win->integerScalingFactor)) / 2,
@@ -179,5 +332,18 @@ static inline void _draw_screen(GameWindow* win, RenderTexture2D rTexture) {
             0,
             WHITE
         );
+        if (win->vmRunning) {
+            EndShaderMode();
+        }
+        if (win->showStats) {
+            Chip8AudioLatency latency;
+            chip8AudioGetLatency(&latency);
+            DrawText(TextFormat("%u hz%s  %llu ips  audio %.1f ms (max %.1f)",
+                    chip8RunnerGetClockSpeed(win->runner),
+                    chip8RunnerGetTurbo(win->runner) ? " turbo" : "",
+                    (unsigned long long) chip8RunnerGetIps(win->runner),
+                    latency.lastMs, latency.maxMs),
+                4, 4, 10, GREEN);
+        }
     EndDrawing();
 }
\ No newline at end of file
@@ -8,7 +8,11 @@ typedef struct GameWindow GameWindow;
 GameWindow* guiCreateGameWindow(Chip8* chip8, const char* windowName, const char* gamePath);
 void guiFreeWindow(GameWindow* win);
 
-void guiInitAndRun(const char* gamePath);
+/**
+ * moviePath may be NULL, otherwise the session's keys get recorded there.
+ * quirks is a C8_QUIRKS_* profile.
+ */
+void guiInitAndRun(const char* gamePath, const char* moviePath, int quirks);
 void guiRun(GameWindow* window);
 
 #endif /* CHIP8GUI_H */
\ No newline at end of file
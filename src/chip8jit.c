@@ -0,0 +1,775 @@
+#include "chip8jit.h"
+#include "chip8ops.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* profiling and tracing builds see every instruction in the interpreter, so they go without */
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(C8_PROFILE) && !defined(C8_TRACE)
+#define C8_JIT_SUPPORTED
+#endif
+
+#ifdef C8_JIT_SUPPORTED
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define C8_JIT_CODE_SIZE        (1 << 20)
+#define C8_JIT_MAX_BLOCK        64      /* guest instructions per block */
+#define C8_JIT_MAX_INS_BYTES    160     /* upper bound of what one instruction (and its budget exit) emits */
+#define C8_JIT_MAX_END_BYTES    256     /* and of what a block's end (exits, handler call) does */
+
+/* stack the generated code keeps below what it pushed: rsp stays 16-aligned for calls (and Windows' shadow space) */
+#ifdef _WIN32
+#define C8_JIT_FRAME            40
+#else
+#define C8_JIT_FRAME            8
+#endif
+
+/* x86-64 registers used by the generated code */
+#define X_EAX   0
+#define X_ECX   1
+#define X_EDX   2
+#define X_ESI   6
+
+#define OFF_V(x)        ((int32_t) (offsetof(Chip8, V) + (x)))
+#define OFF_I           ((int32_t) offsetof(Chip8, I))
+#define OFF_PC          ((int32_t) offsetof(Chip8, pc))
+#define OFF_OPCODE      ((int32_t) offsetof(Chip8, opcode))
+#define OFF_DT          ((int32_t) offsetof(Chip8, delayTimer))
+#define OFF_ST          ((int32_t) offsetof(Chip8, soundTimer))
+#define OFF_SP          ((int32_t) offsetof(Chip8, sp))
+#define OFF_STACK       ((int32_t) offsetof(Chip8, stack))
+#define OFF_INS(addr)   ((int32_t) (offsetof(Chip8, decoded) + ((addr) >> 1) * sizeof(Chip8Ins)))
+#define OFF_RUNNING     ((int32_t) offsetof(Chip8, running))
+#define OFF_WAITING     ((int32_t) offsetof(Chip8, waitingForKey))
+#define OFF_CODE_WRITES ((int32_t) offsetof(Chip8, codeWrites))
+#define OFF_KEY         ((int32_t) offsetof(Chip8, key))
+
+/**
+ * The way into generated code, from the start of the buffer: jumps to a
+ * block, which runs at most budget (>= 1) instructions, going on from
+ * block to block, and returns how much of the budget is left.
+ */
+typedef uint32_t (*Chip8JitEntry)(Chip8*, uint32_t budget, const uint8_t* block);
+
+typedef struct Chip8JitBlock {
+    const uint8_t* code;    /* NULL when there's nothing compiled here */
+    uint16_t count;         /* guest instructions the block runs. 0 = nothing compiled here */
+    uint16_t interp;        /* when count is 0, how many the interpreter runs before looking for a block again */
+    uint8_t compiled;
+} Chip8JitBlock;
+
+/* blocks find the next one as blocks[pc >> 1] with pc * 8 */
+_Static_assert(sizeof(Chip8JitBlock) == 16, "Chip8JitBlock isn't 16 bytes anymore, fix _emit_exit");
+
+struct Chip8Jit {
+    uint8_t* code;
+    size_t used;
+    size_t entrySize;       /* the entry at the start of code, which flushes keep */
+    Chip8JitEntry enter;
+    uint32_t codeWrites;    /* the VM's codeWrites when the blocks were compiled */
+    uint8_t quirks;         /* and its quirk profile */
+    uint8_t exitEvents;     /* C8_YIELD_DRAW when generated code left after drawing */
+    Chip8JitBlock blocks[C8_DECODED_AMOUNT];
+};
+
+enum {
+    JIT_NOT_COVERED,        /* not translated, the block ends with a call to its handler */
+    JIT_CONTINUE,
+    JIT_END                 /* control flow, the instruction already wrote pc */
+};
+
+static void* _alloc_exec(size_t size);
+static void _free_exec(void* mem, size_t size);
+static int _protect_exec(void* mem, size_t size, int writable);
+static int _compile_entry(Chip8Jit* jit);
+static void _compile(Chip8Jit* jit, Chip8* vm, uint16_t pc);
+static void _emit_block(Chip8Jit* jit, Chip8* vm, uint16_t pc);
+static void _drop_stale_blocks(Chip8Jit* jit, const Chip8* vm);
+static int _emit_ins(Chip8Jit* jit, const Chip8Ins* ins, uint16_t addr, unsigned quirks, size_t* slow);
+
+Chip8Jit* chip8JitCreate(void) {
+    Chip8Jit* jit = calloc(1, sizeof(Chip8Jit));
+    if (!jit) {
+        return NULL;
+    }
+    jit->code = _alloc_exec(C8_JIT_CODE_SIZE);
+    if (!jit->code) {
+        free(jit);
+        return NULL;
+    }
+    if (!_compile_entry(jit)) {
+        chip8JitDestroy(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+void chip8JitDestroy(Chip8Jit* jit) {
+    if (jit) {
+        _free_exec(jit->code, C8_JIT_CODE_SIZE);
+        free(jit);
+    }
+}
+
+void chip8JitFlush(Chip8Jit* jit) {
+    if (!jit) {
+        return;
+    }
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    jit->used = jit->entrySize;
+}
+
+int chip8JitRun(Chip8Jit* jit, Chip8* chip8, uint32_t maxCycles, uint32_t* ran) {
+    if (!jit || !chip8) {
+        return 0;
+    }
+    uint32_t done = 0;
+    int events = 0;
+    while (done < maxCycles && !events) {
+        uint16_t pc = chip8->pc;
+        uint32_t n = 0;
+        if (!chip8->running || chip8->waitingForKey || (pc & 1) || pc >= C8_MEMORY_SIZE - 1) {
+            events = chip8RunCycles(chip8, maxCycles - done, &n) & ~C8_YIELD_BUDGET;
+            done += n;
+            continue;
+        }
+
+        /* blocks are compiled for one quirk profile */
+        if (chip8->quirks != jit->quirks) {
+            chip8JitFlush(jit);
+            jit->quirks = chip8->quirks;
+        }
+
+        /* the ROM wrote over code it had already run */
+        if (chip8->codeWrites != jit->codeWrites) {
+            _drop_stale_blocks(jit, chip8);
+            jit->codeWrites = chip8->codeWrites;
+        }
+
+        Chip8JitBlock* blk = &jit->blocks[pc >> 1];
+        if (blk->compiled && chip8->decoded[pc >> 1].op == C8_OP_NONE) {
+            /* the VM got reloaded under us */
+            chip8JitFlush(jit);
+        }
+        if (!blk->compiled) {
+            _compile(jit, chip8, pc);
+        }
+        uint32_t left = maxCycles - done;
+        if (blk->count == 0) {
+            /* the interpreter takes it from here up to where a block can start again */
+            events = chip8RunCycles(chip8, left < blk->interp ? left : blk->interp, &n) & ~C8_YIELD_BUDGET;
+            done += n;
+            continue;
+        }
+
+        /* generated code leaves on anything that yields, so before that only the timer tick cuts it short */
+        if (left > chip8->tickCountdown) {
+            left = chip8->tickCountdown;
+        }
+        n = left - jit->enter(chip8, left, blk->code);
+        done += n;
+        chip8->cycles += n;
+        chip8->tickCountdown -= n;
+        if (chip8->tickCountdown == 0) {
+            chip8->tickCountdown = chip8->cyclesPerTick;
+            events = C8_YIELD_TIMER;
+        }
+        events |= jit->exitEvents;
+        jit->exitEvents = 0;
+        if (!chip8->running) {
+            events |= C8_YIELD_ERROR;
+        }
+        if (chip8->waitingForKey) {
+            events |= C8_YIELD_KEY_WAIT;
+        }
+    }
+    if (done == maxCycles) {
+        events |= C8_YIELD_BUDGET;
+    }
+    if (ran) {
+        *ran = done;
+    }
+    return events;
+}
+
+uint64_t chip8JitRunFor(Chip8Jit* jit, Chip8* chip8, uint64_t cycles) {
+    if (!jit) {
+        return chip8RunFor(chip8, cycles);
+    }
+    uint64_t total = 0;
+    while (chip8 && total < cycles) {
+        uint64_t left = cycles - total;
+        uint32_t ran = 0;
+        int events = chip8JitRun(jit, chip8, left > UINT32_MAX ? UINT32_MAX : (uint32_t) left, &ran);
+        if (events & C8_YIELD_TIMER) {
+            chip8DecrTimers(chip8);
+        }
+        if (ran == 0) {
+            break;
+        }
+        total += ran;
+    }
+    return total;
+}
+
+/**
+ * Fx33/Fx55 clear the decode cache entries they overwrite, so a block is
+ * stale as soon as any of the entries it was compiled from is empty.
+ * Its code is left in the buffer until the next flush.
+ */
+static void _drop_stale_blocks(Chip8Jit* jit, const Chip8* vm) {
+    for (unsigned b = 0; b < C8_DECODED_AMOUNT; b++) {
+        Chip8JitBlock* blk = &jit->blocks[b];
+        if (!blk->compiled) {
+            continue;
+        }
+        unsigned end = blk->count ? b + blk->count : b + 1;
+        for (unsigned i = b; i < end && i < C8_DECODED_AMOUNT; i++) {
+            if (vm->decoded[i].op == C8_OP_NONE) {
+                memset(blk, 0, sizeof(Chip8JitBlock));
+                break;
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+
+/**
+ * Code emission. While generated code runs, the Chip8 pointer lives in rbx
+ * and the budget left in ebp (both callee-saved, so handler calls leave
+ * them alone), and guest state is accessed as [rbx + disp32]. V registers
+ * are bytes, so x86's byte-sized memory operands fold each guest ALU
+ * instruction into one or two host instructions without a register
+ * allocator, and the reads happen in the same order as in the C handlers
+ * (which matters when x or y is F).
+ */
+
+static inline void _emit8(Chip8Jit* j, uint8_t b) {
+    j->code[j->used++] = b;
+}
+
+static inline void _emit16(Chip8Jit* j, uint16_t v) {
+    _emit8(j, v & 0xFF);
+    _emit8(j, v >> 8);
+}
+
+static inline void _emit32(Chip8Jit* j, uint32_t v) {
+    _emit16(j, v & 0xFFFF);
+    _emit16(j, v >> 16);
+}
+
+static inline void _emit64(Chip8Jit* j, uint64_t v) {
+    _emit32(j, v & 0xFFFFFFFF);
+    _emit32(j, v >> 32);
+}
+
+/* ModRM for [rbx + disp32] */
+static inline void _emit_mem(Chip8Jit* j, uint8_t reg, int32_t disp) {
+    _emit8(j, 0x80 | (reg << 3) | 3);
+    _emit32(j, (uint32_t) disp);
+}
+
+static inline void _emit_movzx8(Chip8Jit* j, uint8_t reg, int32_t disp) {
+    _emit8(j, 0x0F); _emit8(j, 0xB6); _emit_mem(j, reg, disp);
+}
+
+static inline void _emit_movzx16(Chip8Jit* j, uint8_t reg, int32_t disp) {
+    _emit8(j, 0x0F); _emit8(j, 0xB7); _emit_mem(j, reg, disp);
+}
+
+static inline void _emit_store8(Chip8Jit* j, int32_t disp, uint8_t reg) {
+    _emit8(j, 0x88); _emit_mem(j, reg, disp);
+}
+
+static inline void _emit_store16(Chip8Jit* j, int32_t disp, uint8_t reg) {
+    _emit8(j, 0x66); _emit8(j, 0x89); _emit_mem(j, reg, disp);
+}
+
+static inline void _emit_store8_imm(Chip8Jit* j, int32_t disp, uint8_t imm) {
+    _emit8(j, 0xC6); _emit_mem(j, 0, disp); _emit8(j, imm);
+}
+
+static inline void _emit_store16_imm(Chip8Jit* j, int32_t disp, uint16_t imm) {
+    _emit8(j, 0x66); _emit8(j, 0xC7); _emit_mem(j, 0, disp); _emit16(j, imm);
+}
+
+/* op r8, byte [rbx + disp] (add 02, sub 2A, cmp 3A) */
+static inline void _emit_alu_load8(Chip8Jit* j, uint8_t opc, uint8_t reg, int32_t disp) {
+    _emit8(j, opc); _emit_mem(j, reg, disp);
+}
+
+/* op byte [rbx + disp], r8 (or 08, and 20, xor 30) */
+static inline void _emit_alu_store8(Chip8Jit* j, uint8_t opc, int32_t disp, uint8_t reg) {
+    _emit8(j, opc); _emit_mem(j, reg, disp);
+}
+
+/* VF = (flags say "above") */
+static inline void _emit_set_vf_above(Chip8Jit* j) {
+    _emit8(j, 0x0F); _emit8(j, 0x97); _emit8(j, 0xC2);     /* seta dl */
+    _emit_store8(j, OFF_V(0xF), X_EDX);
+}
+
+/* skips end a block with pc = (condition) ? addr + 4 : addr + 2 */
+static inline void _emit_skip_targets(Chip8Jit* j, uint16_t addr) {
+    _emit8(j, 0xB9); _emit32(j, (uint16_t) (addr + 2));     /* mov ecx, addr + 2 */
+    _emit8(j, 0xBA); _emit32(j, (uint16_t) (addr + 4));     /* mov edx, addr + 4 */
+}
+
+/* cmovcc is 0x44 (e) or 0x45 (ne) */
+static inline void _emit_skip_commit(Chip8Jit* j, uint8_t cmovcc) {
+    _emit8(j, 0x0F); _emit8(j, cmovcc); _emit8(j, 0xCA);    /* cmovcc ecx, edx */
+    _emit_store16(j, OFF_PC, X_ECX);
+}
+
+/**
+ * What a block doesn't translate it hands to the interpreter's handler for
+ * the profile, and the pc that comes back is where the block goes on from.
+ * Always the last instruction of a block.
+ */
+static void _emit_handler(Chip8Jit* j, const Chip8Ins* ins, uint16_t addr, uint8_t profile) {
+#ifdef _WIN32
+    _emit8(j, 0x48); _emit8(j, 0x89); _emit8(j, 0xD9);     /* mov rcx, rbx */
+    _emit8(j, 0x48); _emit8(j, 0x8D); _emit_mem(j, X_EDX, OFF_INS(addr));   /* lea rdx, [the decoded ins] */
+    _emit8(j, 0x41); _emit8(j, 0xB8); _emit32(j, addr);    /* mov r8d, addr */
+#else
+    _emit8(j, 0x48); _emit8(j, 0x89); _emit8(j, 0xDF);     /* mov rdi, rbx */
+    _emit8(j, 0x48); _emit8(j, 0x8D); _emit_mem(j, X_ESI, OFF_INS(addr));   /* lea rsi, [the decoded ins] */
+    _emit8(j, 0xBA); _emit32(j, addr);                      /* mov edx, addr */
+#endif
+    _emit8(j, 0x48); _emit8(j, 0xB8); _emit64(j, (uint64_t) (uintptr_t) chip8OpHandler(profile, ins->op));   /* mov rax, handler */
+    _emit8(j, 0xFF); _emit8(j, 0xD0);                       /* call rax */
+    _emit8(j, 0x25); _emit32(j, C8_MEMORY_SIZE - 1);        /* and eax, address mask */
+    _emit_store16(j, OFF_PC, X_EAX);
+}
+
+/* short jcc/jmp with the offset left blank, returns where it has to be patched */
+static inline size_t _emit_jump8(Chip8Jit* j, uint8_t opc) {
+    _emit8(j, opc); _emit8(j, 0x00);
+    return j->used - 1;
+}
+
+/* points the jump at what gets emitted next */
+static inline void _patch_jump8(Chip8Jit* j, size_t at) {
+    j->code[at] = (uint8_t) (j->used - (at + 1));
+}
+
+/* same with a near jcc (0F 8x), for targets past the end of the block */
+static inline size_t _emit_jcc32(Chip8Jit* j, uint8_t cc) {
+    _emit8(j, 0x0F); _emit8(j, cc); _emit32(j, 0);
+    return j->used - 4;
+}
+
+static inline void _patch_jump32(Chip8Jit* j, size_t at) {
+    uint32_t rel = (uint32_t) (j->used - (at + 4));
+    memcpy(j->code + at, &rel, 4);
+}
+
+/**
+ * Calls, returns and Bnnn store pc themselves, except when they'd fail (a
+ * full or empty stack, a jump off the end of memory): for that *slow gets
+ * a jcc that the block patches to a handler call after its exit, which
+ * fails the same way the interpreter would.
+ */
+static int _emit_ins(Chip8Jit* j, const Chip8Ins* ins, uint16_t addr, unsigned quirks, size_t* slow) {
+    if (chip8QuirkyOp(quirks, ins->op)) {
+        return JIT_NOT_COVERED;
+    }
+    switch (ins->op) {
+        case C8_OP_LD_BYTE:
+            _emit_store8_imm(j, OFF_V(ins->x), ins->nn);
+            return JIT_CONTINUE;
+        case C8_OP_ADD_BYTE:
+            _emit8(j, 0x80); _emit_mem(j, 0, OFF_V(ins->x)); _emit8(j, ins->nn);
+            return JIT_CONTINUE;
+        case C8_OP_LD_REG:
+            _emit_movzx8(j, X_EAX, OFF_V(ins->y));
+            _emit_store8(j, OFF_V(ins->x), X_EAX);
+            return JIT_CONTINUE;
+        case C8_OP_OR:
+        case C8_OP_AND:
+        case C8_OP_XOR:
+            _emit_movzx8(j, X_ECX, OFF_V(ins->y));
+            _emit_alu_store8(j, ins->op == C8_OP_OR ? 0x08 : ins->op == C8_OP_AND ? 0x20 : 0x30,
+                OFF_V(ins->x), X_ECX);
+            return JIT_CONTINUE;
+        case C8_OP_ADD_REG:
+            _emit_movzx8(j, X_EAX, OFF_V(ins->x));
+            _emit_movzx8(j, X_ECX, OFF_V(ins->y));
+            _emit8(j, 0x01); _emit8(j, 0xC8);                   /* add eax, ecx */
+            _emit8(j, 0x3D); _emit32(j, UINT8_MAX);             /* cmp eax, 255 */
+            _emit_set_vf_above(j);
+            _emit_movzx8(j, X_EAX, OFF_V(ins->x));
+            _emit_alu_load8(j, 0x02, X_EAX, OFF_V(ins->y));     /* add al, Vy */
+            _emit_store8(j, OFF_V(ins->x), X_EAX);
+            return JIT_CONTINUE;
+        case C8_OP_SUB:
+        case C8_OP_SUBN: {
+            uint8_t a = ins->op == C8_OP_SUB ? ins->x : ins->y;
+            uint8_t b = ins->op == C8_OP_SUB ? ins->y : ins->x;
+            _emit_movzx8(j, X_EAX, OFF_V(a));
+            _emit_alu_load8(j, 0x3A, X_EAX, OFF_V(b));          /* cmp al, Vb */
+            _emit_set_vf_above(j);
+            _emit_movzx8(j, X_EAX, OFF_V(a));
+            _emit_alu_load8(j, 0x2A, X_EAX, OFF_V(b));          /* sub al, Vb */
+            _emit_store8(j, OFF_V(ins->x), X_EAX);
+            return JIT_CONTINUE;
+        }
+        case C8_OP_SHR:
+            _emit_movzx8(j, X_EAX, OFF_V(ins->x));
+            _emit8(j, 0x83); _emit8(j, 0xE0); _emit8(j, 0x01);  /* and eax, 1 */
+            _emit_store8(j, OFF_V(0xF), X_EAX);
+            _emit8(j, 0xD0); _emit_mem(j, 5, OFF_V(ins->x));    /* shr byte Vx, 1 */
+            return JIT_CONTINUE;
+        case C8_OP_SHL:
+            _emit_movzx8(j, X_EAX, OFF_V(ins->x));
+            _emit8(j, 0xC1); _emit8(j, 0xE8); _emit8(j, 0x07);  /* shr eax, 7 */
+            _emit_store8(j, OFF_V(0xF), X_EAX);
+            _emit8(j, 0xD0); _emit_mem(j, 4, OFF_V(ins->x));    /* shl byte Vx, 1 */
+            return JIT_CONTINUE;
+        case C8_OP_LD_I:
+            _emit_store16_imm(j, OFF_I, ins->opcode & 0x0FFF);
+            return JIT_CONTINUE;
+        case C8_OP_LD_VX_DT:
+            _emit_movzx8(j, X_EAX, OFF_DT);
+            _emit_store8(j, OFF_V(ins->x), X_EAX);
+            return JIT_CONTINUE;
+        case C8_OP_LD_DT_VX:
+        case C8_OP_LD_ST_VX:
+            _emit_movzx8(j, X_EAX, OFF_V(ins->x));
+            _emit_store8(j, ins->op == C8_OP_LD_DT_VX ? OFF_DT : OFF_ST, X_EAX);
+            return JIT_CONTINUE;
+        case C8_OP_ADD_I_VX:
+            _emit_movzx16(j, X_EAX, OFF_I);
+            _emit_movzx8(j, X_ECX, OFF_V(ins->x));
+            _emit8(j, 0x01); _emit8(j, 0xC8);                   /* add eax, ecx */
+            _emit8(j, 0x3D); _emit32(j, C8_MEMORY_SIZE - 1);    /* cmp eax, end of memory */
+            _emit_set_vf_above(j);
+            _emit_movzx16(j, X_EAX, OFF_I);
+            _emit_movzx8(j, X_ECX, OFF_V(ins->x));
+            _emit8(j, 0x01); _emit8(j, 0xC8);                   /* add eax, ecx */
+            _emit_store16(j, OFF_I, X_EAX);
+            return JIT_CONTINUE;
+        case C8_OP_LD_F_VX:
+            _emit_movzx8(j, X_EAX, OFF_V(ins->x));
+            _emit8(j, 0x8D); _emit8(j, 0x04); _emit8(j, 0x80);  /* lea eax, [rax + rax * 4] */
+            _emit_store16(j, OFF_I, X_EAX);
+            return JIT_CONTINUE;
+
+        /* block terminators */
+        case C8_OP_JP:
+            _emit_store16_imm(j, OFF_PC, ins->opcode & 0x0FFF);
+            return JIT_END;
+        case C8_OP_SE_BYTE:
+        case C8_OP_SNE_BYTE:
+            _emit_skip_targets(j, addr);
+            _emit8(j, 0x80); _emit_mem(j, 7, OFF_V(ins->x)); _emit8(j, ins->nn);   /* cmp byte Vx, nn */
+            _emit_skip_commit(j, ins->op == C8_OP_SE_BYTE ? 0x44 : 0x45);
+            return JIT_END;
+        case C8_OP_SE_REG:
+        case C8_OP_SNE_REG:
+            _emit_skip_targets(j, addr);
+            _emit_movzx8(j, X_EAX, OFF_V(ins->x));
+            _emit_alu_load8(j, 0x3A, X_EAX, OFF_V(ins->y));     /* cmp al, Vy */
+            _emit_skip_commit(j, ins->op == C8_OP_SE_REG ? 0x44 : 0x45);
+            return JIT_END;
+        case C8_OP_SKP:
+        case C8_OP_SKNP: {
+            /* eax = key Vx is down, and there's no key past F */
+            _emit_movzx8(j, X_ECX, OFF_V(ins->x));
+            _emit8(j, 0x31); _emit8(j, 0xC0);                   /* xor eax, eax */
+            _emit8(j, 0x83); _emit8(j, 0xF9); _emit8(j, C8_KEYS_AMOUNT - 1);   /* cmp ecx, F */
+            size_t nokey = _emit_jump8(j, 0x77);                /* ja nokey */
+            _emit8(j, 0x80); _emit8(j, 0xBC); _emit8(j, 0x0B);
+            _emit32(j, (uint32_t) OFF_KEY); _emit8(j, 1);       /* cmp byte [rbx + rcx + key], 1 */
+            _emit8(j, 0x0F); _emit8(j, 0x94); _emit8(j, 0xC0);  /* sete al */
+            _patch_jump8(j, nokey);
+            _emit_skip_targets(j, addr);
+            _emit8(j, 0x85); _emit8(j, 0xC0);                   /* test eax, eax */
+            _emit_skip_commit(j, ins->op == C8_OP_SKP ? 0x45 : 0x44);
+            return JIT_END;
+        }
+        case C8_OP_CALL: {
+            if ((ins->opcode & 0x0FFF) >= C8_MEMORY_SIZE) {
+                return JIT_NOT_COVERED;
+            }
+            _emit_movzx16(j, X_EAX, OFF_SP);
+            _emit8(j, 0x83); _emit8(j, 0xF8); _emit8(j, C8_STACK_SIZE);    /* cmp eax, stack size */
+            *slow = _emit_jcc32(j, 0x84);                       /* je slow */
+            _emit8(j, 0x66); _emit8(j, 0xC7); _emit8(j, 0x84); _emit8(j, 0x43);
+            _emit32(j, (uint32_t) OFF_STACK); _emit16(j, addr); /* mov word [rbx + rax * 2 + stack], addr */
+            _emit8(j, 0x66); _emit8(j, 0xFF); _emit_mem(j, 0, OFF_SP);     /* inc word sp */
+            _emit_store16_imm(j, OFF_PC, ins->opcode & 0x0FFF);
+            return JIT_END;
+        }
+        case C8_OP_RET: {
+            _emit_movzx16(j, X_EAX, OFF_SP);
+            _emit8(j, 0x85); _emit8(j, 0xC0);                   /* test eax, eax */
+            *slow = _emit_jcc32(j, 0x84);                       /* je slow */
+            _emit8(j, 0xFF); _emit8(j, 0xC8);                   /* dec eax */
+            _emit_store16(j, OFF_SP, X_EAX);
+            _emit8(j, 0x0F); _emit8(j, 0xB7); _emit8(j, 0x84); _emit8(j, 0x43);
+            _emit32(j, (uint32_t) OFF_STACK);                   /* movzx eax, word [rbx + rax * 2 + stack] */
+            _emit8(j, 0x83); _emit8(j, 0xC0); _emit8(j, 0x02);  /* add eax, 2 */
+            _emit8(j, 0x25); _emit32(j, C8_MEMORY_SIZE - 1);    /* and eax, address mask */
+            _emit_store16(j, OFF_PC, X_EAX);
+            return JIT_END;
+        }
+        case C8_OP_JP_V0: {
+            _emit_movzx8(j, X_EAX, OFF_V(0));
+            _emit8(j, 0x05); _emit32(j, ins->opcode & 0x0FFF);  /* add eax, nnn */
+            _emit8(j, 0x3D); _emit32(j, C8_MEMORY_SIZE);        /* cmp eax, memory size */
+            *slow = _emit_jcc32(j, 0x83);                       /* jae slow */
+            _emit_store16(j, OFF_PC, X_EAX);
+            return JIT_END;
+        }
+        default:
+            return JIT_NOT_COVERED;
+    }
+}
+
+/* back out to chip8JitRun with eax = budget left, undoing what the entry set up */
+static void _emit_leave(Chip8Jit* j) {
+    _emit8(j, 0x48); _emit8(j, 0x83); _emit8(j, 0xC4); _emit8(j, C8_JIT_FRAME);    /* add rsp, frame */
+    _emit8(j, 0x5D);                                        /* pop rbp */
+    _emit8(j, 0x5B);                                        /* pop rbx */
+    _emit8(j, 0xC3);                                        /* ret */
+}
+
+/**
+ * Before every instruction but the first, a budget check: once the budget
+ * left is down to the instructions the block has run, all of it's gone,
+ * so store where the guest stopped and leave.
+ */
+static void _emit_budget_exit(Chip8Jit* j, uint16_t count, uint16_t addr, uint16_t lastOpcode) {
+    _emit8(j, 0x81); _emit8(j, 0xFD); _emit32(j, count);   /* cmp ebp, count */
+    size_t over = _emit_jump8(j, 0x77);                     /* ja over the exit */
+    _emit_store16_imm(j, OFF_PC, addr);
+    _emit_store16_imm(j, OFF_OPCODE, lastOpcode);
+    _emit8(j, 0x31); _emit8(j, 0xC0);                       /* xor eax, eax */
+    _emit_leave(j);
+    _patch_jump8(j, over);
+}
+
+/**
+ * The end of a block, pc and opcode already stored: takes the block's
+ * instructions off the budget and, with chain, goes straight on to the
+ * block at pc when there's budget left and one's compiled there (odd
+ * addresses never are). After a handler the VM must also still be
+ * running, not waiting, and without new writes over code, or chip8JitRun
+ * has to see it first. Otherwise it leaves.
+ */
+static void _emit_exit(Chip8Jit* j, uint16_t count, int chain, int handled) {
+    size_t out[8];
+    int outs = 0;
+    _emit8(j, 0x81); _emit8(j, 0xED); _emit32(j, count);   /* sub ebp, count */
+    if (chain) {
+        out[outs++] = _emit_jump8(j, 0x74);                 /* jz out */
+        if (handled) {
+            _emit8(j, 0x80); _emit_mem(j, 7, OFF_RUNNING); _emit8(j, 0);   /* cmp byte running, 0 */
+            out[outs++] = _emit_jump8(j, 0x74);             /* je out */
+            _emit8(j, 0x80); _emit_mem(j, 7, OFF_WAITING); _emit8(j, 0);   /* cmp byte waitingForKey, 0 */
+            out[outs++] = _emit_jump8(j, 0x75);             /* jne out */
+            _emit8(j, 0x8B); _emit_mem(j, X_EAX, OFF_CODE_WRITES);         /* mov eax, codeWrites */
+            _emit8(j, 0x48); _emit8(j, 0xBA); _emit64(j, (uint64_t) (uintptr_t) &j->codeWrites);   /* mov rdx, &jit->codeWrites */
+            _emit8(j, 0x3B); _emit8(j, 0x02);               /* cmp eax, [rdx] */
+            out[outs++] = _emit_jump8(j, 0x75);             /* jne out */
+        }
+        _emit_movzx16(j, X_EAX, OFF_PC);
+        _emit8(j, 0xA8); _emit8(j, 0x01);                   /* test al, 1 */
+        out[outs++] = _emit_jump8(j, 0x75);                 /* jnz out */
+        _emit8(j, 0xC1); _emit8(j, 0xE0); _emit8(j, 0x03);  /* shl eax, 3 */
+        _emit8(j, 0x48); _emit8(j, 0xBA); _emit64(j, (uint64_t) (uintptr_t) j->blocks);    /* mov rdx, jit->blocks */
+        _emit8(j, 0x48); _emit8(j, 0x8B); _emit8(j, 0x04); _emit8(j, 0x02);    /* mov rax, [rdx + rax] (its code) */
+        _emit8(j, 0x48); _emit8(j, 0x85); _emit8(j, 0xC0);  /* test rax, rax */
+        out[outs++] = _emit_jump8(j, 0x74);                 /* jz out */
+        _emit8(j, 0xFF); _emit8(j, 0xE0);                   /* jmp rax */
+    }
+    for (int i = 0; i < outs; i++) {
+        _patch_jump8(j, out[i]);
+    }
+    _emit8(j, 0x89); _emit8(j, 0xE8);                       /* mov eax, ebp */
+    _emit_leave(j);
+}
+
+/**
+ * The entry at the start of the buffer: saves what generated code uses,
+ * loads the registers and jumps to the block. See Chip8JitEntry.
+ */
+static void _emit_entry(Chip8Jit* j) {
+    _emit8(j, 0x53);                                        /* push rbx */
+    _emit8(j, 0x55);                                        /* push rbp */
+    _emit8(j, 0x48); _emit8(j, 0x83); _emit8(j, 0xEC); _emit8(j, C8_JIT_FRAME);    /* sub rsp, frame */
+#ifdef _WIN32
+    _emit8(j, 0x48); _emit8(j, 0x89); _emit8(j, 0xCB);     /* mov rbx, rcx */
+    _emit8(j, 0x89); _emit8(j, 0xD5);                       /* mov ebp, edx */
+    _emit8(j, 0x41); _emit8(j, 0xFF); _emit8(j, 0xE0);     /* jmp r8 */
+#else
+    _emit8(j, 0x48); _emit8(j, 0x89); _emit8(j, 0xFB);     /* mov rbx, rdi */
+    _emit8(j, 0x89); _emit8(j, 0xF5);                       /* mov ebp, esi */
+    _emit8(j, 0xFF); _emit8(j, 0xE2);                       /* jmp rdx */
+#endif
+}
+
+static int _compile_entry(Chip8Jit* jit) {
+    if (!_protect_exec(jit->code, C8_JIT_CODE_SIZE, 1)) {
+        return 0;
+    }
+    _emit_entry(jit);
+    jit->entrySize = jit->used;
+    jit->enter = (Chip8JitEntry) (void*) jit->code;
+    return _protect_exec(jit->code, C8_JIT_CODE_SIZE, 0);
+}
+
+/**
+ * The code buffer is never writable and executable at once (ROMs are
+ * untrusted input, after all): it's made writable for as long as a block
+ * takes to emit and goes back to executable-only after. If either switch
+ * fails the block is left to the interpreter.
+ */
+static void _compile(Chip8Jit* jit, Chip8* vm, uint16_t pc) {
+    Chip8JitBlock* blk = &jit->blocks[pc >> 1];
+    if (!_protect_exec(jit->code, C8_JIT_CODE_SIZE, 1)) {
+        memset(blk, 0, sizeof(Chip8JitBlock));
+        blk->compiled = 1;
+        blk->interp = 1;
+        return;
+    }
+    _emit_block(jit, vm, pc);
+    if (!_protect_exec(jit->code, C8_JIT_CODE_SIZE, 0)) {
+        /* nothing in the buffer can run anymore */
+        chip8JitFlush(jit);
+        blk->compiled = 1;
+        blk->interp = 1;
+    }
+}
+
+static void _emit_block(Chip8Jit* jit, Chip8* vm, uint16_t pc) {
+    Chip8JitBlock* blk = &jit->blocks[pc >> 1];
+    if (C8_JIT_CODE_SIZE - jit->used < C8_JIT_MAX_BLOCK * C8_JIT_MAX_INS_BYTES + C8_JIT_MAX_END_BYTES) {
+        chip8JitFlush(jit);
+    }
+
+    unsigned quirks = chip8QuirksFlags(vm->quirks);
+    size_t start = jit->used;
+    size_t slow = 0;
+    uint16_t addr = pc;
+    uint16_t count = 0;
+    uint16_t lastOpcode = 0;
+    uint8_t lastOp = C8_OP_NONE;
+    int ended = 0;
+    int handled = 0;
+    /* the last couple of words are left to the interpreter, so no exit can land past the end of memory */
+    while (count < C8_JIT_MAX_BLOCK && addr + 4 < C8_MEMORY_SIZE) {
+        const Chip8Ins* ins = chip8DecodeAt(vm, addr);
+        if (count > 0) {
+            _emit_budget_exit(jit, count, addr, lastOpcode);
+        }
+        int kind = _emit_ins(jit, ins, addr, quirks, &slow);
+        if (kind == JIT_NOT_COVERED) {
+            _emit_handler(jit, ins, addr, vm->quirks);
+            handled = 1;
+            kind = JIT_END;
+        }
+        count++;
+        lastOpcode = ins->opcode;
+        lastOp = ins->op;
+        addr += 2;
+        if (kind == JIT_END) {
+            ended = 1;
+            break;
+        }
+    }
+
+    blk->compiled = 1;
+    blk->count = count;
+    if (count == 0) {
+        /* the tail of memory, which the interpreter runs through */
+        blk->interp = (C8_MEMORY_SIZE - pc) / 2;
+        return;
+    }
+    if (!ended) {
+        _emit_store16_imm(jit, OFF_PC, addr);
+    }
+    _emit_store16_imm(jit, OFF_OPCODE, lastOpcode);
+    if (handled && C8_OP_DRAWS(lastOp)) {
+        /* drawing yields, so that one goes back and says so */
+        _emit8(jit, 0x48); _emit8(jit, 0xBA); _emit64(jit, (uint64_t) (uintptr_t) &jit->exitEvents);  /* mov rdx, &jit->exitEvents */
+        _emit8(jit, 0xC6); _emit8(jit, 0x02); _emit8(jit, C8_YIELD_DRAW);      /* mov byte [rdx], draw */
+        _emit_exit(jit, count, 0, 1);
+    } else {
+        _emit_exit(jit, count, 1, handled);
+    }
+    if (slow) {
+        /* a call, return or Bnnn that fails, which stops the VM */
+        _patch_jump32(jit, slow);
+        _emit_handler(jit, chip8DecodeAt(vm, addr - 2), (uint16_t) (addr - 2), vm->quirks);
+        _emit_store16_imm(jit, OFF_OPCODE, lastOpcode);
+        _emit_exit(jit, count, 0, 1);
+    }
+    blk->code = jit->code + start;
+}
+
+static void* _alloc_exec(size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READ);
+#else
+    void* mem = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+#endif
+}
+
+/* read/write while emitting, read/execute the rest of the time */
+static int _protect_exec(void* mem, size_t size, int writable) {
+#ifdef _WIN32
+    DWORD old;
+    return VirtualProtect(mem, size, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old) != 0;
+#else
+    return mprotect(mem, size, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+static void _free_exec(void* mem, size_t size) {
+#ifdef _WIN32
+    (void) size;
+    VirtualFree(mem, 0, MEM_RELEASE);
+#else
+    munmap(mem, size);
+#endif
+}
+
+#else /* !C8_JIT_SUPPORTED */
+
+Chip8Jit* chip8JitCreate(void) {
+    return NULL;
+}
+
+void chip8JitDestroy(Chip8Jit* jit) {
+    (void) jit;
+}
+
+void chip8JitFlush(Chip8Jit* jit) {
+    (void) jit;
+}
+
+int chip8JitRun(Chip8Jit* jit, Chip8* chip8, uint32_t maxCycles, uint32_t* ran) {
+    (void) jit;
+    (void) chip8;
+    (void) maxCycles;
+    (void) ran;
+    return 0;
+}
+
+uint64_t chip8JitRunFor(Chip8Jit* jit, Chip8* chip8, uint64_t cycles) {
+    (void) jit;
+    return chip8RunFor(chip8, cycles);
+}
+
+#endif /* C8_JIT_SUPPORTED */
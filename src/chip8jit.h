@@ -0,0 +1,32 @@
+#ifndef CHIP8JIT_H
+#define CHIP8JIT_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+/**
+ * Optional x86-64 dynamic recompiler. Straight-line runs of ALU, load,
+ * timer, jump, skip, call and return instructions are translated into
+ * native basic blocks that chain into each other; a block ends on anything
+ * else with a call to the interpreter's handler for it, so those stay the
+ * reference. Only available on x86-64 hosts, chip8JitCreate returns NULL
+ * elsewhere (or when executable memory can't be had).
+ */
+typedef struct Chip8Jit Chip8Jit;
+
+Chip8Jit* chip8JitCreate(void);
+void chip8JitDestroy(Chip8Jit* jit);
+
+/* forget every compiled block. call after loading a new ROM into the VM */
+void chip8JitFlush(Chip8Jit* jit);
+
+/**
+ * Drop-in for chip8RunCycles: runs up to maxCycles instructions, yields on
+ * the same events and returns the same C8_YIELD_* mask.
+ */
+int chip8JitRun(Chip8Jit* jit, Chip8* chip8, uint32_t maxCycles, uint32_t* ran);
+/* and for chip8RunFor. a NULL jit runs on the interpreter */
+uint64_t chip8JitRunFor(Chip8Jit* jit, Chip8* chip8, uint64_t cycles);
+
+#endif /* CHIP8JIT_H */
@@ -0,0 +1,221 @@
+#include "chip8movie.h"
+#include "chip8ops.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define C8_MOVIE_MAGIC          "C8MV"
+#define C8_MOVIE_HEADER_SIZE    52
+#define C8_MOVIE_EVENT_SIZE     10
+
+typedef struct Chip8MovieEvent {
+    uint64_t cycle;         /* the VM's cycles when the keys came in */
+    uint16_t keys;
+} Chip8MovieEvent;
+
+struct Chip8Movie {
+    uint64_t seed;
+    int quirks;             /* the profile it was recorded with */
+    uint64_t romHash;       /* chip8StateHash right after loading */
+    uint64_t endCycles;
+    uint64_t stateHash;     /* chip8StateHash at the end */
+    uint64_t screenHash;
+    Chip8MovieEvent* events;
+    size_t count;
+    size_t cap;
+    uint16_t keys;          /* the last mask pressed */
+    int finished;
+};
+
+static int _run_until(Chip8* chip8, uint64_t cycle);
+
+Chip8Movie* chip8MovieCreate(const Chip8* chip8, uint64_t seed) {
+    if (!chip8) {
+        return NULL;
+    }
+    Chip8Movie* movie = calloc(1, sizeof(Chip8Movie));
+    if (!movie) {
+        return NULL;
+    }
+    movie->seed = seed;
+    movie->quirks = chip8->quirks;
+    movie->romHash = chip8StateHash(chip8);
+    return movie;
+}
+
+void chip8MovieDestroy(Chip8Movie* movie) {
+    if (!movie) {
+        return;
+    }
+    free(movie->events);
+    free(movie);
+}
+
+int chip8MoviePressKeys(Chip8Movie* movie, Chip8* chip8, uint16_t keys) {
+    if (!chip8) {
+        return 0;
+    }
+    /* a held key also answers an Fx0A, so those presses count too */
+    if (movie && !movie->finished && (keys != movie->keys || (chip8->waitingForKey && keys))) {
+        if (movie->count == movie->cap) {
+            size_t cap = movie->cap ? movie->cap * 2 : 256;
+            Chip8MovieEvent* events = realloc(movie->events, cap * sizeof(Chip8MovieEvent));
+            if (!events) {
+                return 0;
+            }
+            movie->events = events;
+            movie->cap = cap;
+        }
+        movie->events[movie->count].cycle = chip8->cycles;
+        movie->events[movie->count].keys = keys;
+        movie->count++;
+        movie->keys = keys;
+    }
+    return chip8PressKeys(chip8, keys);
+}
+
+int chip8MovieFinish(Chip8Movie* movie, const Chip8* chip8) {
+    if (!movie || !chip8 || movie->finished) {
+        return 0;
+    }
+    movie->endCycles = chip8->cycles;
+    movie->stateHash = chip8StateHash(chip8);
+    movie->screenHash = chip8ScreenHash(chip8);
+    movie->finished = 1;
+    return 1;
+}
+
+/**
+ * Layout, little endian: magic, version, quirk profile (u16), seed, romHash,
+ * endCycles, stateHash, screenHash, the event count (u32), then each
+ * event as its cycle (u64) and keys (u16).
+ */
+int chip8MovieSave(const Chip8Movie* movie, const char* path) {
+    if (!movie || !path || !movie->finished || movie->count > UINT32_MAX) {
+        return 0;
+    }
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    uint8_t header[C8_MOVIE_HEADER_SIZE] = { 0 };
+    memcpy(header, C8_MOVIE_MAGIC, 4);
+    chip8Put16(header + 4, C8_MOVIE_VERSION);
+    chip8Put16(header + 6, (uint16_t) movie->quirks);
+    chip8Put64(header + 8, movie->seed);
+    chip8Put64(header + 16, movie->romHash);
+    chip8Put64(header + 24, movie->endCycles);
+    chip8Put64(header + 32, movie->stateHash);
+    chip8Put64(header + 40, movie->screenHash);
+    chip8Put32(header + 48, (uint32_t) movie->count);
+    int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    for (size_t i = 0; ok && i < movie->count; i++) {
+        uint8_t ev[C8_MOVIE_EVENT_SIZE];
+        chip8Put64(ev, movie->events[i].cycle);
+        chip8Put16(ev + 8, movie->events[i].keys);
+        ok = fwrite(ev, 1, sizeof(ev), file) == sizeof(ev);
+    }
+    return fclose(file) == 0 && ok;
+}
+
+Chip8Movie* chip8MovieLoad(const char* path) {
+    if (!path) {
+        return NULL;
+    }
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    uint8_t header[C8_MOVIE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)
+            || memcmp(header, C8_MOVIE_MAGIC, 4) != 0
+            || chip8Get16(header + 4) < 1 || chip8Get16(header + 4) > C8_MOVIE_VERSION) {
+        fclose(file);
+        return NULL;
+    }
+    /* version 1 came before quirk profiles, it's always the default one */
+    int quirks = chip8Get16(header + 4) >= 2 ? chip8Get16(header + 6) : C8_QUIRKS_DEFAULT;
+    if (quirks >= C8_QUIRKS_COUNT) {
+        fclose(file);
+        return NULL;
+    }
+    Chip8Movie* movie = calloc(1, sizeof(Chip8Movie));
+    if (!movie) {
+        fclose(file);
+        return NULL;
+    }
+    movie->seed = chip8Get64(header + 8);
+    movie->quirks = quirks;
+    movie->romHash = chip8Get64(header + 16);
+    movie->endCycles = chip8Get64(header + 24);
+    movie->stateHash = chip8Get64(header + 32);
+    movie->screenHash = chip8Get64(header + 40);
+    movie->finished = 1;
+    size_t count = chip8Get32(header + 48);
+    movie->events = count ? malloc(count * sizeof(Chip8MovieEvent)) : NULL;
+    int ok = count == 0 || movie->events != NULL;
+    uint64_t last = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        uint8_t ev[C8_MOVIE_EVENT_SIZE];
+        if (fread(ev, 1, sizeof(ev), file) != sizeof(ev)) {
+            ok = 0;
+            break;
+        }
+        movie->events[i].cycle = chip8Get64(ev);
+        movie->events[i].keys = chip8Get16(ev + 8);
+        /* a replay only goes forward */
+        ok = movie->events[i].cycle >= last && movie->events[i].cycle <= movie->endCycles;
+        last = movie->events[i].cycle;
+    }
+    fclose(file);
+    if (!ok) {
+        chip8MovieDestroy(movie);
+        return NULL;
+    }
+    movie->count = count;
+    movie->cap = count;
+    return movie;
+}
+
+int chip8MovieReplay(const Chip8Movie* movie, Chip8* chip8) {
+    if (!movie || !chip8 || !movie->finished || chip8->quirks != movie->quirks
+            || chip8StateHash(chip8) != movie->romHash) {
+        return 0;
+    }
+    chip8Seed(chip8, movie->seed);
+    for (size_t i = 0; i < movie->count; i++) {
+        if (!_run_until(chip8, movie->events[i].cycle)) {
+            return 0;
+        }
+        chip8PressKeys(chip8, movie->events[i].keys);
+    }
+    _run_until(chip8, movie->endCycles);
+    return chip8->cycles == movie->endCycles
+        && chip8StateHash(chip8) == movie->stateHash
+        && chip8ScreenHash(chip8) == movie->screenHash;
+}
+
+int chip8MovieQuirks(const Chip8Movie* movie) {
+    return movie ? movie->quirks : C8_QUIRKS_DEFAULT;
+}
+
+size_t chip8MovieEventCount(const Chip8Movie* movie) {
+    return movie ? movie->count : 0;
+}
+
+uint64_t chip8MovieCycles(const Chip8Movie* movie) {
+    return movie ? movie->endCycles : 0;
+}
+
+// ----------------------------------------------------------------------
+
+/* runs up to the given cycle count, returns 0 if the VM stopped short of it */
+static int _run_until(Chip8* chip8, uint64_t cycle) {
+    if (chip8->cycles < cycle) {
+        chip8RunFor(chip8, cycle - chip8->cycles);
+    }
+    return chip8->cycles >= cycle;
+}
+
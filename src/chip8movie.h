@@ -0,0 +1,53 @@
+#ifndef CHIP8MOVIE_H
+#define CHIP8MOVIE_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define C8_MOVIE_VERSION    2       /* 1 had no quirk profile, those load as C8_QUIRKS_DEFAULT */
+
+/**
+ * Input movies. A movie is the RNG seed, the quirk profile, a hash of the
+ * freshly loaded VM (so it won't be replayed on the wrong ROM) and every key mask handed to
+ * the VM, tagged with the cycle it came in at. The VM is deterministic
+ * otherwise, so feeding the masks back at the same cycles gives the same
+ * run, down to the last pixel.
+ */
+typedef struct Chip8Movie Chip8Movie;
+
+/**
+ * Starts a recording, call it right after loading the ROM, setting the
+ * quirk profile and seeding the VM with seed.
+ */
+Chip8Movie* chip8MovieCreate(const Chip8* chip8, uint64_t seed);
+void chip8MovieDestroy(Chip8Movie* movie);
+
+/**
+ * Use instead of chip8PressKeys while recording. Only presses that can
+ * change something get stored (the mask changed, or the VM is waiting for
+ * a key). movie may be NULL, then it just presses the keys.
+ */
+int chip8MoviePressKeys(Chip8Movie* movie, Chip8* chip8, uint16_t keys);
+/* ends the recording where the VM is now and remembers its final state */
+int chip8MovieFinish(Chip8Movie* movie, const Chip8* chip8);
+
+int chip8MovieSave(const Chip8Movie* movie, const char* path);
+Chip8Movie* chip8MovieLoad(const char* path);
+
+/**
+ * Replays a finished movie on a VM that has just loaded the ROM and been
+ * set to chip8MovieQuirks. Runs at full speed, no window. Returns 1 when
+ * the VM ends up in the same state the recording did, 0 on the wrong ROM,
+ * the wrong quirk profile or a mismatch.
+ */
+int chip8MovieReplay(const Chip8Movie* movie, Chip8* chip8);
+
+/* the C8_QUIRKS_* profile it was recorded with */
+int chip8MovieQuirks(const Chip8Movie* movie);
+
+size_t chip8MovieEventCount(const Chip8Movie* movie);
+uint64_t chip8MovieCycles(const Chip8Movie* movie);
+
+#endif /* CHIP8MOVIE_H */
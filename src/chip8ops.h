@@ -0,0 +1,109 @@
+#ifndef CHIP8OPS_H
+#define CHIP8OPS_H
+
+#include "chip8.h"
+
+/**
+ * Internal to the emulator core: the decoded instruction ids and the
+ * decoder, shared by the interpreter and the other execution engines.
+ * Not part of the public API.
+ */
+
+/**
+ * Every instruction is decoded once into one of these ids, which index
+ * the interpreter's handler table. C8_OP_NONE marks a decode cache slot
+ * that hasn't been filled in yet (or was invalidated by a write to memory).
+ */
+enum {
+    C8_OP_NONE = 0,
+    C8_OP_UNKNOWN,
+    C8_OP_CLS,  C8_OP_RET,  C8_OP_SYS,
+    C8_OP_JP,   C8_OP_CALL, C8_OP_SE_BYTE, C8_OP_SNE_BYTE, C8_OP_SE_REG,
+    C8_OP_LD_BYTE, C8_OP_ADD_BYTE,
+    C8_OP_LD_REG, C8_OP_OR, C8_OP_AND, C8_OP_XOR, C8_OP_ADD_REG,
+    C8_OP_SUB, C8_OP_SHR, C8_OP_SUBN, C8_OP_SHL,
+    C8_OP_SNE_REG, C8_OP_LD_I, C8_OP_JP_V0, C8_OP_RND, C8_OP_DRW,
+    C8_OP_SKP, C8_OP_SKNP,
+    C8_OP_LD_VX_DT, C8_OP_LD_VX_K, C8_OP_LD_DT_VX, C8_OP_LD_ST_VX,
+    C8_OP_ADD_I_VX, C8_OP_LD_F_VX, C8_OP_LD_B_VX, C8_OP_LD_MEM_VX, C8_OP_LD_VX_MEM,
+    /* SUPER-CHIP's and XO-CHIP's, only decoded for profiles that have them. screen ones first */
+    C8_OP_SCD, C8_OP_SCU, C8_OP_SCR, C8_OP_SCL, C8_OP_LOW, C8_OP_HIGH,
+    C8_OP_EXIT, C8_OP_LD_HF_VX, C8_OP_LD_R_VX, C8_OP_LD_VX_R,
+    C8_OP_SAVE_RANGE, C8_OP_LOAD_RANGE, C8_OP_LD_I_LONG, C8_OP_PLANE, C8_OP_AUDIO, C8_OP_PITCH,
+    C8_OP_COUNT
+};
+
+/**
+ * Decodes a raw opcode, without touching any cache. quirks are the
+ * profile's C8_QUIRK_* flags: without C8_QUIRK_SCHIP_OPS/XOCHIP_OPS the
+ * newer instructions decode to whatever they always did.
+ */
+void chip8DecodeOp(uint16_t opcode, unsigned quirks, Chip8Ins* out);
+
+/* returns the decode cache entry for an even address, decoding it if needed */
+const Chip8Ins* chip8DecodeAt(Chip8* c8, uint16_t addr);
+
+/* instructions that change the screen, and so raise C8_YIELD_DRAW */
+#define C8_OP_DRAWS(op)     ((op) == C8_OP_DRW || (op) == C8_OP_CLS \
+                            || (uint8_t) ((op) - C8_OP_SCD) <= C8_OP_HIGH - C8_OP_SCD)
+
+/**
+ * The interpreter's handler for op under a quirk profile (C8_QUIRKS_*).
+ * It runs the instruction at pc and returns the next pc, not wrapped yet.
+ * Cycles, timers and events are up to the caller. For the JIT, which ends
+ * its blocks on the instructions it doesn't translate.
+ */
+typedef uint16_t (*Chip8OpHandler)(Chip8* c8, const Chip8Ins* ins, uint16_t pc);
+Chip8OpHandler chip8OpHandler(uint8_t quirks, uint8_t op);
+
+/**
+ * Whether op does anything different under these C8_QUIRK_* flags. The
+ * other engines only implement the default behavior, and leave the
+ * instructions this says yes to to the interpreter.
+ */
+int chip8QuirkyOp(unsigned quirks, uint8_t op);
+
+#define C8_FNV_OFFSET       0xCBF29CE484222325ULL
+#define C8_FNV_PRIME        0x100000001B3ULL
+
+/**
+ * 64-bit FNV-1a of data, carrying on from h (C8_FNV_OFFSET starts a new
+ * one). State hashes, ROM hashes and so -Q rules all go through this one.
+ */
+uint64_t chip8Fnv1a(uint64_t h, const void* data, size_t size);
+
+/**
+ * Little endian, byte by byte, so states, movies and traces move between
+ * hosts. The puts return where the next field goes.
+ */
+static inline uint8_t* chip8Put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    return p + 2;
+}
+
+static inline uint8_t* chip8Put32(uint8_t* p, uint32_t v) {
+    return chip8Put16(chip8Put16(p, (uint16_t) v), (uint16_t) (v >> 16));
+}
+
+static inline uint8_t* chip8Put64(uint8_t* p, uint64_t v) {
+    return chip8Put32(chip8Put32(p, (uint32_t) v), (uint32_t) (v >> 32));
+}
+
+static inline uint16_t chip8Get16(const uint8_t* p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t chip8Get32(const uint8_t* p) {
+    return chip8Get16(p) | (uint32_t) chip8Get16(p + 2) << 16;
+}
+
+static inline uint64_t chip8Get64(const uint8_t* p) {
+    return chip8Get32(p) | (uint64_t) chip8Get32(p + 4) << 32;
+}
+
+/* a monotonic clock and a sleep, for the runner, the tracer and the tools */
+double chip8NowSeconds(void);
+void chip8SleepSeconds(double s);
+
+#endif /* CHIP8OPS_H */
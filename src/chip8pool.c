@@ -0,0 +1,365 @@
+#include "chip8pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define C8_POOL_SLICE       (1U << 16)  /* cycles a job runs before going back on its deque */
+#define C8_POOL_EMPTY       (-1)
+
+typedef struct Chip8PoolJob {
+    const uint8_t* rom;
+    size_t size;
+    uint64_t budget;
+    uint64_t seed;
+    int quirks;
+    Chip8* vm;              /* allocated by whichever worker starts the job */
+    Chip8PoolResult result;
+    int done;
+} Chip8PoolJob;
+
+/**
+ * Chase-Lev deque of job indices. The owner pushes and pops at the
+ * bottom, thieves take from the top. It never grows: a job sits in at
+ * most one deque at a time, so the job count bounds every deque.
+ */
+typedef struct Chip8PoolDeque {
+    atomic_long top;
+    atomic_long bottom;
+    atomic_int* slots;
+    long mask;
+} Chip8PoolDeque;
+
+typedef struct Chip8PoolWorker {
+    Chip8Pool* pool;
+    Chip8PoolDeque deque;
+    uint32_t victimSeed;    /* picks who to steal from */
+    int id;
+} Chip8PoolWorker;
+
+struct Chip8Pool {
+    int threads;
+    Chip8PoolJob* jobs;
+    int jobCount;
+    int jobCap;
+    Chip8PoolWorker* workers;
+    atomic_int remaining;   /* jobs of the current run that aren't done yet */
+    uint64_t seed;          /* every job's VM starts from it */
+    int quirks;             /* and runs with this quirk profile */
+};
+
+static int _cpu_count(void);
+static void* _worker_main(void* arg);
+static int _run_slice(Chip8PoolJob* job);
+static int _steal(Chip8PoolWorker* self);
+static void _deque_push(Chip8PoolDeque* d, int job);
+static int _deque_pop(Chip8PoolDeque* d);
+static int _deque_steal(Chip8PoolDeque* d);
+
+Chip8Pool* chip8PoolCreate(int threads) {
+    if (threads <= 0) {
+        threads = _cpu_count();
+    }
+    Chip8Pool* pool = calloc(1, sizeof(Chip8Pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->threads = threads;
+    pool->seed = C8_DEFAULT_SEED;
+    pool->workers = calloc(threads, sizeof(Chip8PoolWorker));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void chip8PoolDestroy(Chip8Pool* pool) {
+    if (!pool) {
+        return;
+    }
+    chip8PoolClear(pool);
+    free(pool->jobs);
+    free(pool->workers);
+    free(pool);
+}
+
+int chip8PoolAdd(Chip8Pool* pool, const uint8_t* rom, size_t size, uint64_t cycles) {
+    if (!pool || !rom) {
+        return -1;
+    }
+    if (pool->jobCount == pool->jobCap) {
+        int cap = pool->jobCap ? pool->jobCap * 2 : 64;
+        Chip8PoolJob* jobs = realloc(pool->jobs, cap * sizeof(Chip8PoolJob));
+        if (!jobs) {
+            return -1;
+        }
+        pool->jobs = jobs;
+        pool->jobCap = cap;
+    }
+    Chip8PoolJob* job = &pool->jobs[pool->jobCount];
+    memset(job, 0, sizeof(Chip8PoolJob));
+    job->rom = rom;
+    job->size = size;
+    job->budget = cycles;
+    job->seed = pool->seed;
+    job->quirks = pool->quirks;
+    return pool->jobCount++;
+}
+
+void chip8PoolClear(Chip8Pool* pool) {
+    if (!pool) {
+        return;
+    }
+    for (int i = 0; i < pool->jobCount; i++) {
+        chip8Destroy(pool->jobs[i].vm);
+        free(pool->jobs[i].vm);
+    }
+    pool->jobCount = 0;
+}
+
+void chip8PoolSetSeed(Chip8Pool* pool, uint64_t seed) {
+    if (pool) {
+        pool->seed = seed;
+    }
+}
+
+void chip8PoolSetQuirks(Chip8Pool* pool, int profile) {
+    if (pool && profile >= 0 && profile < C8_QUIRKS_COUNT) {
+        pool->quirks = profile;
+    }
+}
+
+int chip8PoolRun(Chip8Pool* pool) {
+    if (!pool) {
+        return 0;
+    }
+    int pending = 0;
+    for (int i = 0; i < pool->jobCount; i++) {
+        pending += !pool->jobs[i].done;
+    }
+    if (pending == 0) {
+        return 1;
+    }
+
+    long cap = 1;
+    while (cap < pending) {
+        cap <<= 1;
+    }
+    int ok = 1;
+    for (int t = 0; t < pool->threads; t++) {
+        Chip8PoolWorker* w = &pool->workers[t];
+        w->pool = pool;
+        w->id = t;
+        w->victimSeed = 0x9E3779B9U * (uint32_t) (t + 1);
+        w->deque.slots = malloc(cap * sizeof(atomic_int));
+        w->deque.mask = cap - 1;
+        atomic_init(&w->deque.top, 0);
+        atomic_init(&w->deque.bottom, 0);
+        if (!w->deque.slots) {
+            ok = 0;
+        }
+    }
+    if (ok) {
+        /* deal the jobs out like cards, the stealing evens out the rest */
+        int next = 0;
+        for (int i = 0; i < pool->jobCount; i++) {
+            if (!pool->jobs[i].done) {
+                _deque_push(&pool->workers[next].deque, i);
+                next = (next + 1) % pool->threads;
+            }
+        }
+        atomic_store(&pool->remaining, pending);
+
+        /* the calling thread is worker 0 */
+        pthread_t* tids = calloc(pool->threads, sizeof(pthread_t));
+        int started = 1;
+        if (tids) {
+            for (; started < pool->threads; started++) {
+                if (pthread_create(&tids[started], NULL, _worker_main, &pool->workers[started]) != 0) {
+                    break;
+                }
+            }
+        }
+        _worker_main(&pool->workers[0]);
+        for (int t = 1; t < started; t++) {
+            pthread_join(tids[t], NULL);
+        }
+        free(tids);
+    }
+    for (int t = 0; t < pool->threads; t++) {
+        free(pool->workers[t].deque.slots);
+        pool->workers[t].deque.slots = NULL;
+    }
+    return ok;
+}
+
+int chip8PoolJobCount(const Chip8Pool* pool) {
+    return pool ? pool->jobCount : 0;
+}
+
+int chip8PoolThreadCount(const Chip8Pool* pool) {
+    return pool ? pool->threads : 0;
+}
+
+const Chip8PoolResult* chip8PoolGetResult(const Chip8Pool* pool, int job) {
+    if (!pool || job < 0 || job >= pool->jobCount || !pool->jobs[job].done) {
+        return NULL;
+    }
+    return &pool->jobs[job].result;
+}
+
+const Chip8* chip8PoolGetVM(const Chip8Pool* pool, int job) {
+    if (!pool || job < 0 || job >= pool->jobCount) {
+        return NULL;
+    }
+    return pool->jobs[job].vm;
+}
+
+// ----------------------------------------------------------------------
+
+/**
+ * Works through its own deque, steals once that's empty, and leaves when
+ * every job of the run is done (not just when there's nothing to steal,
+ * since another worker might still put a slice back).
+ */
+static void* _worker_main(void* arg) {
+    Chip8PoolWorker* self = arg;
+    Chip8Pool* pool = self->pool;
+    for (;;) {
+        int j = _deque_pop(&self->deque);
+        if (j == C8_POOL_EMPTY) {
+            j = _steal(self);
+        }
+        if (j == C8_POOL_EMPTY) {
+            if (atomic_load(&pool->remaining) == 0) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        if (_run_slice(&pool->jobs[j])) {
+            atomic_fetch_sub(&pool->remaining, 1);
+        } else {
+            _deque_push(&self->deque, j);
+        }
+    }
+    return NULL;
+}
+
+/* runs the next slice of a job, returns 1 once the job is done */
+static int _run_slice(Chip8PoolJob* job) {
+    Chip8PoolResult* res = &job->result;
+    if (!job->vm) {
+        job->vm = calloc(1, sizeof(Chip8));
+        if (!job->vm || !chip8LoadFromArray(job->vm, job->rom, job->size)) {
+            res->err = job->vm ? job->vm->err : C8_ERR_NO_ROM_LOADED;
+            job->done = 1;
+            return 1;
+        }
+        chip8Seed(job->vm, job->seed);
+        chip8SetQuirks(job->vm, job->quirks);
+        res->loaded = 1;
+    }
+
+    Chip8* vm = job->vm;
+    uint64_t left = job->budget - res->cycles;
+    res->cycles += chip8RunFor(vm, left < C8_POOL_SLICE ? left : C8_POOL_SLICE);
+
+    if (res->cycles < job->budget && vm->running) {
+        return 0;
+    }
+    res->err = vm->err;
+    res->stateHash = chip8StateHash(vm);
+    res->screenHash = chip8ScreenHash(vm);
+    job->done = 1;
+    return 1;
+}
+
+/* tries every other worker once, starting from a random one */
+static int _steal(Chip8PoolWorker* self) {
+    int n = self->pool->threads;
+    if (n < 2) {
+        return C8_POOL_EMPTY;
+    }
+    uint32_t r = self->victimSeed;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    self->victimSeed = r;
+
+    int start = (int) (r % (uint32_t) n);
+    for (int i = 0; i < n; i++) {
+        int victim = (start + i) % n;
+        if (victim == self->id) {
+            continue;
+        }
+        int j = _deque_steal(&self->pool->workers[victim].deque);
+        if (j != C8_POOL_EMPTY) {
+            return j;
+        }
+    }
+    return C8_POOL_EMPTY;
+}
+
+static void _deque_push(Chip8PoolDeque* d, int job) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    atomic_store_explicit(&d->slots[b & d->mask], job, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+}
+
+static int _deque_pop(Chip8PoolDeque* d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return C8_POOL_EMPTY;
+    }
+    int job = atomic_load_explicit(&d->slots[b & d->mask], memory_order_relaxed);
+    if (t == b) {
+        /* last one, race the thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                memory_order_seq_cst, memory_order_relaxed)) {
+            job = C8_POOL_EMPTY;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+static int _deque_steal(Chip8PoolDeque* d) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) {
+        return C8_POOL_EMPTY;
+    }
+    int job = atomic_load_explicit(&d->slots[t & d->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return C8_POOL_EMPTY;
+    }
+    return job;
+}
+
+static int _cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+#endif
+}
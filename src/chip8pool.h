@@ -0,0 +1,54 @@
+#ifndef CHIP8POOL_H
+#define CHIP8POOL_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * A pool of VMs run in parallel, for when there are lots of short runs to
+ * get through (ROM validation, searches and the like). Every job gets its
+ * own Chip8 owned by the pool. chip8PoolRun spreads them over the worker
+ * threads, each with its own deque of jobs; a worker that runs out steals
+ * from the others. Long jobs go in slices, so they can be stolen midway.
+ */
+typedef struct Chip8Pool Chip8Pool;
+
+typedef struct Chip8PoolResult {
+    uint64_t cycles;        /* cycles the VM ran */
+    uint64_t stateHash;     /* chip8StateHash of the final state */
+    uint64_t screenHash;    /* chip8ScreenHash of the final screen */
+    int err;                /* the VM's err once it's done */
+    int loaded;             /* 0 when the ROM couldn't be loaded, nothing ran */
+} Chip8PoolResult;
+
+/* threads = 0 picks one per core */
+Chip8Pool* chip8PoolCreate(int threads);
+void chip8PoolDestroy(Chip8Pool* pool);
+
+/**
+ * Queues a run of rom for up to cycles cycles and returns the job's index
+ * (-1 on failure). rom isn't copied, it must stay around until the run is
+ * over.
+ */
+int chip8PoolAdd(Chip8Pool* pool, const uint8_t* rom, size_t size, uint64_t cycles);
+
+/* seed for the random numbers (Cxkk) of the jobs added after it, C8_DEFAULT_SEED unless set */
+void chip8PoolSetSeed(Chip8Pool* pool, uint64_t seed);
+/* same for the quirk profile (C8_QUIRKS_*), C8_QUIRKS_DEFAULT unless set */
+void chip8PoolSetQuirks(Chip8Pool* pool, int profile);
+
+/* runs every queued job that hasn't run yet, returns once they're all done */
+int chip8PoolRun(Chip8Pool* pool);
+
+/* drops every job (and its VM) */
+void chip8PoolClear(Chip8Pool* pool);
+
+int chip8PoolJobCount(const Chip8Pool* pool);
+int chip8PoolThreadCount(const Chip8Pool* pool);
+const Chip8PoolResult* chip8PoolGetResult(const Chip8Pool* pool, int job);
+/* the job's VM, in whatever state the run left it */
+const Chip8* chip8PoolGetVM(const Chip8Pool* pool, int job);
+
+#endif /* CHIP8POOL_H */
@@ -0,0 +1,233 @@
+#include "chip8rewind.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define C8_REWIND_MIN_RUN       4   /* zeros it takes to end a literal run */
+#define C8_REWIND_MAX_RUN       0xFFFF  /* what a run header's u16 counts hold */
+#define C8_REWIND_MAX_DELTA     (2 * C8_STATE_SIZE) /* worst case for _pack_delta */
+
+typedef struct Chip8RewindFrame {
+    uint32_t off;           /* where the frame's delta starts in data */
+    uint32_t size;
+} Chip8RewindFrame;
+
+/**
+ * data is a ring of deltas, oldest at frames[first]. A delta that doesn't
+ * fit before the end of data goes back to the start instead, the leftover
+ * bytes at the end just sit unused until the ring comes around again.
+ */
+struct Chip8Rewind {
+    uint8_t* data;
+    size_t dataCap;
+    size_t tail;            /* where the next delta goes */
+    Chip8RewindFrame* frames;
+    int frameCap;
+    int first;
+    int count;
+    int hasCurrent;
+    uint8_t current[C8_STATE_SIZE];         /* the newest frame, whole */
+    uint8_t scratch[C8_STATE_SIZE];
+    uint8_t delta[C8_REWIND_MAX_DELTA];
+};
+
+static size_t _pack_delta(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out);
+static uint8_t* _put_run(uint8_t* p, size_t skip, size_t len);
+static void _apply_delta(uint8_t* state, const uint8_t* delta, size_t size);
+static int _reserve(Chip8Rewind* rw, size_t size, size_t* off);
+static void _drop_oldest(Chip8Rewind* rw);
+
+Chip8Rewind* chip8RewindCreate(size_t bytes) {
+    if (bytes < sizeof(Chip8Rewind)) {
+        return NULL;
+    }
+    /* deltas tend to be a few dozen bytes, so a quarter goes to the frame index */
+    size_t left = bytes - sizeof(Chip8Rewind);
+    int frameCap = (int) (left / 4 / sizeof(Chip8RewindFrame));
+    size_t dataCap = left - frameCap * sizeof(Chip8RewindFrame);
+    if (frameCap < 1 || dataCap < C8_REWIND_MAX_DELTA || dataCap > UINT32_MAX) {
+        return NULL;
+    }
+
+    Chip8Rewind* rw = calloc(1, sizeof(Chip8Rewind));
+    if (!rw) {
+        return NULL;
+    }
+    rw->data = malloc(dataCap);
+    rw->frames = malloc(frameCap * sizeof(Chip8RewindFrame));
+    if (!rw->data || !rw->frames) {
+        chip8RewindDestroy(rw);
+        return NULL;
+    }
+    rw->dataCap = dataCap;
+    rw->frameCap = frameCap;
+    return rw;
+}
+
+void chip8RewindDestroy(Chip8Rewind* rw) {
+    if (!rw) {
+        return;
+    }
+    free(rw->data);
+    free(rw->frames);
+    free(rw);
+}
+
+int chip8RewindPush(Chip8Rewind* rw, const Chip8* chip8) {
+    if (!rw || !chip8SaveState(chip8, rw->scratch, C8_STATE_SIZE)) {
+        return 0;
+    }
+    if (!rw->hasCurrent) {
+        memcpy(rw->current, rw->scratch, C8_STATE_SIZE);
+        rw->hasCurrent = 1;
+        return 1;
+    }
+
+    /* the delta takes the new frame back to the one that was newest until now */
+    size_t size = _pack_delta(rw->current, rw->scratch, C8_STATE_SIZE, rw->delta);
+    size_t off = 0;
+    if (!_reserve(rw, size, &off)) {
+        return 0;
+    }
+    memcpy(rw->data + off, rw->delta, size);
+    Chip8RewindFrame* frame = &rw->frames[(rw->first + rw->count) % rw->frameCap];
+    frame->off = (uint32_t) off;
+    frame->size = (uint32_t) size;
+    rw->count++;
+    rw->tail = off + size;
+    memcpy(rw->current, rw->scratch, C8_STATE_SIZE);
+    return 1;
+}
+
+int chip8RewindStep(Chip8Rewind* rw, Chip8* chip8) {
+    if (!rw || !chip8 || rw->count == 0) {
+        return 0;
+    }
+    Chip8RewindFrame* frame = &rw->frames[(rw->first + rw->count - 1) % rw->frameCap];
+    _apply_delta(rw->current, rw->data + frame->off, frame->size);
+    rw->count--;
+    rw->tail = rw->count ? frame->off : 0;
+    return chip8LoadState(chip8, rw->current, C8_STATE_SIZE);
+}
+
+void chip8RewindClear(Chip8Rewind* rw) {
+    if (!rw) {
+        return;
+    }
+    rw->first = 0;
+    rw->count = 0;
+    rw->tail = 0;
+    rw->hasCurrent = 0;
+}
+
+int chip8RewindFrames(const Chip8Rewind* rw) {
+    return rw ? rw->count : 0;
+}
+
+// ----------------------------------------------------------------------
+
+/**
+ * Packs a ^ b as runs: a u16 count of bytes that didn't change, a u16
+ * count of bytes that did, then those XORed bytes. Trailing unchanged
+ * bytes are left out. A literal only ends at C8_REWIND_MIN_RUN zeros, so
+ * a run header always pays for itself and out never needs more than
+ * twice the state. The XO-CHIP state is way past 64k, so longer skips and
+ * literals get split into runs of at most C8_REWIND_MAX_RUN.
+ */
+static size_t _pack_delta(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out) {
+    uint8_t* p = out;
+    size_t i = 0;
+    while (i < size) {
+        size_t start = i;
+        while (i < size && a[i] == b[i]) {
+            i++;
+        }
+        if (i == size) {
+            break;
+        }
+        size_t skip = i - start;
+        while (skip > C8_REWIND_MAX_RUN) {
+            p = _put_run(p, C8_REWIND_MAX_RUN, 0);
+            skip -= C8_REWIND_MAX_RUN;
+        }
+        size_t litStart = i;
+        size_t zeros = 0;
+        while (i < size && zeros < C8_REWIND_MIN_RUN && i - litStart < C8_REWIND_MAX_RUN) {
+            zeros = a[i] == b[i] ? zeros + 1 : 0;
+            i++;
+        }
+        i -= zeros;
+        p = _put_run(p, skip, i - litStart);
+        for (size_t k = litStart; k < i; k++) {
+            *p++ = a[k] ^ b[k];
+        }
+    }
+    return (size_t) (p - out);
+}
+
+static uint8_t* _put_run(uint8_t* p, size_t skip, size_t len) {
+    p[0] = (uint8_t) skip;
+    p[1] = (uint8_t) (skip >> 8);
+    p[2] = (uint8_t) len;
+    p[3] = (uint8_t) (len >> 8);
+    return p + 4;
+}
+
+static void _apply_delta(uint8_t* state, const uint8_t* delta, size_t size) {
+    const uint8_t* end = delta + size;
+    size_t pos = 0;
+    while (delta < end) {
+        size_t skip = delta[0] | (delta[1] << 8);
+        size_t len = delta[2] | (delta[3] << 8);
+        delta += 4;
+        pos += skip;
+        for (size_t k = 0; k < len; k++) {
+            state[pos++] ^= *delta++;
+        }
+    }
+}
+
+/**
+ * Finds room for size bytes, dropping the oldest frames until there is.
+ * The live deltas are data[head, tail), or data[head, end) plus
+ * data[0, tail) once the ring wrapped, in which case tail < head.
+ */
+static int _reserve(Chip8Rewind* rw, size_t size, size_t* off) {
+    if (size > rw->dataCap) {
+        return 0;
+    }
+    if (rw->count == rw->frameCap) {
+        _drop_oldest(rw);
+    }
+    for (;;) {
+        if (rw->count == 0) {
+            *off = 0;
+            return 1;
+        }
+        size_t head = rw->frames[rw->first].off;
+        if (rw->tail >= head) {
+            if (rw->tail + size <= rw->dataCap) {
+                *off = rw->tail;
+                return 1;
+            }
+            if (size < head) {
+                *off = 0;
+                return 1;
+            }
+        } else if (rw->tail + size < head) {
+            *off = rw->tail;
+            return 1;
+        }
+        _drop_oldest(rw);
+    }
+}
+
+static void _drop_oldest(Chip8Rewind* rw) {
+    rw->first = (rw->first + 1) % rw->frameCap;
+    rw->count--;
+    if (rw->count == 0) {
+        rw->first = 0;
+        rw->tail = 0;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef CHIP8REWIND_H
+#define CHIP8REWIND_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define C8_REWIND_DEFAULT_BYTES     (4U << 20)  /* several minutes of most games at 60 fps */
+
+/**
+ * A rewind buffer. Push the VM once per frame and step back through the
+ * frames later. Only the newest frame is kept whole; every older one is
+ * stored as the RLE-packed XOR of its save state against the frame after
+ * it, so a frame where just a few registers moved costs a few bytes.
+ * Stepping back undoes one delta, pushing packs one. When the buffer is
+ * full the oldest frames go.
+ */
+typedef struct Chip8Rewind Chip8Rewind;
+
+/* bytes caps everything the buffer allocates */
+Chip8Rewind* chip8RewindCreate(size_t bytes);
+void chip8RewindDestroy(Chip8Rewind* rw);
+
+/* records the VM's current state as the newest frame */
+int chip8RewindPush(Chip8Rewind* rw, const Chip8* chip8);
+/**
+ * Puts the VM back to the frame before the newest one, which then becomes
+ * the newest. Returns 0 when there's nothing older left.
+ */
+int chip8RewindStep(Chip8Rewind* rw, Chip8* chip8);
+/* forgets every frame, say after loading another ROM */
+void chip8RewindClear(Chip8Rewind* rw);
+
+/* how many times chip8RewindStep can go back right now */
+int chip8RewindFrames(const Chip8Rewind* rw);
+
+#endif /* CHIP8REWIND_H */
@@ -0,0 +1,376 @@
+#include "chip8romcache.h"
+#include "chip8ops.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define C8_ROMCACHE_MIN_TABLE   64
+#define C8_ROMCACHE_EMPTY       (-1)
+
+typedef struct Chip8RomCachePath {
+    char* path;
+    uint64_t hash;          /* of the path, not the ROM */
+    int rom;
+} Chip8RomCachePath;
+
+/**
+ * byHash and byPath are open-addressed (linear probing) indices into roms
+ * and paths. They share tableCap, a power of two kept over twice the
+ * bigger of the two counts.
+ */
+struct Chip8RomCache {
+    Chip8Rom** roms;
+    int count;
+    int cap;
+    Chip8RomCachePath* paths;
+    int pathCount;
+    int pathCap;
+    int* byHash;
+    int* byPath;
+    int tableCap;
+};
+
+static int _add(Chip8RomCache* cache, const uint8_t* data, size_t size, const char* path);
+static int _add_path(Chip8RomCache* cache, const char* path, uint64_t hash, int rom);
+static int _find_path(const Chip8RomCache* cache, const char* path, uint64_t hash);
+static int _reserve(Chip8RomCache* cache);
+static const uint8_t* _map_file(const char* path, size_t* size);
+static void _unmap_file(const uint8_t* data, size_t size);
+static int _compare_names(const void* a, const void* b);
+static char* _copy_string(const char* s);
+
+Chip8RomCache* chip8RomCacheCreate(void) {
+    return calloc(1, sizeof(Chip8RomCache));
+}
+
+void chip8RomCacheDestroy(Chip8RomCache* cache) {
+    if (!cache) {
+        return;
+    }
+    for (int i = 0; i < cache->count; i++) {
+        free((char*) cache->roms[i]->path);
+        free(cache->roms[i]);
+    }
+    for (int i = 0; i < cache->pathCount; i++) {
+        free(cache->paths[i].path);
+    }
+    free(cache->roms);
+    free(cache->paths);
+    free(cache->byHash);
+    free(cache->byPath);
+    free(cache);
+}
+
+const Chip8Rom* chip8RomCacheLoad(Chip8RomCache* cache, const char* path) {
+    if (!cache || !path) {
+        return NULL;
+    }
+    uint64_t hash = chip8Fnv1a(C8_FNV_OFFSET, path, strlen(path));
+    int known = _find_path(cache, path, hash);
+    if (known != C8_ROMCACHE_EMPTY) {
+        return cache->roms[cache->paths[known].rom];
+    }
+
+    size_t size = 0;
+    const uint8_t* data = _map_file(path, &size);
+    if (!data) {
+        return NULL;
+    }
+    int rom = _add(cache, data, size, path);
+    _unmap_file(data, size);
+    if (rom == C8_ROMCACHE_EMPTY || !_add_path(cache, path, hash, rom)) {
+        return NULL;
+    }
+    return cache->roms[rom];
+}
+
+const Chip8Rom* chip8RomCacheAdd(Chip8RomCache* cache, const uint8_t* data, size_t size) {
+    if (!cache || !data || size == 0 || size > C8_MAX_ROM_SIZE) {
+        return NULL;
+    }
+    int rom = _add(cache, data, size, NULL);
+    return rom == C8_ROMCACHE_EMPTY ? NULL : cache->roms[rom];
+}
+
+int chip8RomCacheLoadDir(Chip8RomCache* cache, const char* dir) {
+    if (!cache || !dir) {
+        return -1;
+    }
+    DIR* d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+    char** names = NULL;
+    int count = 0, cap = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            char** grown = realloc(names, cap * sizeof(char*));
+            if (!grown) {
+                break;
+            }
+            names = grown;
+        }
+        names[count] = _copy_string(entry->d_name);
+        if (names[count]) {
+            count++;
+        }
+    }
+    closedir(d);
+    if (count > 1) {
+        qsort(names, count, sizeof(char*), _compare_names);
+    }
+
+    size_t dirLen = strlen(dir);
+    int sep = dirLen > 0 && dir[dirLen - 1] != '/' && dir[dirLen - 1] != '\\';
+    int loaded = 0;
+    for (int i = 0; i < count; i++) {
+        size_t nameLen = strlen(names[i]);
+        char* path = malloc(dirLen + sep + nameLen + 1);
+        if (path) {
+            memcpy(path, dir, dirLen);
+            path[dirLen] = '/';
+            memcpy(path + dirLen + sep, names[i], nameLen + 1);
+            if (chip8RomCacheLoad(cache, path)) {
+                loaded++;
+            }
+            free(path);
+        }
+        free(names[i]);
+    }
+    free(names);
+    return loaded;
+}
+
+const Chip8Rom* chip8RomCacheFind(const Chip8RomCache* cache, uint64_t hash) {
+    if (!cache || cache->tableCap == 0) {
+        return NULL;
+    }
+    uint32_t mask = (uint32_t) cache->tableCap - 1;
+    for (uint32_t slot = (uint32_t) hash & mask; cache->byHash[slot] != C8_ROMCACHE_EMPTY; slot = (slot + 1) & mask) {
+        if (cache->roms[cache->byHash[slot]]->hash == hash) {
+            return cache->roms[cache->byHash[slot]];
+        }
+    }
+    return NULL;
+}
+
+int chip8RomCacheCount(const Chip8RomCache* cache) {
+    return cache ? cache->count : 0;
+}
+
+const Chip8Rom* chip8RomCacheGet(const Chip8RomCache* cache, int index) {
+    if (!cache || index < 0 || index >= cache->count) {
+        return NULL;
+    }
+    return cache->roms[index];
+}
+
+int chip8LoadCachedRom(Chip8* chip8, const Chip8Rom* rom) {
+    if (!rom) {
+        return 0;
+    }
+    return chip8LoadFromArray(chip8, rom->data, rom->size);
+}
+
+// ----------------------------------------------------------------------
+
+/* returns the image's index, an existing one if the same bytes are already in */
+static int _add(Chip8RomCache* cache, const uint8_t* data, size_t size, const char* path) {
+    uint64_t hash = chip8Fnv1a(C8_FNV_OFFSET, data, size);
+    if (!_reserve(cache)) {
+        return C8_ROMCACHE_EMPTY;
+    }
+    uint32_t mask = (uint32_t) cache->tableCap - 1;
+    uint32_t slot = (uint32_t) hash & mask;
+    for (; cache->byHash[slot] != C8_ROMCACHE_EMPTY; slot = (slot + 1) & mask) {
+        const Chip8Rom* rom = cache->roms[cache->byHash[slot]];
+        if (rom->hash == hash && rom->size == size && memcmp(rom->data, data, size) == 0) {
+            return cache->byHash[slot];
+        }
+    }
+
+    if (cache->count == cache->cap) {
+        int cap = cache->cap ? cache->cap * 2 : 64;
+        Chip8Rom** roms = realloc(cache->roms, cap * sizeof(Chip8Rom*));
+        if (!roms) {
+            return C8_ROMCACHE_EMPTY;
+        }
+        cache->roms = roms;
+        cache->cap = cap;
+    }
+    Chip8Rom* rom = malloc(sizeof(Chip8Rom) + size);
+    if (!rom) {
+        return C8_ROMCACHE_EMPTY;
+    }
+    rom->hash = hash;
+    rom->size = size;
+    rom->path = path ? _copy_string(path) : NULL;
+    memcpy(rom->data, data, size);
+    cache->roms[cache->count] = rom;
+    cache->byHash[slot] = cache->count;
+    return cache->count++;
+}
+
+static int _add_path(Chip8RomCache* cache, const char* path, uint64_t hash, int rom) {
+    if (!_reserve(cache)) {
+        return 0;
+    }
+    if (cache->pathCount == cache->pathCap) {
+        int cap = cache->pathCap ? cache->pathCap * 2 : 64;
+        Chip8RomCachePath* paths = realloc(cache->paths, cap * sizeof(Chip8RomCachePath));
+        if (!paths) {
+            return 0;
+        }
+        cache->paths = paths;
+        cache->pathCap = cap;
+    }
+    Chip8RomCachePath* entry = &cache->paths[cache->pathCount];
+    entry->path = _copy_string(path);
+    if (!entry->path) {
+        return 0;
+    }
+    entry->hash = hash;
+    entry->rom = rom;
+    uint32_t mask = (uint32_t) cache->tableCap - 1;
+    uint32_t slot = (uint32_t) hash & mask;
+    while (cache->byPath[slot] != C8_ROMCACHE_EMPTY) {
+        slot = (slot + 1) & mask;
+    }
+    cache->byPath[slot] = cache->pathCount++;
+    return 1;
+}
+
+static int _find_path(const Chip8RomCache* cache, const char* path, uint64_t hash) {
+    if (cache->tableCap == 0) {
+        return C8_ROMCACHE_EMPTY;
+    }
+    uint32_t mask = (uint32_t) cache->tableCap - 1;
+    for (uint32_t slot = (uint32_t) hash & mask; cache->byPath[slot] != C8_ROMCACHE_EMPTY; slot = (slot + 1) & mask) {
+        const Chip8RomCachePath* entry = &cache->paths[cache->byPath[slot]];
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+            return cache->byPath[slot];
+        }
+    }
+    return C8_ROMCACHE_EMPTY;
+}
+
+/* makes sure one more image and one more path fit, rebuilding both indices when they grow */
+static int _reserve(Chip8RomCache* cache) {
+    int most = cache->count > cache->pathCount ? cache->count : cache->pathCount;
+    if ((most + 1) * 2 <= cache->tableCap) {
+        return 1;
+    }
+    int cap = cache->tableCap ? cache->tableCap * 2 : C8_ROMCACHE_MIN_TABLE;
+    int* byHash = malloc(cap * sizeof(int));
+    int* byPath = malloc(cap * sizeof(int));
+    if (!byHash || !byPath) {
+        free(byHash);
+        free(byPath);
+        return 0;
+    }
+    uint32_t mask = (uint32_t) cap - 1;
+    for (int i = 0; i < cap; i++) {
+        byHash[i] = C8_ROMCACHE_EMPTY;
+        byPath[i] = C8_ROMCACHE_EMPTY;
+    }
+    for (int i = 0; i < cache->count; i++) {
+        uint32_t slot = (uint32_t) cache->roms[i]->hash & mask;
+        while (byHash[slot] != C8_ROMCACHE_EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        byHash[slot] = i;
+    }
+    for (int i = 0; i < cache->pathCount; i++) {
+        uint32_t slot = (uint32_t) cache->paths[i].hash & mask;
+        while (byPath[slot] != C8_ROMCACHE_EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        byPath[slot] = i;
+    }
+    free(cache->byHash);
+    free(cache->byPath);
+    cache->byHash = byHash;
+    cache->byPath = byPath;
+    cache->tableCap = cap;
+    return 1;
+}
+
+/* maps a regular file read-only, if it's a size a ROM can be */
+static const uint8_t* _map_file(const char* path, size_t* size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    LARGE_INTEGER len;
+    if (!GetFileSizeEx(file, &len) || len.QuadPart <= 0 || len.QuadPart > C8_MAX_ROM_SIZE) {
+        CloseHandle(file);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        return NULL;
+    }
+    /* the view keeps the mapping alive on its own */
+    const uint8_t* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    *size = (size_t) len.QuadPart;
+    return data;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > C8_MAX_ROM_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    *size = (size_t) st.st_size;
+    return data;
+#endif
+}
+
+static void _unmap_file(const uint8_t* data, size_t size) {
+#ifdef _WIN32
+    (void) size;
+    UnmapViewOfFile(data);
+#else
+    munmap((void*) data, size);
+#endif
+}
+
+static int _compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static char* _copy_string(const char* s) {
+    size_t len = strlen(s) + 1;
+    char* copy = malloc(len);
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
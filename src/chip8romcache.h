@@ -0,0 +1,49 @@
+#ifndef CHIP8ROMCACHE_H
+#define CHIP8ROMCACHE_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * ROM images kept in memory, indexed by a hash of their contents (and by
+ * the paths they were loaded from). Files are mapped, checked and copied
+ * in once; after that, putting a VM back on a ROM is chip8Init and a
+ * memcpy, without touching the file system. Identical ROMs under
+ * different names share one image. The cache doesn't notice files
+ * changing on disk once they're in.
+ */
+typedef struct Chip8RomCache Chip8RomCache;
+
+typedef struct Chip8Rom {
+    uint64_t hash;          /* 64-bit FNV-1a of the image */
+    size_t size;
+    const char* path;       /* the first file it was loaded from, NULL if it came from memory */
+    uint8_t data[];
+} Chip8Rom;
+
+Chip8RomCache* chip8RomCacheCreate(void);
+/* frees every image too, so no Chip8Rom may be used after it */
+void chip8RomCacheDestroy(Chip8RomCache* cache);
+
+/* a path that's already in only costs a lookup. NULL if the file can't be read or won't fit */
+const Chip8Rom* chip8RomCacheLoad(Chip8RomCache* cache, const char* path);
+/* same, from memory. data is copied */
+const Chip8Rom* chip8RomCacheAdd(Chip8RomCache* cache, const uint8_t* data, size_t size);
+/**
+ * Loads every file in dir (not its subdirectories), in name order, and
+ * returns how many were ROMs. Files that aren't are skipped. -1 when dir
+ * can't be opened as a directory.
+ */
+int chip8RomCacheLoadDir(Chip8RomCache* cache, const char* dir);
+
+const Chip8Rom* chip8RomCacheFind(const Chip8RomCache* cache, uint64_t hash);
+/* every distinct image, in the order they came in */
+int chip8RomCacheCount(const Chip8RomCache* cache);
+const Chip8Rom* chip8RomCacheGet(const Chip8RomCache* cache, int index);
+
+/* chip8LoadRom for a cached image: resets the VM and copies the ROM in */
+int chip8LoadCachedRom(Chip8* chip8, const Chip8Rom* rom);
+
+#endif /* CHIP8ROMCACHE_H */
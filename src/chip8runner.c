@@ -0,0 +1,360 @@
+#include "chip8runner.h"
+#include "chip8ops.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define C8_RUNNER_FRESH         4           /* set on middle when it holds an unread frame */
+#define C8_RUNNER_SLICE         0.001       /* seconds slept between slices when not in turbo */
+#define C8_RUNNER_TURBO_CHUNK   4096        /* cycles per slice in turbo */
+#define C8_RUNNER_MAX_BEHIND    0.25        /* longer stalls aren't caught up on */
+#define C8_RUNNER_FRAME_TIME    (1.0 / 60)  /* how often rewind snapshots (and steps back) */
+#define C8_RUNNER_STATS_PERIOD  0.5
+#define C8_RUNNER_SOUND_TRIES   4           /* reads of a sound state that keep getting torn before giving up */
+
+/**
+ * The triple buffer: the thread draws into frames[back], then swaps it
+ * with middle; the reader swaps middle with frames[front] when it's fresh.
+ * Nobody ever waits, and the reader always gets the newest whole frame.
+ */
+struct Chip8Runner {
+    Chip8* vm;
+    Chip8Movie* movie;
+    Chip8Rewind* rewind;
+    pthread_t thread;
+    int started;
+
+    atomic_int quit;
+    atomic_uint keys;
+    atomic_int rewinding;
+    atomic_int turbo;
+    atomic_uint clockWanted;        /* what the display side asked for */
+    atomic_uint clock;              /* what the VM runs at */
+    atomic_uint_least64_t ips;
+
+    Chip8RunnerFrame frames[3];
+    atomic_int middle;
+    int back;                       /* the runner thread's */
+    int front;                      /* the reader's */
+
+    /**
+     * The sound state, behind a sequence count: odd while the runner is
+     * writing it, so readers can tell a torn read and retry instead of
+     * locking. Everything is atomic (relaxed) so the retries are race free.
+     */
+    atomic_uint soundSeq;
+    atomic_uint_least64_t soundBits;        /* on, patterned, pitch */
+    atomic_uint_least64_t soundPattern[2];
+    atomic_uint_least64_t soundChangedAt;
+    Chip8RunnerSound sound;                 /* the runner thread's copy of what it last published */
+};
+
+static void* _runner_main(void* arg);
+static void _publish(Chip8Runner* r);
+static void _publish_sound(Chip8Runner* r, int silent);
+
+Chip8Runner* chip8RunnerCreate(Chip8* chip8, Chip8Movie* movie, Chip8Rewind* rewind) {
+    if (!chip8) {
+        return NULL;
+    }
+    Chip8Runner* r = calloc(1, sizeof(Chip8Runner));
+    if (!r) {
+        return NULL;
+    }
+    r->vm = chip8;
+    r->movie = movie;
+    r->rewind = rewind;
+    uint32_t hz = chip8GetClockSpeed(chip8);
+    atomic_init(&r->quit, 0);
+    atomic_init(&r->keys, 0);
+    atomic_init(&r->rewinding, 0);
+    atomic_init(&r->turbo, 0);
+    atomic_init(&r->clockWanted, hz);
+    atomic_init(&r->clock, hz);
+    atomic_init(&r->ips, 0);
+    /* every slot starts out as the current screen, so the reader has something right away */
+    for (int i = 0; i < 3; i++) {
+        memcpy(r->frames[i].gfx, chip8->gfx, sizeof(chip8->gfx));
+        r->frames[i].hires = chip8->hires;
+        r->frames[i].running = chip8->running;
+    }
+    r->back = 0;
+    atomic_init(&r->middle, 1);
+    r->front = 2;
+    atomic_init(&r->soundSeq, 0);
+    atomic_init(&r->soundBits, 0);
+    atomic_init(&r->soundPattern[0], 0);
+    atomic_init(&r->soundPattern[1], 0);
+    r->sound.changedAt = chip8RunnerTime();
+    atomic_init(&r->soundChangedAt, r->sound.changedAt);
+    return r;
+}
+
+void chip8RunnerDestroy(Chip8Runner* runner) {
+    if (!runner) {
+        return;
+    }
+    chip8RunnerStop(runner);
+    free(runner);
+}
+
+int chip8RunnerStart(Chip8Runner* runner) {
+    if (!runner || runner->started) {
+        return 0;
+    }
+    atomic_store(&runner->quit, 0);
+    if (pthread_create(&runner->thread, NULL, _runner_main, runner) != 0) {
+        return 0;
+    }
+    runner->started = 1;
+    return 1;
+}
+
+void chip8RunnerStop(Chip8Runner* runner) {
+    if (!runner || !runner->started) {
+        return;
+    }
+    atomic_store(&runner->quit, 1);
+    pthread_join(runner->thread, NULL);
+    runner->started = 0;
+}
+
+void chip8RunnerSetKeys(Chip8Runner* runner, uint16_t keysMask) {
+    if (runner) {
+        atomic_store_explicit(&runner->keys, keysMask, memory_order_relaxed);
+    }
+}
+
+void chip8RunnerSetRewinding(Chip8Runner* runner, int rewinding) {
+    if (runner) {
+        atomic_store_explicit(&runner->rewinding, rewinding, memory_order_relaxed);
+    }
+}
+
+void chip8RunnerSetTurbo(Chip8Runner* runner, int turbo) {
+    if (runner) {
+        atomic_store_explicit(&runner->turbo, turbo, memory_order_relaxed);
+    }
+}
+
+void chip8RunnerSetClockSpeed(Chip8Runner* runner, uint32_t hz) {
+    if (runner) {
+        atomic_store_explicit(&runner->clockWanted, hz, memory_order_relaxed);
+    }
+}
+
+uint32_t chip8RunnerGetClockSpeed(const Chip8Runner* runner) {
+    return runner ? atomic_load_explicit(&runner->clock, memory_order_relaxed) : 0;
+}
+
+int chip8RunnerGetTurbo(const Chip8Runner* runner) {
+    return runner ? atomic_load_explicit(&runner->turbo, memory_order_relaxed) : 0;
+}
+
+uint64_t chip8RunnerGetIps(const Chip8Runner* runner) {
+    return runner ? atomic_load_explicit(&runner->ips, memory_order_relaxed) : 0;
+}
+
+int chip8RunnerAcquireFrame(Chip8Runner* runner, const Chip8RunnerFrame** frame) {
+    if (!runner || !frame) {
+        return 0;
+    }
+    int fresh = 0;
+    if (atomic_load_explicit(&runner->middle, memory_order_relaxed) & C8_RUNNER_FRESH) {
+        int old = atomic_exchange_explicit(&runner->middle, runner->front, memory_order_acq_rel);
+        runner->front = old & ~C8_RUNNER_FRESH;
+        fresh = 1;
+    }
+    *frame = &runner->frames[runner->front];
+    return fresh;
+}
+
+int chip8RunnerGetSound(const Chip8Runner* runner, Chip8RunnerSound* sound) {
+    if (!runner || !sound) {
+        return 0;
+    }
+    const Chip8Runner* r = runner;
+    for (int i = 0; i < C8_RUNNER_SOUND_TRIES; i++) {
+        unsigned seq = atomic_load_explicit(&r->soundSeq, memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        uint64_t bits = atomic_load_explicit(&r->soundBits, memory_order_relaxed);
+        uint64_t hi = atomic_load_explicit(&r->soundPattern[0], memory_order_relaxed);
+        uint64_t lo = atomic_load_explicit(&r->soundPattern[1], memory_order_relaxed);
+        uint64_t changedAt = atomic_load_explicit(&r->soundChangedAt, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&r->soundSeq, memory_order_relaxed) != seq) {
+            continue;
+        }
+        sound->on = (uint8_t) bits;
+        sound->patterned = (uint8_t) (bits >> 8);
+        sound->pitch = (uint8_t) (bits >> 16);
+        for (int k = 0; k < 8; k++) {
+            sound->pattern[k] = (uint8_t) (hi >> (56 - 8 * k));
+            sound->pattern[8 + k] = (uint8_t) (lo >> (56 - 8 * k));
+        }
+        sound->changedAt = changedAt;
+        return 1;
+    }
+    return 0;
+}
+
+uint64_t chip8RunnerTime(void) {
+    return (uint64_t) (chip8NowSeconds() * 1e9);
+}
+
+double chip8NowSeconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void chip8SleepSeconds(double s) {
+#ifdef _WIN32
+    Sleep((DWORD) (s * 1000));
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t) s;
+    ts.tv_nsec = (long) ((s - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+#endif
+}
+
+// ----------------------------------------------------------------------
+
+/**
+ * Slices of about a millisecond: whatever cycles the clock says are owed
+ * since the last slice (fractions carry over), or a fixed chunk in turbo.
+ * Rewinding snapshots and steps back on wall time, 60 times a second.
+ */
+static void* _runner_main(void* arg) {
+    Chip8Runner* r = arg;
+    Chip8* vm = r->vm;
+    double last = chip8NowSeconds();
+    double nextFrame = last + C8_RUNNER_FRAME_TIME;
+    double statsStart = last;
+    uint64_t statsCycles = 0;
+    double owed = 0;
+    uint8_t published = vm->running;
+
+    while (!atomic_load_explicit(&r->quit, memory_order_relaxed)) {
+        double now = chip8NowSeconds();
+        double elapsed = now - last;
+        last = now;
+
+        uint32_t hz = atomic_load_explicit(&r->clockWanted, memory_order_relaxed);
+        if (!r->movie && hz != chip8GetClockSpeed(vm)) {
+            chip8SetClockSpeed(vm, hz);
+            atomic_store_explicit(&r->clock, chip8GetClockSpeed(vm), memory_order_relaxed);
+        }
+
+        if (atomic_load_explicit(&r->rewinding, memory_order_relaxed) && r->rewind && !r->movie) {
+            if (now >= nextFrame) {
+                if (chip8RewindStep(r->rewind, vm)) {
+                    _publish(r);
+                }
+                nextFrame = now + C8_RUNNER_FRAME_TIME;
+            }
+            _publish_sound(r, 1);
+            owed = 0;
+            chip8SleepSeconds(C8_RUNNER_SLICE);
+            continue;
+        }
+
+        uint16_t keys = (uint16_t) atomic_load_explicit(&r->keys, memory_order_relaxed);
+        chip8MoviePressKeys(r->movie, vm, keys);
+        int turbo = atomic_load_explicit(&r->turbo, memory_order_relaxed);
+        uint32_t ran;
+        if (turbo) {
+            ran = (uint32_t) chip8RunFor(vm, C8_RUNNER_TURBO_CHUNK);
+            owed = 0;
+        } else {
+            owed += (elapsed < C8_RUNNER_MAX_BEHIND ? elapsed : C8_RUNNER_MAX_BEHIND) * chip8GetClockSpeed(vm);
+            uint32_t cycles = (uint32_t) owed;
+            owed -= cycles;
+            ran = (uint32_t) chip8RunFor(vm, cycles);
+        }
+        statsCycles += ran;
+
+        if (vm->drawFlag || vm->running != published) {
+            _publish(r);
+            vm->drawFlag = 0;
+            published = vm->running;
+        }
+        _publish_sound(r, 0);
+        if (now >= nextFrame) {
+            chip8RewindPush(r->rewind, vm);
+            nextFrame += C8_RUNNER_FRAME_TIME;
+            if (nextFrame < now) {
+                nextFrame = now + C8_RUNNER_FRAME_TIME;
+            }
+        }
+        if (now - statsStart >= C8_RUNNER_STATS_PERIOD) {
+            atomic_store_explicit(&r->ips, (uint64_t) (statsCycles / (now - statsStart)), memory_order_relaxed);
+            statsCycles = 0;
+            statsStart = now;
+        }
+        if (!turbo || ran == 0) {
+            chip8SleepSeconds(C8_RUNNER_SLICE);
+        }
+    }
+    return NULL;
+}
+
+static void _publish(Chip8Runner* r) {
+    Chip8RunnerFrame* f = &r->frames[r->back];
+    memcpy(f->gfx, r->vm->gfx, sizeof(f->gfx));
+    f->hires = r->vm->hires;
+    f->running = r->vm->running;
+    int old = atomic_exchange_explicit(&r->middle, r->back | C8_RUNNER_FRESH, memory_order_acq_rel);
+    r->back = old & ~C8_RUNNER_FRESH;
+}
+
+/* only writes when something changed, which is rarely */
+static void _publish_sound(Chip8Runner* r, int silent) {
+    Chip8* vm = r->vm;
+    Chip8RunnerSound s = r->sound;
+    s.on = !silent && vm->running && vm->soundTimer > 0;
+    s.patterned = (chip8QuirksFlags(vm->quirks) & C8_QUIRK_XOCHIP_OPS) != 0;
+    s.pitch = vm->pitch;
+    memcpy(s.pattern, vm->audio, sizeof(s.pattern));
+    if (s.on == r->sound.on && s.patterned == r->sound.patterned && s.pitch == r->sound.pitch
+            && memcmp(s.pattern, r->sound.pattern, sizeof(s.pattern)) == 0) {
+        return;
+    }
+    if (s.on != r->sound.on) {
+        s.changedAt = chip8RunnerTime();
+    }
+    r->sound = s;
+
+    uint64_t hi = 0, lo = 0;
+    for (int k = 0; k < 8; k++) {
+        hi = hi << 8 | s.pattern[k];
+        lo = lo << 8 | s.pattern[8 + k];
+    }
+    unsigned seq = atomic_load_explicit(&r->soundSeq, memory_order_relaxed);
+    atomic_store_explicit(&r->soundSeq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&r->soundBits, s.on | (uint64_t) s.patterned << 8 | (uint64_t) s.pitch << 16, memory_order_relaxed);
+    atomic_store_explicit(&r->soundPattern[0], hi, memory_order_relaxed);
+    atomic_store_explicit(&r->soundPattern[1], lo, memory_order_relaxed);
+    atomic_store_explicit(&r->soundChangedAt, s.changedAt, memory_order_relaxed);
+    atomic_store_explicit(&r->soundSeq, seq + 2, memory_order_release);
+}
+
@@ -0,0 +1,78 @@
+#ifndef CHIP8RUNNER_H
+#define CHIP8RUNNER_H
+
+#include "chip8.h"
+#include "chip8movie.h"
+#include "chip8rewind.h"
+
+#include <stdint.h>
+
+/**
+ * Runs a VM on a thread of its own, paced to its clock speed (or flat out
+ * in turbo), so the display thread never holds it up and the other way
+ * around. While it runs the VM belongs to the runner: the display side
+ * only hands it keys and settings, and gets finished screens back through
+ * a lock-free triple buffer.
+ */
+typedef struct Chip8Runner Chip8Runner;
+
+/* a published screen */
+typedef struct Chip8RunnerFrame {
+    uint64_t gfx[C8_PLANES][C8_ROW_WORDS][C8_HIRES_HEIGHT];  /* laid out like Chip8's */
+    uint8_t hires;
+    uint8_t running;                /* the VM's running flag when the frame was taken */
+} Chip8RunnerFrame;
+
+/**
+ * What the speaker should be doing, as of the last slice. Off whenever the
+ * VM is stopped or being rewound.
+ */
+typedef struct Chip8RunnerSound {
+    uint8_t on;                     /* the sound timer is running */
+    uint8_t patterned;              /* XO-CHIP: play pattern at pitch, not a plain beep */
+    uint8_t pitch;
+    uint8_t pattern[16];            /* 128 1-bit samples, msb first */
+    uint64_t changedAt;             /* when on last flipped, on chip8RunnerTime's clock */
+} Chip8RunnerSound;
+
+/**
+ * movie and rewind may be NULL. Both are only touched by the runner's
+ * thread while it runs. No rewinding or clock changes while recording.
+ */
+Chip8Runner* chip8RunnerCreate(Chip8* chip8, Chip8Movie* movie, Chip8Rewind* rewind);
+/* stops the thread first if it's still going */
+void chip8RunnerDestroy(Chip8Runner* runner);
+
+int chip8RunnerStart(Chip8Runner* runner);
+/* waits for the thread to finish, after that the VM is the caller's again */
+void chip8RunnerStop(Chip8Runner* runner);
+
+/* these can be called from any thread, they take effect on the next slice */
+void chip8RunnerSetKeys(Chip8Runner* runner, uint16_t keysMask);
+void chip8RunnerSetRewinding(Chip8Runner* runner, int rewinding);
+void chip8RunnerSetTurbo(Chip8Runner* runner, int turbo);
+void chip8RunnerSetClockSpeed(Chip8Runner* runner, uint32_t hz);
+
+uint32_t chip8RunnerGetClockSpeed(const Chip8Runner* runner);
+int chip8RunnerGetTurbo(const Chip8Runner* runner);
+/* instructions per second the VM actually ran lately */
+uint64_t chip8RunnerGetIps(const Chip8Runner* runner);
+
+/**
+ * The newest published screen. Returns 1 when it's a new one since the
+ * last call, 0 when it's the same as before. *frame stays valid until the
+ * next call. Only one thread may read frames.
+ */
+int chip8RunnerAcquireFrame(Chip8Runner* runner, const Chip8RunnerFrame** frame);
+
+/**
+ * The newest sound state. Never blocks or allocates, so it's fine to call
+ * from an audio callback, and any number of threads can. Returns 0 (and
+ * leaves *sound alone) if the runner was in the middle of publishing one
+ * every time it looked, which only a very unlucky caller ever sees.
+ */
+int chip8RunnerGetSound(const Chip8Runner* runner, Chip8RunnerSound* sound);
+/* a monotonic clock in nanoseconds, the one changedAt is on */
+uint64_t chip8RunnerTime(void);
+
+#endif /* CHIP8RUNNER_H */
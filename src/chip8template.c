@@ -0,0 +1,60 @@
+#include "chip8template.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+struct Chip8Template {
+    Chip8 vm;               /* dirtyPages always 0, so forks start clean */
+};
+
+Chip8Template* chip8TemplateCreate(const uint8_t* rom, size_t size, uint64_t seed, uint64_t warmupCycles) {
+    Chip8Template* tmpl = malloc(sizeof(Chip8Template));
+    if (!tmpl) {
+        return NULL;
+    }
+    if (!chip8LoadFromArray(&tmpl->vm, rom, size)) {
+        free(tmpl);
+        return NULL;
+    }
+    chip8Seed(&tmpl->vm, seed);
+    chip8RunFor(&tmpl->vm, warmupCycles);
+    tmpl->vm.dirtyPages = 0;
+    return tmpl;
+}
+
+Chip8Template* chip8TemplateFromVM(const Chip8* chip8) {
+    if (!chip8) {
+        return NULL;
+    }
+    Chip8Template* tmpl = malloc(sizeof(Chip8Template));
+    if (!tmpl) {
+        return NULL;
+    }
+    tmpl->vm = *chip8;
+    tmpl->vm.dirtyPages = 0;
+    return tmpl;
+}
+
+void chip8TemplateDestroy(Chip8Template* tmpl) {
+    free(tmpl);
+}
+
+int chip8TemplateFork(const Chip8Template* tmpl, Chip8* chip8) {
+    if (!tmpl || !chip8) {
+        return 0;
+    }
+    *chip8 = tmpl->vm;
+    return 1;
+}
+
+int chip8TemplateReset(const Chip8Template* tmpl, Chip8* chip8) {
+    if (!tmpl) {
+        return 0;
+    }
+    return chip8Restore(chip8, &tmpl->vm);
+}
+
+const Chip8* chip8TemplateGetVM(const Chip8Template* tmpl) {
+    return tmpl ? &tmpl->vm : NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef CHIP8TEMPLATE_H
+#define CHIP8TEMPLATE_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * A VM set up once (font, ROM, seed, maybe some warm-up cycles) and then
+ * frozen, for when the same ROM gets restarted over and over (fuzzing,
+ * searches, training runs). Forking a VM off it is one struct copy, and
+ * putting a forked VM back only copies the memory pages it wrote, no
+ * init, no ROM load.
+ */
+typedef struct Chip8Template Chip8Template;
+
+/**
+ * Loads rom into a fresh VM, seeds it and runs warmupCycles cycles (ticking
+ * the timers as it goes), then freezes it. NULL if the ROM doesn't load.
+ */
+Chip8Template* chip8TemplateCreate(const uint8_t* rom, size_t size, uint64_t seed, uint64_t warmupCycles);
+/* freezes a copy of a VM as it is right now */
+Chip8Template* chip8TemplateFromVM(const Chip8* chip8);
+void chip8TemplateDestroy(Chip8Template* tmpl);
+
+/**
+ * Makes chip8 a copy of the template. Like after loading a ROM, a JIT that
+ * ran chip8 before needs a chip8JitFlush.
+ */
+int chip8TemplateFork(const Chip8Template* tmpl, Chip8* chip8);
+/**
+ * Puts a VM forked off tmpl back the way it was forked, copying only
+ * what it wrote since (see chip8Restore). No flush needed for a JIT.
+ */
+int chip8TemplateReset(const Chip8Template* tmpl, Chip8* chip8);
+
+const Chip8* chip8TemplateGetVM(const Chip8Template* tmpl);
+
+#endif /* CHIP8TEMPLATE_H */
@@ -0,0 +1,328 @@
+#include "chip8trace.h"
+#include "chip8ops.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+#define C8_TRACE_WRITER_SLEEP   0.001       /* seconds the writer naps when the ring is empty */
+#define C8_TRACE_CHUNK          1024        /* records encoded per fwrite */
+#define C8_TRACE_CACHE_LINE     64
+
+/**
+ * A single-producer, single-consumer ring: the VM's thread only moves head
+ * and the writer only moves tail, so neither ever takes a lock. The VM
+ * keeps its own copies of both and only looks at the writer's tail again
+ * when the ring seems full.
+ */
+struct Chip8Tracer {
+    /* the VM's thread */
+    Chip8TraceRecord* ring;
+    uint32_t mask;                  /* capacity - 1 */
+    int lossless;
+    Chip8TraceFilter filter;
+    uint64_t head;
+    uint64_t tailSeen;              /* tail, when it was last looked at */
+    atomic_uint_least64_t dropped;
+
+    /* shared, a cache line apart so the two threads don't keep taking lines from each other */
+    uint8_t pad0[C8_TRACE_CACHE_LINE];
+    atomic_uint_least64_t published;    /* head, as far as the writer knows */
+    uint8_t pad1[C8_TRACE_CACHE_LINE];
+    atomic_uint_least64_t tail;
+    uint8_t pad2[C8_TRACE_CACHE_LINE];
+
+    /* the writer's */
+    FILE* file;
+    pthread_t thread;
+    atomic_int quit;
+};
+
+/* the V register each kind of instruction writes */
+static const uint8_t _writesVx[C8_OP_COUNT] = {
+    [C8_OP_LD_BYTE] = 1,    [C8_OP_ADD_BYTE] = 1,   [C8_OP_LD_REG] = 1,     [C8_OP_OR] = 1,
+    [C8_OP_AND] = 1,        [C8_OP_XOR] = 1,        [C8_OP_ADD_REG] = 1,    [C8_OP_SUB] = 1,
+    [C8_OP_SHR] = 1,        [C8_OP_SUBN] = 1,       [C8_OP_SHL] = 1,        [C8_OP_RND] = 1,
+    [C8_OP_LD_VX_DT] = 1,   [C8_OP_LD_VX_K] = 1,    [C8_OP_LD_VX_MEM] = 1,  [C8_OP_LD_VX_R] = 1,
+    [C8_OP_LOAD_RANGE] = 1,
+};
+
+static void* _writer_main(void* arg);
+static size_t _drain(Chip8Tracer* t);
+static void _encode(uint8_t* p, const Chip8TraceRecord* r);
+static void _decode(const uint8_t* p, Chip8TraceRecord* r);
+static void _yield(void);
+
+Chip8Tracer* chip8TracerCreate(const char* path, uint32_t capacity, int lossless) {
+    if (!path) {
+        return NULL;
+    }
+    if (capacity == 0) {
+        capacity = C8_TRACE_DEFAULT_CAPACITY;
+    }
+    uint32_t cap = 2;
+    while (cap < capacity && cap < (1U << 31)) {
+        cap <<= 1;
+    }
+    Chip8Tracer* t = calloc(1, sizeof(Chip8Tracer));
+    if (!t) {
+        return NULL;
+    }
+    t->ring = malloc((size_t) cap * sizeof(Chip8TraceRecord));
+    t->file = t->ring ? fopen(path, "wb") : NULL;
+    if (!t->file) {
+        free(t->ring);
+        free(t);
+        return NULL;
+    }
+    t->mask = cap - 1;
+    t->lossless = lossless;
+    t->filter.pcLo = 0;
+    t->filter.pcHi = C8_MEMORY_SIZE - 1;
+    t->filter.families = C8_TRACE_ALL_FAMILIES;
+    atomic_init(&t->published, 0);
+    atomic_init(&t->tail, 0);
+    atomic_init(&t->dropped, 0);
+    atomic_init(&t->quit, 0);
+
+    uint8_t header[C8_TRACE_HEADER_SIZE];
+    memcpy(header, C8_TRACE_MAGIC, 4);
+    chip8Put16(header + 4, C8_TRACE_VERSION);
+    chip8Put16(header + 6, C8_TRACE_RECORD_SIZE);
+    if (fwrite(header, 1, sizeof(header), t->file) != sizeof(header)
+            || pthread_create(&t->thread, NULL, _writer_main, t) != 0) {
+        fclose(t->file);
+        free(t->ring);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void chip8TracerDestroy(Chip8Tracer* tracer) {
+    if (!tracer) {
+        return;
+    }
+    atomic_store(&tracer->quit, 1);
+    pthread_join(tracer->thread, NULL);
+    fclose(tracer->file);
+    free(tracer->ring);
+    free(tracer);
+}
+
+void chip8TracerSetFilter(Chip8Tracer* tracer, const Chip8TraceFilter* filter) {
+    if (tracer && filter) {
+        tracer->filter = *filter;
+    }
+}
+
+int chip8TracerParseFilter(const char* spec, Chip8TraceFilter* filter) {
+    if (!spec || !filter) {
+        return 0;
+    }
+    Chip8TraceFilter f = { 0, C8_MEMORY_SIZE - 1, 0 };
+    const char* p = spec;
+    while (*p) {
+        char* end;
+        if (strncmp(p, "pc=", 3) == 0) {
+            unsigned long lo = strtoul(p + 3, &end, 16);
+            if (end == p + 3 || *end != '-') {
+                return 0;
+            }
+            const char* hiStart = end + 1;
+            unsigned long hi = strtoul(hiStart, &end, 16);
+            if (end == hiStart || lo > hi || hi >= C8_MEMORY_SIZE) {
+                return 0;
+            }
+            f.pcLo = (uint16_t) lo;
+            f.pcHi = (uint16_t) hi;
+        } else if (strncmp(p, "op=", 3) == 0) {
+            unsigned long family = strtoul(p + 3, &end, 16);
+            if (end != p + 4 || family > 0xF) {
+                return 0;
+            }
+            f.families |= 1U << family;
+        } else {
+            return 0;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end) {
+            return 0;
+        }
+        p = end;
+    }
+    if (f.families == 0) {
+        f.families = C8_TRACE_ALL_FAMILIES;
+    }
+    *filter = f;
+    return 1;
+}
+
+int chip8TracerAttach(Chip8Tracer* tracer, Chip8* chip8) {
+    if (!chip8) {
+        return 0;
+    }
+#ifdef C8_TRACE
+    chip8->tracer = tracer;
+    return 1;
+#else
+    (void) tracer;
+    return 0;
+#endif
+}
+
+uint64_t chip8TracerGetWritten(const Chip8Tracer* tracer) {
+    return tracer ? atomic_load(&tracer->tail) : 0;
+}
+
+uint64_t chip8TracerGetDropped(const Chip8Tracer* tracer) {
+    return tracer ? atomic_load_explicit(&tracer->dropped, memory_order_relaxed) : 0;
+}
+
+void chip8TracerPush(Chip8Tracer* tracer, const Chip8* chip8, uint16_t pc, const Chip8Ins* ins, uint64_t cycle) {
+    Chip8Tracer* t = tracer;
+    const Chip8TraceFilter* f = &t->filter;
+    int reported = ins->op == C8_OP_SYS || ins->op == C8_OP_UNKNOWN;
+    if (!reported && ((uint16_t) (pc - f->pcLo) > f->pcHi - f->pcLo || !((f->families >> (ins->opcode >> 12)) & 1))) {
+        return;
+    }
+    uint64_t head = t->head;
+    if (head - t->tailSeen > t->mask) {
+        t->tailSeen = atomic_load_explicit(&t->tail, memory_order_acquire);
+        while (head - t->tailSeen > t->mask) {
+            if (!t->lossless) {
+                /* only this thread writes it, so no need for a locked add */
+                atomic_store_explicit(&t->dropped, atomic_load_explicit(&t->dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+                return;
+            }
+            _yield();
+            t->tailSeen = atomic_load_explicit(&t->tail, memory_order_acquire);
+        }
+    }
+    Chip8TraceRecord* r = &t->ring[head & t->mask];
+    r->cycle = cycle;
+    r->pc = pc;
+    r->opcode = ins->opcode;
+    r->I = chip8->I;
+    r->sp = (uint8_t) chip8->sp;
+    r->op = ins->op;
+    r->reg = _writesVx[ins->op] ? ins->x : C8_TRACE_NO_REG;
+    r->value = chip8->V[ins->x];
+    r->vf = chip8->V[0xF];
+    r->delayTimer = chip8->delayTimer;
+    t->head = head + 1;
+    atomic_store_explicit(&t->published, head + 1, memory_order_release);
+}
+
+long chip8TraceDump(FILE* inFile, FILE* outFile) {
+    if (!inFile || !outFile) {
+        return -1;
+    }
+    uint8_t header[C8_TRACE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), inFile) != sizeof(header)
+            || memcmp(header, C8_TRACE_MAGIC, 4) != 0
+            || chip8Get16(header + 4) != C8_TRACE_VERSION
+            || chip8Get16(header + 6) != C8_TRACE_RECORD_SIZE) {
+        return -1;
+    }
+    uint8_t buf[C8_TRACE_RECORD_SIZE];
+    long count = 0;
+    while (fread(buf, 1, sizeof(buf), inFile) == sizeof(buf)) {
+        Chip8TraceRecord r;
+        _decode(buf, &r);
+        fprintf(outFile, "%10llu  %03X  %04X  I=%03X SP=%X VF=%02X DT=%02X",
+            (unsigned long long) r.cycle, r.pc, r.opcode, r.I, r.sp, r.vf, r.delayTimer);
+        if (r.reg != C8_TRACE_NO_REG) {
+            fprintf(outFile, "  V%X=%02X", r.reg, r.value);
+        }
+        if (r.op == C8_OP_UNKNOWN) {
+            fputs("  unknown opcode", outFile);
+        } else if (r.op == C8_OP_SYS) {
+            fputs("  nop", outFile);
+        }
+        fputc('\n', outFile);
+        count++;
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------
+
+/* drains until told to quit, then once more so nothing pushed before Destroy is lost */
+static void* _writer_main(void* arg) {
+    Chip8Tracer* t = arg;
+    while (!atomic_load_explicit(&t->quit, memory_order_acquire)) {
+        if (_drain(t) == 0) {
+            chip8SleepSeconds(C8_TRACE_WRITER_SLEEP);
+        }
+    }
+    while (_drain(t) > 0) {
+    }
+    fflush(t->file);
+    return NULL;
+}
+
+/* writes out everything published so far, returns how many records that was */
+static size_t _drain(Chip8Tracer* t) {
+    uint64_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&t->published, memory_order_acquire);
+    size_t total = 0;
+    uint8_t buf[C8_TRACE_CHUNK * C8_TRACE_RECORD_SIZE];
+    while (tail < head) {
+        size_t n = head - tail < C8_TRACE_CHUNK ? (size_t) (head - tail) : C8_TRACE_CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            _encode(buf + i * C8_TRACE_RECORD_SIZE, &t->ring[(tail + i) & t->mask]);
+        }
+        /* the slots are free again once they're encoded */
+        tail += n;
+        total += n;
+        atomic_store_explicit(&t->tail, tail, memory_order_release);
+        fwrite(buf, C8_TRACE_RECORD_SIZE, n, t->file);
+    }
+    return total;
+}
+
+static void _encode(uint8_t* p, const Chip8TraceRecord* r) {
+    chip8Put64(p, r->cycle);
+    chip8Put16(p + 8, r->pc);
+    chip8Put16(p + 10, r->opcode);
+    chip8Put16(p + 12, r->I);
+    p[14] = r->sp;
+    p[15] = r->op;
+    p[16] = r->reg;
+    p[17] = r->value;
+    p[18] = r->vf;
+    p[19] = r->delayTimer;
+}
+
+static void _decode(const uint8_t* p, Chip8TraceRecord* r) {
+    r->cycle = chip8Get64(p);
+    r->pc = chip8Get16(p + 8);
+    r->opcode = chip8Get16(p + 10);
+    r->I = chip8Get16(p + 12);
+    r->sp = p[14];
+    r->op = p[15];
+    r->reg = p[16];
+    r->value = p[17];
+    r->vf = p[18];
+    r->delayTimer = p[19];
+}
+
+static void _yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
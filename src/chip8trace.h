@@ -0,0 +1,81 @@
+#ifndef CHIP8TRACE_H
+#define CHIP8TRACE_H
+
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define C8_TRACE_MAGIC              "C8TR"
+#define C8_TRACE_VERSION            1
+#define C8_TRACE_HEADER_SIZE        8       /* magic, version, record size */
+#define C8_TRACE_RECORD_SIZE        20      /* in the file, little endian */
+#define C8_TRACE_DEFAULT_CAPACITY   (1 << 16)
+#define C8_TRACE_NO_REG             0xFF
+#define C8_TRACE_ALL_FAMILIES       0xFFFF
+
+/**
+ * Execution traces, for 'make TRACE=1' builds. The VM puts one fixed-size
+ * record per instruction into a lock-free ring buffer, and a thread of the
+ * tracer's own writes them out, so the VM never waits on stdio. 0nnn and
+ * unknown instructions always make it into the trace, whatever the filter
+ * says: that's where the interpreter reports them.
+ */
+typedef struct Chip8Tracer Chip8Tracer;
+
+typedef struct Chip8TraceRecord {
+    uint64_t cycle;                 /* cycles run before this instruction */
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;                     /* this and everything below are after the instruction ran */
+    uint8_t sp;
+    uint8_t op;                     /* the decoded instruction kind */
+    uint8_t reg;                    /* the V register it wrote, C8_TRACE_NO_REG if none */
+    uint8_t value;                  /* what that register holds now */
+    uint8_t vf;
+    uint8_t delayTimer;
+} Chip8TraceRecord;
+
+/* which instructions get traced */
+typedef struct Chip8TraceFilter {
+    uint16_t pcLo;                  /* from pcLo to pcHi, both included */
+    uint16_t pcHi;
+    uint16_t families;              /* bit n set traces the nXXX opcodes */
+} Chip8TraceFilter;
+
+/**
+ * Starts a tracer writing to path, with room for capacity records (rounded
+ * up to a power of two, 0 for C8_TRACE_DEFAULT_CAPACITY) between the VM and
+ * the file. When the ring fills up, a lossless tracer makes the VM wait for
+ * the writer; otherwise records get dropped (and counted).
+ */
+Chip8Tracer* chip8TracerCreate(const char* path, uint32_t capacity, int lossless);
+/* writes out whatever is still in the ring. VMs using it must be detached first */
+void chip8TracerDestroy(Chip8Tracer* tracer);
+
+/* everything is traced until a filter is set. set it before attaching */
+void chip8TracerSetFilter(Chip8Tracer* tracer, const Chip8TraceFilter* filter);
+/**
+ * Parses a filter like "pc=200-2FF,op=D,op=F": a pc range and/or opcode
+ * families (hex digits), any of them left out means all of them. Returns 0
+ * on anything it doesn't understand.
+ */
+int chip8TracerParseFilter(const char* spec, Chip8TraceFilter* filter);
+
+/**
+ * Traces chip8 from now on (tracer NULL stops it). Returns 0 in builds
+ * without C8_TRACE. chip8Init, and so loading a ROM, detaches. A tracer
+ * only takes one VM at a time, run from one thread.
+ */
+int chip8TracerAttach(Chip8Tracer* tracer, Chip8* chip8);
+
+uint64_t chip8TracerGetWritten(const Chip8Tracer* tracer);
+uint64_t chip8TracerGetDropped(const Chip8Tracer* tracer);
+
+/* the interpreter's side, called after every instruction ran */
+void chip8TracerPush(Chip8Tracer* tracer, const Chip8* chip8, uint16_t pc, const Chip8Ins* ins, uint64_t cycle);
+
+/* prints a trace file as text, one line per record. -1 if it isn't a trace */
+long chip8TraceDump(FILE* inFile, FILE* outFile);
+
+#endif /* CHIP8TRACE_H */
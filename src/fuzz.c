@@ -0,0 +1,600 @@
+#include "chip8.h"
+#include "chip8romcache.h"
+#include "chip8ops.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#define FUZZ_DEFAULT_CYCLES     2000        /* per input */
+#define FUZZ_MAX_STACK          8           /* mutations applied to one input */
+#define FUZZ_MAX_CHUNK          16          /* bytes inserted or deleted at once */
+#define FUZZ_REPORT_PERIOD      2.0         /* seconds between status lines */
+#define FUZZ_MIN_NAME           "%s.min"
+#define FUZZ_HEADER             1           /* the profile byte in front of the ROM */
+
+static Chip8 _vm;
+static uint32_t _maxCycles = FUZZ_DEFAULT_CYCLES;
+
+static void _run_input(const uint8_t* data, size_t size);
+static void _check(const Chip8* vm);
+
+#ifdef C8_LIBFUZZER
+
+/* 'make fuzz LIBFUZZER=1': libFuzzer brings main, the mutator and the corpus handling */
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    _run_input(data, size);
+    return 0;
+}
+
+#else
+
+static uint64_t _rng;
+static uint8_t _seen[C8_FUZZ_MAP_SIZE];     /* hit count buckets seen so far, per edge */
+static uint8_t _bucket[256];
+static int _edges;
+
+/* what's running, so a crash can leave it behind */
+static const uint8_t* volatile _current;
+static volatile size_t _currentSize;
+
+static int _fuzz(Chip8RomCache* corpus, const char* outDir, uint64_t maxRuns, double maxSeconds);
+static int _replay(const Chip8RomCache* corpus);
+static int _minimize(const char* path);
+#ifndef _WIN32
+static int _crashes(const uint8_t* data, size_t size);
+#endif
+static int _new_coverage(void);
+static void _mutate(uint8_t* buf, size_t* size, const Chip8RomCache* corpus);
+static int _collect(Chip8RomCache* corpus, const char* path);
+static int _save(const char* dir, const uint8_t* data, size_t size);
+static void _on_crash(void);
+static void _on_signal(int sig);
+static uint32_t _rand(void);
+static void _usage(const char* prog);
+
+#if defined(__GNUC__) && !defined(_WIN32)
+/* only there when a sanitizer runtime is linked in */
+extern void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+#endif
+
+/**
+ * A small coverage-guided fuzzer for when libFuzzer isn't around: inputs
+ * from the corpus get mutated and run, and the ones that reach an edge
+ * (or an edge hit count bucket) nothing else did join the corpus. Any
+ * crash is written to crash-<hash> in the working directory.
+ */
+int main(int argc, char const *argv[])
+{
+    const char* outDir = NULL;
+    const char* minimizePath = NULL;
+    uint64_t maxRuns = 0;
+    double maxSeconds = 0;
+    int replay = 0;
+    _rng = (uint64_t) time(NULL);
+    int first = 1;
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-c") == 0 && first + 1 < argc) {
+            _maxCycles = (uint32_t) strtoul(argv[first + 1], NULL, 10);
+            first += 2;
+        } else if (strcmp(argv[first], "-n") == 0 && first + 1 < argc) {
+            maxRuns = strtoull(argv[first + 1], NULL, 10);
+            first += 2;
+        } else if (strcmp(argv[first], "-t") == 0 && first + 1 < argc) {
+            maxSeconds = atof(argv[first + 1]);
+            first += 2;
+        } else if (strcmp(argv[first], "-s") == 0 && first + 1 < argc) {
+            _rng = strtoull(argv[first + 1], NULL, 0);
+            first += 2;
+        } else if (strcmp(argv[first], "-o") == 0 && first + 1 < argc) {
+            outDir = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-m") == 0 && first + 1 < argc) {
+            minimizePath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-r") == 0) {
+            replay = 1;
+            first++;
+        } else {
+            _usage(argv[0]);
+            return 1;
+        }
+    }
+    if (_maxCycles == 0) {
+        _usage(argv[0]);
+        return 1;
+    }
+    if (minimizePath) {
+        return _minimize(minimizePath);
+    }
+
+    Chip8RomCache* corpus = chip8RomCacheCreate();
+    if (!corpus) {
+        return 1;
+    }
+    for (int i = first; i < argc; i++) {
+        int isDir = _collect(corpus, argv[i]);
+        if (isDir < 0) {
+            printf("could not load %s\n", argv[i]);
+            chip8RomCacheDestroy(corpus);
+            return 1;
+        }
+        if (isDir && !outDir) {
+            outDir = argv[i];
+        }
+    }
+
+    int result = replay
+        ? _replay(corpus)
+        : _fuzz(corpus, outDir, maxRuns, maxSeconds);
+    chip8RomCacheDestroy(corpus);
+    return result;
+}
+
+static void _usage(const char* prog) {
+    printf("Usage: %s [-c cycles] [-n runs] [-t seconds] [-s seed] [-o dir] [-r] [corpus...]\n", prog);
+    printf("       %s [-c cycles] -m crash-file\n", prog);
+    printf("  -c  cycles each input runs for at most (%d)\n", FUZZ_DEFAULT_CYCLES);
+    printf("  -n  stop after this many runs\n");
+    printf("  -t  stop after this many seconds\n");
+    printf("  -s  seed for the mutator (the time)\n");
+    printf("  -o  where new inputs are written (the first corpus directory)\n");
+    printf("  -r  just run every input once and stop, e.g. to check a crash is fixed\n");
+    printf("  -m  shrink a crashing input as far as it still crashes, into <file>.min\n");
+    printf("  corpus entries are ROM files or directories of them\n");
+}
+
+static int _fuzz(Chip8RomCache* corpus, const char* outDir, uint64_t maxRuns, double maxSeconds) {
+    for (int i = 0; i < 256; i++) {
+        _bucket[i] = i == 0 ? 0 : i == 1 ? 1 : i == 2 ? 2 : i == 3 ? 4
+            : i < 8 ? 8 : i < 16 ? 16 : i < 32 ? 32 : i < 128 ? 64 : 128;
+    }
+    signal(SIGSEGV, _on_signal);
+    signal(SIGABRT, _on_signal);
+    signal(SIGFPE, _on_signal);
+    signal(SIGILL, _on_signal);
+#if defined(__GNUC__) && !defined(_WIN32)
+    if (__sanitizer_set_death_callback) {
+        __sanitizer_set_death_callback(_on_crash);
+    }
+#endif
+
+    if (chip8RomCacheCount(corpus) == 0) {
+        static const uint8_t jump[] = { C8_QUIRKS_DEFAULT, 0x12, 0x00 };
+        chip8RomCacheAdd(corpus, jump, sizeof(jump));
+    }
+    int seeds = chip8RomCacheCount(corpus);
+    for (int i = 0; i < seeds; i++) {
+        const Chip8Rom* rom = chip8RomCacheGet(corpus, i);
+        _current = rom->data;
+        _currentSize = rom->size;
+        _run_input(rom->data, rom->size);
+        _new_coverage();
+    }
+    printf("seeds=%d edges=%d cycles=%u seed=0x%llX\n", seeds, _edges, _maxCycles, (unsigned long long) _rng);
+
+    uint8_t buf[C8_MAX_ROM_SIZE];
+    uint64_t runs = 0;
+    double start = chip8NowSeconds();
+    double nextReport = start + FUZZ_REPORT_PERIOD;
+    for (;;) {
+        const Chip8Rom* rom = chip8RomCacheGet(corpus, _rand() % chip8RomCacheCount(corpus));
+        size_t size = rom->size;
+        memcpy(buf, rom->data, size);
+        int stack = 1 + _rand() % FUZZ_MAX_STACK;
+        for (int i = 0; i < stack; i++) {
+            _mutate(buf, &size, corpus);
+        }
+        _current = buf;
+        _currentSize = size;
+        _run_input(buf, size);
+        runs++;
+        if (_new_coverage()) {
+            const Chip8Rom* added = chip8RomCacheAdd(corpus, buf, size);
+            if (added && outDir && !_save(outDir, added->data, added->size)) {
+                printf("could not write to %s\n", outDir);
+                return 1;
+            }
+        }
+
+        if ((runs & 0xFFF) == 0 || runs == maxRuns) {
+            double now = chip8NowSeconds();
+            int done = (maxRuns && runs >= maxRuns) || (maxSeconds > 0 && now - start >= maxSeconds);
+            if (now >= nextReport || done) {
+                printf("#%llu  corpus=%d edges=%d  %.0f runs/s\n",
+                    (unsigned long long) runs,
+                    chip8RomCacheCount(corpus),
+                    _edges,
+                    runs / (now - start)
+                );
+                fflush(stdout);
+                nextReport = now + FUZZ_REPORT_PERIOD;
+            }
+            if (done) {
+                break;
+            }
+        }
+    }
+    _current = NULL;
+    return 0;
+}
+
+static int _replay(const Chip8RomCache* corpus) {
+    int count = chip8RomCacheCount(corpus);
+    for (int i = 0; i < count; i++) {
+        const Chip8Rom* rom = chip8RomCacheGet(corpus, i);
+        _run_input(rom->data, rom->size);
+        printf("%s: ok (%llu cycles, err=%d)\n",
+            rom->path ? rom->path : "?",
+            (unsigned long long) _vm.cycles,
+            _vm.err
+        );
+    }
+    return 0;
+}
+
+/* folds this run's counters into _seen, says whether any bucket in them is new */
+static int _new_coverage(void) {
+    const uint64_t* words = (const uint64_t*) chip8FuzzCoverage;
+    int found = 0;
+    for (size_t w = 0; w < C8_FUZZ_MAP_SIZE / 8; w++) {
+        if (!words[w]) {
+            continue;
+        }
+        for (size_t i = w * 8; i < w * 8 + 8; i++) {
+            uint8_t b = _bucket[chip8FuzzCoverage[i]];
+            if (b & ~_seen[i]) {
+                _edges += !_seen[i];
+                _seen[i] |= b;
+                found = 1;
+            }
+        }
+    }
+    return found;
+}
+
+/* instructions that reach the interesting parts, with the operand bits that get randomized */
+static const uint16_t _opcodes[][2] = {
+    { 0xAF00, 0x00FF },     /* I near the end of memory */
+    { 0xA000, 0x0FFF },
+    { 0xD000, 0x0FFF },
+    { 0xF055, 0x0F00 },
+    { 0xF065, 0x0F00 },
+    { 0xF033, 0x0F00 },
+    { 0xF01E, 0x0F00 },
+    { 0xF029, 0x0F00 },
+    { 0xF00A, 0x0F00 },
+    { 0xE09E, 0x0F00 },
+    { 0xE0A1, 0x0F00 },
+    { 0x2000, 0x0FFF },
+    { 0x00EE, 0x0000 },
+    { 0x1000, 0x0FFF },
+    { 0xB000, 0x0FFF },
+    { 0x6000, 0x0FFF },
+    { 0x7000, 0x0FFF },
+    { 0x8000, 0x0FFF },
+    { 0xC000, 0x0FFF },
+    { 0x00E0, 0x0000 },
+    /* SUPER-CHIP and XO-CHIP, for inputs on those profiles */
+    { 0x00C0, 0x000F },     /* scroll down */
+    { 0x00D0, 0x000F },     /* scroll up */
+    { 0x00FB, 0x0000 },
+    { 0x00FC, 0x0000 },
+    { 0x00FF, 0x0000 },     /* hi-res */
+    { 0xD000, 0x0FF0 },     /* Dxy0, 16x16 */
+    { 0x5002, 0x0FF1 },     /* 5xy2 and 5xy3 */
+    { 0xF000, 0x0000 },     /* F000 nnnn, takes whatever comes next */
+    { 0xF001, 0x0F00 },
+    { 0xF030, 0x0F00 },
+    { 0xF075, 0x0F00 },
+    { 0xF085, 0x0F00 },
+};
+
+static const uint8_t _bytes[] = { 0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0xEE, 0xF0, 0xFE, 0xFF };
+
+/* one random edit. buf holds C8_MAX_ROM_SIZE bytes and *size stays at least 2 */
+static void _mutate(uint8_t* buf, size_t* size, const Chip8RomCache* corpus) {
+    size_t n = *size;
+    size_t at = _rand() % n;
+    switch (_rand() % 8) {
+        case 0:
+            buf[at] ^= 1 << (_rand() % 8);
+            break;
+        case 1:
+            buf[at] = (uint8_t) _rand();
+            break;
+        case 2:
+            buf[at] = _bytes[_rand() % sizeof(_bytes)];
+            break;
+        case 3: {
+            const uint16_t* op = _opcodes[_rand() % (sizeof(_opcodes) / sizeof(_opcodes[0]))];
+            uint16_t opcode = op[0] | (_rand() & op[1]);
+            /* on an instruction boundary of the ROM, which starts after the header */
+            at = at < FUZZ_HEADER ? FUZZ_HEADER : ((at - FUZZ_HEADER) & ~(size_t) 1) + FUZZ_HEADER;
+            if (at + 2 > C8_MAX_ROM_SIZE) {
+                at -= 2;
+            }
+            if (at + 2 > n) {
+                n = at + 2;
+            }
+            buf[at] = opcode >> 8;
+            buf[at + 1] = opcode & 0xFF;
+            break;
+        }
+        case 4: {
+            size_t len = 1 + _rand() % FUZZ_MAX_CHUNK;
+            if (n + len > C8_MAX_ROM_SIZE) {
+                break;
+            }
+            memmove(buf + at + len, buf + at, n - at);
+            for (size_t i = 0; i < len; i++) {
+                buf[at + i] = (uint8_t) _rand();
+            }
+            n += len;
+            break;
+        }
+        case 5: {
+            size_t len = 1 + _rand() % FUZZ_MAX_CHUNK;
+            if (len + 2 > n) {
+                break;
+            }
+            if (at + len > n) {
+                at = n - len;
+            }
+            memmove(buf + at, buf + at + len, n - at - len);
+            n -= len;
+            break;
+        }
+        case 6: {
+            size_t from = _rand() % n;
+            size_t len = 1 + _rand() % FUZZ_MAX_CHUNK;
+            if (from + len > n) {
+                len = n - from;
+            }
+            if (at + len > n) {
+                len = n - at;
+            }
+            memmove(buf + at, buf + from, len);
+            break;
+        }
+        case 7: {
+            /* the front of this one, the back of another */
+            const Chip8Rom* other = chip8RomCacheGet(corpus, _rand() % chip8RomCacheCount(corpus));
+            size_t from = _rand() % other->size;
+            size_t len = other->size - from;
+            if (at + len > C8_MAX_ROM_SIZE) {
+                len = C8_MAX_ROM_SIZE - at;
+            }
+            memcpy(buf + at, other->data + from, len);
+            n = at + len > 2 ? at + len : 2;
+            break;
+        }
+    }
+    if (n < 2) {
+        buf[1] = 0;
+        n = 2;
+    }
+    *size = n;
+}
+
+/**
+ * Shrinks a crashing input: drops chunks of it, halving their size each
+ * round, then blanks whole instructions to 0000, keeping every edit after
+ * which it still crashes. Each try runs in a child process, since it's
+ * meant to crash.
+ */
+static int _minimize(const char* path) {
+#ifdef _WIN32
+    (void) path;
+    printf("minimizing needs fork, it isn't there on Windows\n");
+    return 1;
+#else
+    Chip8RomCache* cache = chip8RomCacheCreate();
+    const Chip8Rom* rom = cache ? chip8RomCacheLoad(cache, path) : NULL;
+    if (!rom) {
+        printf("could not load %s\n", path);
+        chip8RomCacheDestroy(cache);
+        return 1;
+    }
+    uint8_t buf[C8_MAX_ROM_SIZE];
+    uint8_t try[C8_MAX_ROM_SIZE];
+    size_t size = rom->size;
+    memcpy(buf, rom->data, size);
+    chip8RomCacheDestroy(cache);
+    if (!_crashes(buf, size)) {
+        printf("%s doesn't crash\n", path);
+        return 1;
+    }
+
+    size_t original = size;
+    int tries = 0;
+    for (size_t chunk = size / 2; chunk > 0; chunk /= 2) {
+        for (size_t at = 0; at + chunk <= size && size > chunk;) {
+            memcpy(try, buf, at);
+            memcpy(try + at, buf + at + chunk, size - at - chunk);
+            tries++;
+            if (_crashes(try, size - chunk)) {
+                size -= chunk;
+                memcpy(buf, try, size);
+            } else {
+                at += chunk;
+            }
+        }
+    }
+    for (size_t at = FUZZ_HEADER; at + 1 < size; at += 2) {
+        if (buf[at] == 0 && buf[at + 1] == 0) {
+            continue;
+        }
+        memcpy(try, buf, size);
+        try[at] = try[at + 1] = 0;
+        tries++;
+        if (_crashes(try, size)) {
+            memcpy(buf, try, size);
+        }
+    }
+
+    char out[1024];
+    snprintf(out, sizeof(out), FUZZ_MIN_NAME, path);
+    FILE* file = fopen(out, "wb");
+    if (!file || fwrite(buf, 1, size, file) != size || fclose(file) != 0) {
+        printf("could not write %s\n", out);
+        return 1;
+    }
+    printf("%zu -> %zu bytes after %d tries, written to %s\n", original, size, tries, out);
+    return 0;
+#endif
+}
+
+#ifndef _WIN32
+/* anything but a clean exit counts, the child's output goes nowhere */
+static int _crashes(const uint8_t* data, size_t size) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        return 0;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        _run_input(data, size);
+        _exit(0);
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        return 0;
+    }
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+#endif
+
+/* 1 when path was a directory, 0 when it was a file, -1 when it was neither */
+static int _collect(Chip8RomCache* corpus, const char* path) {
+    if (chip8RomCacheLoadDir(corpus, path) >= 0) {
+        return 1;
+    }
+    return chip8RomCacheLoad(corpus, path) ? 0 : -1;
+}
+
+/* corpus files are named after their hash, so the same input is only written once */
+static int _save(const char* dir, const uint8_t* data, size_t size) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long) chip8Fnv1a(C8_FNV_OFFSET, data, size));
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    int ok = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+/* the sanitizers' last words and fatal signals both end up here */
+static void _on_crash(void) {
+    const uint8_t* data = _current;
+    size_t size = _currentSize;
+    if (!data) {
+        return;
+    }
+    _current = NULL;
+    char path[32];
+    snprintf(path, sizeof(path), "crash-%016llx", (unsigned long long) chip8Fnv1a(C8_FNV_OFFSET, data, size));
+    FILE* file = fopen(path, "wb");
+    if (file) {
+        fwrite(data, 1, size, file);
+        fclose(file);
+        fprintf(stderr, "crashing input written to %s\n", path);
+    }
+}
+
+static void _on_signal(int sig) {
+    _on_crash();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/* xorshift64* */
+static uint32_t _rand(void) {
+    _rng ^= _rng >> 12;
+    _rng ^= _rng << 25;
+    _rng ^= _rng >> 27;
+    return (uint32_t) ((_rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+#endif /* C8_LIBFUZZER */
+
+// ----------------------------------------------------------------------
+
+/**
+ * One input is a byte that picks the quirk profile (so the SUPER-CHIP and
+ * XO-CHIP instructions get fuzzed too), then the ROM, run for at most
+ * _maxCycles. Keys come and go with the timer ticks, and one gets pressed
+ * whenever the VM waits for it, so every instruction is reachable.
+ * Afterwards the VM still has to make sense, or it counts as a crash just
+ * like a sanitizer report would.
+ */
+static void _run_input(const uint8_t* data, size_t size) {
+    chip8FuzzReset();
+    if (size <= FUZZ_HEADER) {
+        return;
+    }
+    int profile = data[0] % C8_QUIRKS_COUNT;
+    data += FUZZ_HEADER;
+    size -= FUZZ_HEADER;
+    if (size > C8_MAX_ROM_SIZE) {
+        size = C8_MAX_ROM_SIZE;
+    }
+    if (!chip8LoadFromArray(&_vm, data, size)) {
+        return;
+    }
+    chip8SetQuirks(&_vm, profile);
+    /* a tick at a time, the keys change between ticks (an Fx0A always gets one) */
+    uint64_t left = _maxCycles;
+    while (left > 0 && _vm.running) {
+        uint64_t slice = left < _vm.tickCountdown ? left : _vm.tickCountdown;
+        uint64_t ran = chip8RunFor(&_vm, slice);
+        left -= ran;
+        if (_vm.waitingForKey) {
+            chip8PressKeys(&_vm, (uint16_t) (1U << (_vm.cycles & 0xF)));
+        } else {
+            chip8PressKeys(&_vm, (uint16_t) ((_vm.cycles * 0x9E3779B97F4A7C15ULL) >> 48));
+        }
+        if (ran == 0) {
+            break;
+        }
+    }
+    _check(&_vm);
+}
+
+/* what has to hold whatever the ROM did */
+static void _check(const Chip8* vm) {
+    const char* broken = NULL;
+    /* a mask, not a compare: with 64K of memory no uint16_t pc is out of range */
+    if (vm->pc & ~(C8_MEMORY_SIZE - 1)) {
+        broken = "pc is past the end of memory";
+    } else if (vm->sp > C8_STACK_SIZE) {
+        broken = "sp is past the end of the stack";
+    } else {
+        for (int i = 0; i < C8_DECODED_AMOUNT; i++) {
+            const Chip8Ins* ins = &vm->decoded[i];
+            if (ins->op && ins->opcode != (vm->memory[2 * i] << 8 | vm->memory[2 * i + 1])) {
+                broken = "the decode cache doesn't match memory";
+                break;
+            }
+        }
+    }
+    if (broken) {
+        fprintf(stderr, "%s (pc=0x%X sp=%d I=0x%X)\n", broken, vm->pc, vm->sp, vm->I);
+        abort();
+    }
+}
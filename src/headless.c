@@ -0,0 +1,713 @@
+#include "chip8.h"
+#include "chip8jit.h"
+#include "chip8pool.h"
+#include "chip8batch.h"
+#include "chip8movie.h"
+#include "chip8romcache.h"
+#include "chip8trace.h"
+#include "chip8ops.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define HL_CYCLES_PER_FRAME     (C8_CLOCK_SPEED / C8_TIMER_SPEED)
+#define HL_DEFAULT_FRAMES       (C8_TIMER_SPEED * 60)   /* a minute of emulated time */
+
+/* a line of a -Q file: a ROM, by hash or file name, and its quirk profile */
+typedef struct HlQuirkRule {
+    uint64_t hash;
+    char name[256];         /* empty when it goes by hash */
+    int profile;
+} HlQuirkRule;
+
+static uint64_t _seed = C8_DEFAULT_SEED;    /* what every VM's Cxkk gets seeded with */
+static const char* _statePath = NULL;       /* -l, a save state to start from */
+static const char* _savePath = NULL;        /* -w, where to save the final state */
+static FILE* _profileFile = NULL;           /* -P, execution counts of every ROM go here */
+static int _profileCsv = 0;
+static int _profiled = 0;                   /* ROMs written to _profileFile so far */
+static FILE* _dumpFile = NULL;              /* -d, final VM dumps of every ROM go here */
+static int _dumpJson = 0;
+static int _dumped = 0;
+static Chip8RomCache* _roms = NULL;         /* every ROM is read once, runs reset from here */
+static Chip8Tracer* _tracer = NULL;         /* -T, plain runs get traced into it one after another */
+static int _quirks = C8_QUIRKS_DEFAULT;     /* -q, the quirk profile ROMs run with */
+static HlQuirkRule* _quirkRules = NULL;     /* -Q, profiles for particular ROMs */
+static int _quirkRuleCount = 0;
+
+static const char** _collect_roms(const char** args, int count, int* found);
+static int _run_rom(Chip8* vm, Chip8Jit* jit, const char* path, uint64_t cycles);
+static int _verify_jit(Chip8* vm, Chip8Jit* jit, const char* path, uint64_t cycles);
+static int _run_pool(int threads, int runs, const char** paths, int count, uint64_t cycles);
+static int _run_batch(int lanes, const char* path, uint64_t cycles);
+static int _replay_movie(const char* moviePath, const char* path);
+static uint8_t* _read_file(const char* path, size_t* size);
+static int _load_state_file(Chip8* vm, const char* path);
+static int _save_state_file(const Chip8* vm, const char* path);
+static void _write_profile(const Chip8* vm, const char* path);
+static void _write_dump(const Chip8* vm, const char* path);
+static void _write_json_string(FILE* file, const char* str);
+static int _dump_trace(const char* path);
+static int _load_quirk_rules(const char* path);
+static int _quirks_for(const char* path);
+static void _usage(const char* prog);
+
+/**
+ * Runs one or more ROMs without a window, at full host speed, for a fixed
+ * budget of cycles (or 60hz frames) each. Prints the achieved instructions
+ * per second and a hash of the final VM state.
+ */
+int main(int argc, char const *argv[])
+{
+    uint64_t cycles = (uint64_t) HL_DEFAULT_FRAMES * HL_CYCLES_PER_FRAME;
+    int useJit = 0;
+    int verify = 0;
+    int threads = -1;
+    int runs = 1;
+    int lanes = 0;
+    const char* moviePath = NULL;
+    const char* profilePath = NULL;
+    const char* tracePath = NULL;
+    const char* traceFilter = NULL;
+    const char* dumpPath = NULL;
+    const char* vmDumpPath = NULL;
+    int first = 1;
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-c") == 0 && first + 1 < argc) {
+            cycles = strtoull(argv[first + 1], NULL, 10);
+            first += 2;
+        } else if (strcmp(argv[first], "-f") == 0 && first + 1 < argc) {
+            cycles = strtoull(argv[first + 1], NULL, 10) * HL_CYCLES_PER_FRAME;
+            first += 2;
+        } else if (strcmp(argv[first], "-j") == 0) {
+            useJit = 1;
+            first++;
+        } else if (strcmp(argv[first], "-v") == 0) {
+            verify = 1;
+            first++;
+        } else if (strcmp(argv[first], "-p") == 0 && first + 1 < argc) {
+            threads = atoi(argv[first + 1]);
+            first += 2;
+        } else if (strcmp(argv[first], "-n") == 0 && first + 1 < argc) {
+            runs = atoi(argv[first + 1]);
+            first += 2;
+        } else if (strcmp(argv[first], "-s") == 0 && first + 1 < argc) {
+            _seed = strtoull(argv[first + 1], NULL, 0);
+            first += 2;
+        } else if (strcmp(argv[first], "-l") == 0 && first + 1 < argc) {
+            _statePath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-w") == 0 && first + 1 < argc) {
+            _savePath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-P") == 0 && first + 1 < argc) {
+            profilePath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-d") == 0 && first + 1 < argc) {
+            vmDumpPath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-q") == 0 && first + 1 < argc) {
+            _quirks = chip8QuirksByName(argv[first + 1]);
+            if (_quirks < 0) {
+                printf("no quirk profile called %s\n", argv[first + 1]);
+                return 1;
+            }
+            first += 2;
+        } else if (strcmp(argv[first], "-Q") == 0 && first + 1 < argc) {
+            if (!_load_quirk_rules(argv[first + 1])) {
+                return 1;
+            }
+            first += 2;
+        } else if (strcmp(argv[first], "-T") == 0 && first + 1 < argc) {
+            tracePath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-F") == 0 && first + 1 < argc) {
+            traceFilter = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-D") == 0 && first + 1 < argc) {
+            dumpPath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-m") == 0 && first + 1 < argc) {
+            moviePath = argv[first + 1];
+            first += 2;
+        } else if (strcmp(argv[first], "-b") == 0 && first + 1 < argc) {
+            lanes = atoi(argv[first + 1]);
+            first += 2;
+        } else {
+            _usage(argv[0]);
+            return 1;
+        }
+    }
+    if (dumpPath) {
+        return !_dump_trace(dumpPath);
+    }
+    /* only a plain (or -j) run has one VM per ROM to load into, save, dump, profile or trace */
+    const char* mode = moviePath ? "-m" : threads >= 0 ? "-p" : lanes > 0 ? "-b" : verify ? "-v" : NULL;
+    if (mode && (_statePath || _savePath || vmDumpPath || profilePath || tracePath)) {
+        printf("-l, -w, -d, -P and -T don't work with %s\n", mode);
+        _usage(argv[0]);
+        return 1;
+    }
+    if (first >= argc) {
+        _usage(argv[0]);
+        return 1;
+    }
+
+    if (profilePath) {
+#ifndef C8_PROFILE
+        printf("this build doesn't count anything, rebuild with 'make PROFILE=1' for -P\n");
+        return 1;
+#endif
+        size_t len = strlen(profilePath);
+        _profileCsv = len >= 4 && strcmp(profilePath + len - 4, ".csv") == 0;
+        _profileFile = fopen(profilePath, "w");
+        if (!_profileFile) {
+            printf("could not open %s\n", profilePath);
+            return 1;
+        }
+        fputs(_profileCsv ? C8_PROFILE_CSV_HEADER : "{", _profileFile);
+    }
+    if (vmDumpPath) {
+        size_t len = strlen(vmDumpPath);
+        _dumpJson = len >= 5 && strcmp(vmDumpPath + len - 5, ".json") == 0;
+        _dumpFile = fopen(vmDumpPath, "w");
+        if (!_dumpFile) {
+            printf("could not open %s\n", vmDumpPath);
+            return 1;
+        }
+        fputs(_dumpJson ? "{" : "", _dumpFile);
+    }
+    if (tracePath) {
+#ifndef C8_TRACE
+        printf("this build doesn't trace, rebuild with 'make TRACE=1' for -T\n");
+        return 1;
+#endif
+        Chip8TraceFilter filter;
+        if (traceFilter && !chip8TracerParseFilter(traceFilter, &filter)) {
+            printf("bad trace filter %s\n", traceFilter);
+            return 1;
+        }
+        /* lossless: nothing's watching the clock here, and a trace with holes in it is no good */
+        _tracer = chip8TracerCreate(tracePath, 0, 1);
+        if (!_tracer) {
+            printf("could not open %s\n", tracePath);
+            return 1;
+        }
+        if (traceFilter) {
+            chip8TracerSetFilter(_tracer, &filter);
+        }
+    }
+
+    _roms = chip8RomCacheCreate();
+    int count = 0;
+    const char** paths = _roms ? _collect_roms(argv + first, argc - first, &count) : NULL;
+    if (!paths) {
+        chip8RomCacheDestroy(_roms);
+        return 1;
+    }
+
+    int failed = 0;
+    if (moviePath) {
+        for (int i = 0; i < count; i++) {
+            if (!_replay_movie(moviePath, paths[i])) {
+                failed = 1;
+            }
+        }
+    } else if (threads >= 0) {
+        failed = !_run_pool(threads, runs, paths, count, cycles);
+    } else if (lanes > 0) {
+        for (int i = 0; i < count; i++) {
+            if (!_run_batch(lanes, paths[i], cycles)) {
+                failed = 1;
+            }
+        }
+    } else {
+        Chip8Jit* jit = NULL;
+        if (useJit || verify) {
+            jit = chip8JitCreate();
+            if (!jit) {
+                printf("the JIT isn't available on this host\n");
+                failed = 1;
+            }
+        }
+        Chip8* vm = failed ? NULL : calloc(1, sizeof(Chip8));
+        for (int i = 0; vm && i < count; i++) {
+            int ok = verify
+                ? _verify_jit(vm, jit, paths[i], cycles)
+                : _run_rom(vm, jit, paths[i], cycles);
+            if (!ok) {
+                failed = 1;
+            }
+        }
+        if (!vm) {
+            failed = 1;
+        }
+        chip8Destroy(vm);
+        free(vm);
+        chip8JitDestroy(jit);
+    }
+    if (_profileFile) {
+        fputs(_profileCsv ? "" : "}\n", _profileFile);
+        fclose(_profileFile);
+    }
+    if (_dumpFile) {
+        fputs(_dumpJson ? "}\n" : "", _dumpFile);
+        fclose(_dumpFile);
+    }
+    chip8TracerDestroy(_tracer);
+    free(_quirkRules);
+    free(paths);
+    chip8RomCacheDestroy(_roms);
+    return failed;
+}
+
+static void _usage(const char* prog) {
+    printf("Usage: %s [-c cycles | -f frames] [-s seed] [-q quirks] [-Q rules] [-l state] [-w state] [-P profile] [-d dump] [-T trace [-F filter]] [-j | -v | -p threads [-n runs] | -b lanes | -m movie] rom|dir [rom|dir...]\n", prog);
+    printf("  a directory stands for every ROM in it\n");
+    printf("  -l, -w, -P, -d and -T only go with a plain run or -j\n");
+    printf("  -l  start from a save state instead of a fresh VM (the ROM is loaded first)\n");
+    printf("  -w  write the final state to a file, for -l to pick up later\n");
+    printf("  -P  write per-instruction and per-address counts (.json or .csv), needs 'make PROFILE=1'\n");
+    printf("  -d  write every ROM's final VM (memory, registers, screen...) as text, or as JSON if it ends in .json\n");
+    printf("  -T  write every instruction run to a binary trace, needs 'make TRACE=1'\n");
+    printf("  -F  only trace some of them, e.g. pc=200-2FF,op=D,op=F (pc range, opcode families)\n");
+    printf("  -D  print a trace file as text and exit\n");
+    printf("  -q  quirk profile to run the ROMs with, one of");
+    for (int i = 0; i < C8_QUIRKS_COUNT; i++) {
+        printf(" %s", chip8QuirksName(i));
+    }
+    printf("\n");
+    printf("  -Q  file of '<rom hash or file name> <profile>' lines, for ROMs that need their own\n");
+    printf("  -s  seed for the VMs' random numbers (Cxkk), the same seed gives the same run\n");
+    printf("  -j  run on the JIT instead of the interpreter\n");
+    printf("  -v  run on both and check they end up in the same state\n");
+    printf("  -p  run every ROM in parallel on a VM pool (0 threads = one per core)\n");
+    printf("  -n  with -p, queue each ROM this many times\n");
+    printf("  -b  run each ROM on that many lanes of a lockstep batch\n");
+    printf("  -m  replay a recorded movie on the ROM and check it ends the same way\n");
+}
+
+/**
+ * Loads every ROM named on the command line into the cache and returns
+ * their paths, with each directory swapped for the ROMs that were in it.
+ * A path that doesn't load stays in, so it gets reported when it's run.
+ */
+static const char** _collect_roms(const char** args, int count, int* found) {
+    int cap = count > 0 ? count : 1;
+    const char** paths = malloc(cap * sizeof(const char*));
+    *found = 0;
+    for (int i = 0; paths && i < count; i++) {
+        int before = chip8RomCacheCount(_roms);
+        int loaded = chip8RomCacheLoadDir(_roms, args[i]);
+        int added = loaded < 0 ? 1 : chip8RomCacheCount(_roms) - before;
+        if (*found + added > cap) {
+            cap = (*found + added) * 2;
+            const char** grown = realloc(paths, cap * sizeof(const char*));
+            if (!grown) {
+                free(paths);
+                return NULL;
+            }
+            paths = grown;
+        }
+        if (loaded < 0) {
+            chip8RomCacheLoad(_roms, args[i]);
+            paths[(*found)++] = args[i];
+        } else {
+            for (int r = before; r < before + added; r++) {
+                paths[(*found)++] = chip8RomCacheGet(_roms, r)->path;
+            }
+        }
+    }
+    return paths;
+}
+
+static int _run_rom(Chip8* vm, Chip8Jit* jit, const char* path, uint64_t cycles) {
+    if (!chip8LoadCachedRom(vm, chip8RomCacheLoad(_roms, path))) {
+        printf("%s: could not load rom\n", path);
+        return 0;
+    }
+    chip8Seed(vm, _seed);
+    chip8SetQuirks(vm, _quirks_for(path));
+    if (_statePath && !_load_state_file(vm, _statePath)) {
+        printf("%s: could not load state %s\n", path, _statePath);
+        return 0;
+    }
+    chip8JitFlush(jit);
+    chip8TracerAttach(_tracer, vm);
+
+    double start = chip8NowSeconds();
+    uint64_t ran = chip8JitRunFor(jit, vm, cycles);
+    double elapsed = chip8NowSeconds() - start;
+    chip8TracerAttach(NULL, vm);
+
+    _write_profile(vm, path);
+    _write_dump(vm, path);
+    if (_savePath && !_save_state_file(vm, _savePath)) {
+        printf("%s: could not save state to %s\n", path, _savePath);
+        return 0;
+    }
+
+    double ips = elapsed > 0 ? ran / elapsed : 0;
+    printf("%s: cycles=%llu time=%.6fs ips=%.0f err=%d hash=0x%016llX\n",
+        path,
+        (unsigned long long) ran,
+        elapsed,
+        ips,
+        vm->err,
+        (unsigned long long) chip8StateHash(vm)
+    );
+    return vm->err == C8_ERR_NONE;
+}
+
+static int _verify_jit(Chip8* vm, Chip8Jit* jit, const char* path, uint64_t cycles) {
+    Chip8* ref = calloc(1, sizeof(Chip8));
+    if (!ref) {
+        return 0;
+    }
+    const Chip8Rom* rom = chip8RomCacheLoad(_roms, path);
+    if (!chip8LoadCachedRom(vm, rom) || !chip8LoadCachedRom(ref, rom)) {
+        printf("%s: could not load rom\n", path);
+        free(ref);
+        return 0;
+    }
+    chip8Seed(vm, _seed);
+    chip8Seed(ref, _seed);
+    chip8SetQuirks(vm, _quirks_for(path));
+    chip8SetQuirks(ref, _quirks_for(path));
+    chip8JitFlush(jit);
+
+    uint64_t ranJit = chip8JitRunFor(jit, vm, cycles);
+    uint64_t ranRef = chip8RunFor(ref, cycles);
+    uint64_t hashJit = chip8StateHash(vm);
+    uint64_t hashRef = chip8StateHash(ref);
+    int same = ranJit == ranRef
+        && hashJit == hashRef
+        && vm->opcode == ref->opcode
+        && vm->err == ref->err
+        && vm->running == ref->running
+        && vm->waitingForKey == ref->waitingForKey;
+
+    printf("%s: %s cycles=%llu/%llu hash=0x%016llX/0x%016llX\n",
+        path,
+        same ? "match" : "MISMATCH",
+        (unsigned long long) ranJit,
+        (unsigned long long) ranRef,
+        (unsigned long long) hashJit,
+        (unsigned long long) hashRef
+    );
+    free(ref);
+    return same;
+}
+
+/* queues runs copies of every ROM on a pool and reports each job */
+static int _run_pool(int threads, int runs, const char** paths, int count, uint64_t cycles) {
+    Chip8Pool* pool = chip8PoolCreate(threads);
+    const Chip8Rom** roms = calloc(count, sizeof(const Chip8Rom*));
+    if (!pool || !roms) {
+        chip8PoolDestroy(pool);
+        free(roms);
+        return 0;
+    }
+    chip8PoolSetSeed(pool, _seed);
+    int ok = 1;
+    for (int i = 0; i < count; i++) {
+        roms[i] = chip8RomCacheLoad(_roms, paths[i]);
+        if (!roms[i]) {
+            printf("%s: could not load rom\n", paths[i]);
+            ok = 0;
+            continue;
+        }
+        chip8PoolSetQuirks(pool, _quirks_for(paths[i]));
+        for (int r = 0; r < runs; r++) {
+            chip8PoolAdd(pool, roms[i]->data, roms[i]->size, cycles);
+        }
+    }
+
+    double start = chip8NowSeconds();
+    chip8PoolRun(pool);
+    double elapsed = chip8NowSeconds() - start;
+
+    uint64_t total = 0;
+    int job = 0;
+    for (int i = 0; i < count; i++) {
+        if (!roms[i]) {
+            continue;
+        }
+        for (int r = 0; r < runs; r++, job++) {
+            const Chip8PoolResult* res = chip8PoolGetResult(pool, job);
+            if (!res->loaded) {
+                printf("%s: could not load rom\n", paths[i]);
+                ok = 0;
+                continue;
+            }
+            total += res->cycles;
+            printf("%s: cycles=%llu err=%d hash=0x%016llX screen=0x%016llX\n",
+                paths[i],
+                (unsigned long long) res->cycles,
+                res->err,
+                (unsigned long long) res->stateHash,
+                (unsigned long long) res->screenHash
+            );
+            if (res->err != C8_ERR_NONE) {
+                ok = 0;
+            }
+        }
+    }
+    printf("pool: jobs=%d threads=%d time=%.6fs ips=%.0f\n",
+        chip8PoolJobCount(pool),
+        chip8PoolThreadCount(pool),
+        elapsed,
+        elapsed > 0 ? total / elapsed : 0
+    );
+
+    chip8PoolDestroy(pool);
+    free(roms);
+    return ok;
+}
+
+/* one batch per ROM, reports lane 0 and how much ran lane-wide */
+static int _run_batch(int lanes, const char* path, uint64_t cycles) {
+    const Chip8Rom* rom = chip8RomCacheLoad(_roms, path);
+    Chip8Batch* batch = chip8BatchCreate(lanes);
+    if (!rom || !batch || !chip8BatchLoad(batch, rom->data, rom->size)) {
+        printf("%s: could not load rom\n", path);
+        chip8BatchDestroy(batch);
+        return 0;
+    }
+    for (int i = 0; i < lanes; i++) {
+        chip8Seed(chip8BatchGetVM(batch, i), _seed);
+        chip8SetQuirks(chip8BatchGetVM(batch, i), _quirks_for(path));
+    }
+
+    double start = chip8NowSeconds();
+    uint64_t total = 0;
+    for (uint64_t left = cycles; left > 0; ) {
+        uint32_t step = left > UINT32_MAX ? UINT32_MAX : (uint32_t) left;
+        uint64_t ran = chip8BatchRun(batch, step);
+        total += ran;
+        left -= step;
+        if (ran == 0) {
+            break;
+        }
+    }
+    double elapsed = chip8NowSeconds() - start;
+
+    uint64_t lockstep = 0, scalar = 0;
+    chip8BatchGetStats(batch, &lockstep, &scalar);
+    Chip8* vm = chip8BatchGetVM(batch, 0);
+    printf("%s: lanes=%d cycles=%llu time=%.6fs ips=%.0f lockstep=%.1f%% err=%d hash=0x%016llX\n",
+        path,
+        lanes,
+        (unsigned long long) vm->cycles,
+        elapsed,
+        elapsed > 0 ? total / elapsed : 0,
+        lockstep + scalar > 0 ? 100.0 * lockstep / (lockstep + scalar) : 0,
+        vm->err,
+        (unsigned long long) chip8StateHash(vm)
+    );
+    int ok = vm->err == C8_ERR_NONE;
+    chip8BatchDestroy(batch);
+    return ok;
+}
+
+/* replays a movie recorded in the GUI, as fast as it goes */
+static int _replay_movie(const char* moviePath, const char* path) {
+    Chip8Movie* movie = chip8MovieLoad(moviePath);
+    if (!movie) {
+        printf("%s: could not load movie %s\n", path, moviePath);
+        return 0;
+    }
+    Chip8* vm = calloc(1, sizeof(Chip8));
+    if (!vm || !chip8LoadCachedRom(vm, chip8RomCacheLoad(_roms, path))) {
+        printf("%s: could not load rom\n", path);
+        chip8MovieDestroy(movie);
+        free(vm);
+        return 0;
+    }
+    /* the movie knows what it was recorded with, -q and -Q don't apply */
+    chip8SetQuirks(vm, chip8MovieQuirks(movie));
+
+    double start = chip8NowSeconds();
+    int same = chip8MovieReplay(movie, vm);
+    double elapsed = chip8NowSeconds() - start;
+
+    printf("%s: movie=%s quirks=%s events=%zu cycles=%llu time=%.6fs ips=%.0f %s hash=0x%016llX\n",
+        path,
+        moviePath,
+        chip8QuirksName(chip8MovieQuirks(movie)),
+        chip8MovieEventCount(movie),
+        (unsigned long long) vm->cycles,
+        elapsed,
+        elapsed > 0 ? vm->cycles / elapsed : 0,
+        same ? "match" : "MISMATCH",
+        (unsigned long long) chip8StateHash(vm)
+    );
+    chip8MovieDestroy(movie);
+    chip8Destroy(vm);
+    free(vm);
+    return same;
+}
+
+/* JSON is one object keyed by ROM path, CSV has the path in the first column */
+static void _write_profile(const Chip8* vm, const char* path) {
+    if (!_profileFile) {
+        return;
+    }
+    if (_profileCsv) {
+        chip8ProfileWriteCsv(vm, _profileFile, path);
+    } else {
+        fputs(_profiled ? ",\n" : "\n", _profileFile);
+        _write_json_string(_profileFile, path);
+        fputc(':', _profileFile);
+        chip8ProfileWriteJson(vm, _profileFile);
+    }
+    _profiled++;
+}
+
+static void _write_dump(const Chip8* vm, const char* path) {
+    if (!_dumpFile) {
+        return;
+    }
+    if (_dumpJson) {
+        fputs(_dumped ? ",\n" : "\n", _dumpFile);
+        _write_json_string(_dumpFile, path);
+        fputc(':', _dumpFile);
+        chip8VMDumpJson(vm, _dumpFile);
+    } else {
+        fprintf(_dumpFile, "%s%s:\n", _dumped ? "\n" : "", path);
+        chip8VMDump(vm, _dumpFile);
+    }
+    _dumped++;
+}
+
+static void _write_json_string(FILE* file, const char* str) {
+    fputc('"', file);
+    for (const char* c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static int _dump_trace(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("could not open %s\n", path);
+        return 0;
+    }
+    long count = chip8TraceDump(file, stdout);
+    fclose(file);
+    if (count < 0) {
+        printf("%s isn't a trace\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Reads a -Q file. Every line is a ROM, as the 16 hex digit FNV-1a hash of
+ * its bytes or as a file name (no directories), then a profile name. # starts
+ * a comment.
+ */
+static int _load_quirk_rules(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("could not open %s\n", path);
+        return 0;
+    }
+    char line[512];
+    int lineNo = 0;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), file)) {
+        lineNo++;
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char key[256];
+        char name[64];
+        int fields = sscanf(line, "%255s %63s", key, name);
+        if (fields <= 0) {
+            continue;
+        }
+        int profile = fields == 2 ? chip8QuirksByName(name) : -1;
+        HlQuirkRule* rules = profile >= 0 ? realloc(_quirkRules, (_quirkRuleCount + 1) * sizeof(HlQuirkRule)) : NULL;
+        if (!rules) {
+            printf("%s:%d: expected '<rom hash or file name> <profile>'\n", path, lineNo);
+            ok = 0;
+            break;
+        }
+        _quirkRules = rules;
+        HlQuirkRule* rule = &_quirkRules[_quirkRuleCount++];
+        char* end = NULL;
+        rule->hash = strtoull(key, &end, 16);
+        rule->name[0] = '\0';
+        rule->profile = profile;
+        /* anything that doesn't read as a full hash is a name */
+        if (*end != '\0' || strlen(key) < 16) {
+            strcpy(rule->name, key);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+/* the -Q rule for the ROM at path, the -q profile if there isn't one */
+static int _quirks_for(const char* path) {
+    const Chip8Rom* rom = chip8RomCacheLoad(_roms, path);
+    const char* base = path;
+    for (const char* c = path; *c; c++) {
+        if (*c == '/' || *c == '\\') {
+            base = c + 1;
+        }
+    }
+    for (int i = 0; i < _quirkRuleCount; i++) {
+        const HlQuirkRule* rule = &_quirkRules[i];
+        if (rule->name[0] ? strcmp(rule->name, base) == 0 : rom && rom->hash == rule->hash) {
+            return rule->profile;
+        }
+    }
+    return _quirks;
+}
+
+static int _load_state_file(Chip8* vm, const char* path) {
+    size_t size = 0;
+    uint8_t* buf = _read_file(path, &size);
+    int ok = buf && chip8LoadState(vm, buf, size);
+    free(buf);
+    return ok;
+}
+
+static int _save_state_file(const Chip8* vm, const char* path) {
+    uint8_t buf[C8_STATE_SIZE];
+    size_t size = chip8SaveState(vm, buf, sizeof(buf));
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    int ok = size > 0 && fwrite(buf, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+static uint8_t* _read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0L, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    uint8_t* buf = len > 0 ? malloc(len) : NULL;
+    if (buf && fread(buf, 1, len, file) != (size_t) len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(file);
+    *size = buf ? (size_t) len : 0;
+    return buf;
+}
+
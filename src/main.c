@@ -7,12 +7,20 @@
 
 int main(int argc, char const *argv[])
 {
-    if (argc != 2) {
-        printf("Usage: ./Chip8Win.exe path_to_game\n");
-        return 1;
+    int quirks = C8_QUIRKS_DEFAULT;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-q") == 0) {
+        quirks = chip8QuirksByName(argv[2]);
+        if (quirks < 0) {
+            printf("no quirk profile called %s\n", argv[2]);
+            return 1;
+        }
+        first = 3;
     }
-    if (argc == 2) {
-        guiInitAndRun(argv[1]);
+    if (argc - first != 1 && argc - first != 2) {
+        printf("Usage: ./Chip8Win.exe [-q quirks] path_to_game [movie_to_record]\n");
+        return 1;
     }
+    guiInitAndRun(argv[first], argc - first == 2 ? argv[first + 1] : NULL, quirks);
     return 0;
 }
@@ -0,0 +1,236 @@
+#include "chip8.h"
+#include "chip8rewind.h"
+#include "chip8batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define TEST_FRAMES             60
+#define TEST_FRAME_CYCLES       10  /* 600 hz over 60 fps */
+#define TEST_LANES              4
+#define TEST_BATCH_CALLS        30
+#define TEST_BATCH_CYCLES       500 /* per call */
+
+/* counts a failure and says where, without stopping the test */
+#define TEST_CHECK(cond) _check((cond), #cond, __func__, __LINE__)
+
+/* draws and stores random digits all over the place, so every frame changes memory, the screen and timers */
+static const uint8_t _rom_busy[] = {
+    0xA3, 0x00,     /* 200: LD I, 300 */
+    0xC0, 0xFF,     /* 202: RND V0, FF */
+    0xF0, 0x33,     /* 204: LD B, V0 */
+    0xF0, 0x15,     /* 206: LD DT, V0 */
+    0xD0, 0x15,     /* 208: DRW V0, V1, 5 */
+    0x71, 0x01,     /* 20A: ADD V1, 1 */
+    0xF1, 0x55,     /* 20C: LD [I], V1 */
+    0x12, 0x02,     /* 20E: JP 202 */
+};
+
+/* sets both timers, then sits on Fx0A while they run down */
+static const uint8_t _rom_key_wait[] = {
+    0x60, 0x3C,     /* 200: LD V0, 3C */
+    0xF0, 0x15,     /* 202: LD DT, V0 */
+    0xF0, 0x18,     /* 204: LD ST, V0 */
+    0xF1, 0x0A,     /* 206: LD V1, K */
+    0x12, 0x06,     /* 208: JP 206 */
+};
+
+static int _failed = 0;
+
+static void _check(int ok, const char* what, const char* test, int line);
+static Chip8* _load_busy(uint64_t seed);
+static void _test_state_round_trip(void);
+static void _test_state_rejects(void);
+static void _test_rewind_round_trip(void);
+static void _test_rewind_far_memory(void);
+static void _test_batch_key_wait(void);
+
+/**
+ * Checks the save states and the rewind buffer put the VM back where it
+ * was, and the batch runner ends up where plain runs do. 'make test'
+ * runs it, 'make clean test XOCHIP=1' does the same on the 64K build.
+ */
+int main(void)
+{
+    _test_state_round_trip();
+    _test_state_rejects();
+    _test_rewind_round_trip();
+    _test_rewind_far_memory();
+    _test_batch_key_wait();
+    if (_failed) {
+        printf("%d check(s) failed\n", _failed);
+        return 1;
+    }
+    printf("all tests passed (%u bytes of memory, %u byte states)\n", C8_MEMORY_SIZE, (unsigned) C8_STATE_SIZE);
+    return 0;
+}
+
+static void _check(int ok, const char* what, const char* test, int line) {
+    if (!ok) {
+        printf("%s:%d: %s failed\n", test, line, what);
+        _failed++;
+    }
+}
+
+static Chip8* _load_busy(uint64_t seed) {
+    Chip8* vm = calloc(1, sizeof(Chip8));
+    if (!vm || !chip8LoadFromArray(vm, _rom_busy, sizeof(_rom_busy))) {
+        free(vm);
+        return NULL;
+    }
+    chip8Seed(vm, seed);
+    return vm;
+}
+
+/* save, run on, load: same VM as when it saved, in this one and in a fresh one */
+static void _test_state_round_trip(void) {
+    Chip8* vm = _load_busy(1);
+    Chip8* other = _load_busy(2);
+    uint8_t* state = malloc(C8_STATE_SIZE);
+    TEST_CHECK(vm && other && state);
+    if (!vm || !other || !state) {
+        goto done;
+    }
+    chip8RunFor(vm, 1000);
+    TEST_CHECK(chip8SaveState(vm, state, C8_STATE_SIZE) == C8_STATE_SIZE);
+    uint64_t hash = chip8StateHash(vm);
+    uint64_t screen = chip8ScreenHash(vm);
+
+    chip8RunFor(vm, 1000);
+    TEST_CHECK(chip8StateHash(vm) != hash);
+    TEST_CHECK(chip8LoadState(vm, state, C8_STATE_SIZE));
+    TEST_CHECK(chip8StateHash(vm) == hash);
+    TEST_CHECK(chip8ScreenHash(vm) == screen);
+
+    TEST_CHECK(chip8LoadState(other, state, C8_STATE_SIZE));
+    TEST_CHECK(chip8StateHash(other) == hash);
+
+    /* and both carry on the same way, RNG included */
+    chip8RunFor(vm, 1000);
+    chip8RunFor(other, 1000);
+    TEST_CHECK(chip8StateHash(other) == chip8StateHash(vm));
+
+done:
+    free(vm);
+    free(other);
+    free(state);
+}
+
+/* a short or damaged state leaves the VM alone */
+static void _test_state_rejects(void) {
+    Chip8* vm = _load_busy(1);
+    uint8_t* state = malloc(C8_STATE_SIZE);
+    TEST_CHECK(vm && state);
+    if (!vm || !state) {
+        goto done;
+    }
+    TEST_CHECK(chip8SaveState(vm, state, C8_STATE_SIZE - 1) == 0);
+    chip8SaveState(vm, state, C8_STATE_SIZE);
+    chip8RunFor(vm, 1000);
+    uint64_t hash = chip8StateHash(vm);
+    TEST_CHECK(!chip8LoadState(vm, state, C8_STATE_SIZE - 1));
+    state[0] ^= 0xFF;
+    TEST_CHECK(!chip8LoadState(vm, state, C8_STATE_SIZE));
+    TEST_CHECK(chip8StateHash(vm) == hash);
+
+done:
+    free(vm);
+    free(state);
+}
+
+/* push a frame at a time, then step back through every one of them */
+static void _test_rewind_round_trip(void) {
+    Chip8* vm = _load_busy(3);
+    Chip8Rewind* rw = chip8RewindCreate(C8_REWIND_DEFAULT_BYTES);
+    TEST_CHECK(vm && rw);
+    if (!vm || !rw) {
+        goto done;
+    }
+    uint64_t hashes[TEST_FRAMES];
+    for (int i = 0; i < TEST_FRAMES; i++) {
+        hashes[i] = chip8StateHash(vm);
+        TEST_CHECK(chip8RewindPush(rw, vm));
+        chip8RunFor(vm, TEST_FRAME_CYCLES);
+    }
+    TEST_CHECK(chip8RewindFrames(rw) == TEST_FRAMES - 1);
+    for (int i = TEST_FRAMES - 2; i >= 0; i--) {
+        TEST_CHECK(chip8RewindStep(rw, vm));
+        TEST_CHECK(chip8StateHash(vm) == hashes[i]);
+    }
+    TEST_CHECK(!chip8RewindStep(rw, vm));
+    TEST_CHECK(chip8StateHash(vm) == hashes[0]);
+
+done:
+    chip8RewindDestroy(rw);
+    free(vm);
+}
+
+/* changes more than 64k into the state, which the 64K build's states are way past */
+static void _test_rewind_far_memory(void) {
+    Chip8* vm = _load_busy(4);
+    Chip8Rewind* rw = chip8RewindCreate(C8_REWIND_DEFAULT_BYTES);
+    TEST_CHECK(vm && rw);
+    if (!vm || !rw) {
+        goto done;
+    }
+    uint64_t hash = chip8StateHash(vm);
+    TEST_CHECK(chip8RewindPush(rw, vm));
+    vm->memory[C8_MEMORY_SIZE - 4] ^= 0x5A;
+    TEST_CHECK(chip8RewindPush(rw, vm));
+    TEST_CHECK(chip8RewindPush(rw, vm));
+    TEST_CHECK(chip8RewindStep(rw, vm));
+    TEST_CHECK(chip8RewindStep(rw, vm));
+    TEST_CHECK(chip8StateHash(vm) == hash);
+    TEST_CHECK(vm->memory[C8_MEMORY_SIZE - 4] == 0);
+
+    /* and one that changes all of it, so the literal's longer than 64k too */
+    TEST_CHECK(chip8RewindPush(rw, vm));
+    for (int i = 0; i < C8_MEMORY_SIZE; i++) {
+        vm->memory[i] ^= 0xA5;
+    }
+    TEST_CHECK(chip8RewindPush(rw, vm));
+    TEST_CHECK(chip8RewindStep(rw, vm));
+    TEST_CHECK(chip8StateHash(vm) == hash);
+
+done:
+    chip8RewindDestroy(rw);
+    free(vm);
+}
+
+/**
+ * Batch lanes against chip8RunFor, call after call, with lanes waiting on
+ * a key from one call to the next (and one of them getting it).
+ */
+static void _test_batch_key_wait(void) {
+    Chip8Batch* batch = chip8BatchCreate(TEST_LANES);
+    Chip8* ref = calloc(TEST_LANES, sizeof(Chip8));
+    TEST_CHECK(batch && ref);
+    if (!batch || !ref) {
+        goto done;
+    }
+    TEST_CHECK(chip8BatchLoad(batch, _rom_key_wait, sizeof(_rom_key_wait)));
+    for (int i = 0; i < TEST_LANES; i++) {
+        TEST_CHECK(chip8LoadFromArray(&ref[i], _rom_key_wait, sizeof(_rom_key_wait)));
+    }
+    for (int call = 0; call < TEST_BATCH_CALLS; call++) {
+        uint16_t keys = call == 10 ? 1 << 5 : 0;
+        chip8PressKeys(chip8BatchGetVM(batch, 1), keys);
+        chip8PressKeys(&ref[1], keys);
+        chip8BatchRun(batch, TEST_BATCH_CYCLES);
+        for (int i = 0; i < TEST_LANES; i++) {
+            chip8RunFor(&ref[i], TEST_BATCH_CYCLES);
+        }
+    }
+    for (int i = 0; i < TEST_LANES; i++) {
+        const Chip8* lane = chip8BatchGetVM(batch, i);
+        TEST_CHECK(lane->delayTimer == ref[i].delayTimer);
+        TEST_CHECK(lane->soundTimer == ref[i].soundTimer);
+        TEST_CHECK(chip8StateHash(lane) == chip8StateHash(&ref[i]));
+    }
+
+done:
+    chip8BatchDestroy(batch);
+    free(ref);
+}